@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""
+Performance regression harness (`make bench`): run the matrices of a suite
+through every registered method in fp64 and fp32, store the results as a
+baseline on the first run, and on later runs compare against it.
+
+A (matrix, value type, method, threads) regresses when its median SpMV time
+grows by more than the threshold and by more than twice the run-to-run noise
+estimated from the per-iteration coefficients of variation (--stats) of the
+baseline and current runs.  Methods that ran in the baseline but no longer
+give a correct result also count.  The harness prints the comparison table
+and exits with status 1 if anything regressed.
+
+Usage:
+    ./bench.py [--suite=bench_suite.txt] [--baseline=bench_baseline.csv]
+               [--threshold=<percent, default 5>] [--update] [-- <cpu_spmv args>]
+
+--update replaces the baseline with the current run.  cpu_spmv runs with
+--i=500 unless given other arguments, e.g. `-- --i=2000 --threads=16`, and
+with every method it lists under --help (including those not run by default)
+unless given --methods.
+"""
+
+import csv
+import math
+import os
+import shutil
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def run_batch(command):
+    """
+    Run a cpu_spmv batch to completion: the --timeout watchdog ends the process
+    with status 2 after recording the matrix that hung, so rerun the same
+    command (which skips the recorded matrices) until it exits otherwise
+    """
+    while True:
+        status = subprocess.call(command, stdout=subprocess.DEVNULL, cwd=HERE)
+        if status != 2:
+            return status
+        sys.stderr.write("cpu_spmv stopped by its watchdog; resuming\n")
+
+
+def registered_methods():
+    """Names of every method the cpu_spmv build registers, from its --help"""
+    output = subprocess.check_output(["./cpu_spmv", "--help"], cwd=HERE, universal_newlines=True)
+    lines = output.split("\n")
+    methods = []
+    for line in lines[lines.index("SpMV methods:") + 1:]:
+        if not line.startswith("\t"):
+            break
+        methods.append(line.split()[0])
+    return methods
+
+
+def run_suite(suite, spmv_args):
+    """Run the suite in fp64 and fp32 into a fresh results file; returns its name"""
+    results = os.path.join(HERE, "bench_results.csv")
+    if os.path.exists(results):
+        os.remove(results)
+    for fp_args in ([], ["--fp32"]):
+        partial = results + ".part"
+        if os.path.exists(partial):
+            os.remove(partial)
+        # (the cpu_spmv wrapper runs the driver from its own directory)
+        command = ["./cpu_spmv", "--list=" + suite, "--results=" + partial, "--stats", "--quiet"] + fp_args + spmv_args
+        print(" ".join(command))
+        sys.stdout.flush()
+        if run_batch(command) != 0:
+            sys.stderr.write("cpu_spmv failed\n")
+            sys.exit(2)
+        with open(partial) as src, open(results, "a") as dst:
+            lines = src.readlines()
+            dst.writelines(lines if os.path.getsize(results) == 0 else lines[1:])
+        os.remove(partial)
+    return results
+
+
+def load(filename):
+    """(matrix, value_type, method, threads) -> (median ms, cv), and the machines measured on"""
+    entries, machines = {}, set()
+    with open(filename) as f:
+        for record in csv.DictReader(f, skipinitialspace=True):
+            if not record.get("method") or record.get("affinity", "").startswith("sweep"):
+                continue
+            key = (record["matrix"], record["value_type"], record["method"], record["threads"])
+            machines.add("%s (%s)" % (record.get("cpu_model"), record.get("host")))
+            ok = record["status"] == "ok" and record["correct"] == "true"
+            ms = record.get("median_ms") or record.get("avg_ms")
+            entries[key] = (float(ms), float(record.get("cv") or 0)) if ok and ms else None
+    return entries, machines
+
+
+def short_name(matrix):
+    return matrix[4:] if matrix.startswith("gen:") else os.path.basename(matrix)
+
+
+def main(argv):
+    if "--" in argv:
+        split = argv.index("--")
+        argv, spmv_args = argv[:split], argv[split + 1:]
+    else:
+        spmv_args = []
+    if not any(a.startswith("--i=") for a in spmv_args):
+        spmv_args = ["--i=500"] + spmv_args
+    if not any(a.startswith("--methods=") for a in spmv_args):
+        spmv_args = ["--methods=" + ",".join(registered_methods())] + spmv_args
+
+    options = dict((a[2:].split("=", 1) + [""])[:2] for a in argv[1:] if a.startswith("--"))
+    unknown = set(options) - set(["suite", "baseline", "threshold", "update"])
+    if unknown or any(not a.startswith("--") for a in argv[1:]):
+        sys.stderr.write(__doc__)
+        return 2
+    suite = os.path.abspath(options.get("suite") or os.path.join(HERE, "bench_suite.txt"))
+    baseline = os.path.abspath(options.get("baseline") or os.path.join(HERE, "bench_baseline.csv"))
+    threshold = float(options.get("threshold") or 5) / 100
+
+    results = run_suite(suite, spmv_args)
+
+    if "update" in options or not os.path.exists(baseline):
+        shutil.copyfile(results, baseline)
+        print("Stored baseline %s" % baseline)
+        return 0
+
+    base, base_machines = load(baseline)
+    current, current_machines = load(results)
+    if base_machines != current_machines:
+        print("WARNING: baseline measured on %s, current run on %s" % (
+            "; ".join(sorted(base_machines)), "; ".join(sorted(current_machines))))
+
+    rows, regressions = [], 0
+    for key in sorted(set(base) | set(current)):
+        b, c = base.get(key), current.get(key)
+        if b is None and c is None:
+            continue
+        if b is None:
+            rows.append(key + ("-", "%.4f" % c[0], "", "", "new"))
+            continue
+        if c is None:
+            rows.append(key + ("%.4f" % b[0], "-", "", "", "REGRESSED (no correct result)"))
+            regressions += 1
+            continue
+        change = c[0] / b[0] - 1
+        noise = math.sqrt(b[1] ** 2 + c[1] ** 2)
+        if change > threshold and change > 2 * noise:
+            verdict = "REGRESSED"
+            regressions += 1
+        elif -change > threshold and -change > 2 * noise:
+            verdict = "improved"
+        else:
+            verdict = "ok"
+        rows.append(key + ("%.4f" % b[0], "%.4f" % c[0], "%+.1f%%" % (100 * change), "%.1f%%" % (100 * noise), verdict))
+
+    header = ("matrix", "type", "method", "threads", "base ms", "current ms", "change", "noise", "")
+    rows = [(short_name(r[0]),) + tuple(r[1:]) for r in rows]
+    widths = [max(len(str(r[i])) for r in rows + [header]) for i in range(len(header))]
+    for row in [header] + rows:
+        print("  ".join(str(v).ljust(w) for v, w in zip(row, widths)).rstrip())
+
+    print("\n%d of %d regressed by more than %.1f%% (and twice the noise) against %s" % (
+        regressions, len(rows), 100 * threshold, baseline))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
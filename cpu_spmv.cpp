@@ -38,6 +38,11 @@
  *      icpc mergebased_spmv.cpp -openmp -O3 -lrt -fno-alias -xHost -lnuma
  *      export KMP_AFFINITY=granularity=core,scatter
  *
+ * Optional backends (see Makefile)
+ *      -DCUB_MKL       Intel MKL SpMV method and allocator
+ *      -DCUB_NUMA      libnuma placement of matrix and vector storage
+ *      -DCUB_SPMV_PROFILE  Per-thread load-balance timestamps in the merge-based kernels
+ *
  *
  ******************************************************************************/
 
@@ -57,11 +62,20 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <set>
+#include <signal.h>
 
-#include <mkl.h>
+#ifdef CUB_MKL
+    #include <mkl.h>
+#endif
 
 #include "sparse_matrix.h"
 #include "utils.h"
+#include "perf_counters.h"
+#include "roofline.h"
+#include "reorder.h"
+#include "merge_spmv.h"
+#include "spmv_selector.h"
 
 
 
@@ -73,176 +87,29 @@ bool                    g_quiet             = false;        // Whether to displa
 bool                    g_verbose           = false;        // Whether to display output to console
 bool                    g_verbose2          = false;        // Whether to display input to console
 int                     g_omp_threads       = -1;           // Number of openMP threads
-int                     g_expected_calls    = 1000000;
-
-
-//---------------------------------------------------------------------
-// Utility types
-//---------------------------------------------------------------------
-
-struct int2
-{
-    int x;
-    int y;
-};
-
-
-
-/**
- * Counting iterator
- */
-template <
-    typename ValueType,
-    typename OffsetT = ptrdiff_t>
-struct CountingInputIterator
-{
-    // Required iterator traits
-    typedef CountingInputIterator               self_type;              ///< My own type
-    typedef OffsetT                             difference_type;        ///< Type to express the result of subtracting one iterator from another
-    typedef ValueType                           value_type;             ///< The type of the element the iterator can point to
-    typedef ValueType*                          pointer;                ///< The type of a pointer to an element the iterator can point to
-    typedef ValueType                           reference;              ///< The type of a reference to an element the iterator can point to
-    typedef std::random_access_iterator_tag     iterator_category;      ///< The iterator category
-
-    ValueType val;
-
-    /// Constructor
-    inline CountingInputIterator(
-        const ValueType &val)          ///< Starting value for the iterator instance to report
-    :
-        val(val)
-    {}
-
-    /// Postfix increment
-    inline self_type operator++(int)
-    {
-        self_type retval = *this;
-        val++;
-        return retval;
-    }
-
-    /// Prefix increment
-    inline self_type operator++()
-    {
-        val++;
-        return *this;
-    }
-
-    /// Indirection
-    inline reference operator*() const
-    {
-        return val;
-    }
-
-    /// Addition
-    template <typename Distance>
-    inline self_type operator+(Distance n) const
-    {
-        self_type retval(val + n);
-        return retval;
-    }
-
-    /// Addition assignment
-    template <typename Distance>
-    inline self_type& operator+=(Distance n)
-    {
-        val += n;
-        return *this;
-    }
-
-    /// Subtraction
-    template <typename Distance>
-    inline self_type operator-(Distance n) const
-    {
-        self_type retval(val - n);
-        return retval;
-    }
-
-    /// Subtraction assignment
-    template <typename Distance>
-    inline self_type& operator-=(Distance n)
-    {
-        val -= n;
-        return *this;
-    }
-
-    /// Distance
-    inline difference_type operator-(self_type other) const
-    {
-        return val - other.val;
-    }
-
-    /// Array subscript
-    template <typename Distance>
-    inline reference operator[](Distance n) const
-    {
-        return val + n;
-    }
-
-    /// Structure dereference
-    inline pointer operator->()
-    {
-        return &val;
-    }
-
-    /// Equal to
-    inline bool operator==(const self_type& rhs)
-    {
-        return (val == rhs.val);
-    }
-
-    /// Not equal to
-    inline bool operator!=(const self_type& rhs)
-    {
-        return (val != rhs.val);
-    }
-
-    /// ostream operator
-    friend std::ostream& operator<<(std::ostream& os, const self_type& itr)
-    {
-        os << "[" << itr.val << "]";
-        return os;
-    }
-};
-
-
-
-//---------------------------------------------------------------------
-// MergePath Search
-//---------------------------------------------------------------------
-
-
-/**
- * Computes the begin offsets into A and B for the specific diagonal
- */
-template <
-    typename AIteratorT,
-    typename BIteratorT,
-    typename OffsetT,
-    typename CoordinateT>
-inline void MergePathSearch(
-    OffsetT         diagonal,           ///< [in]The diagonal to search
-    AIteratorT      a,                  ///< [in]List A
-    BIteratorT      b,                  ///< [in]List B
-    OffsetT         a_len,              ///< [in]Length of A
-    OffsetT         b_len,              ///< [in]Length of B
-    CoordinateT&    path_coordinate)    ///< [out] (x,y) coordinate where diagonal intersects the merge path
-{
-    OffsetT x_min = std::max(diagonal - b_len, 0);
-    OffsetT x_max = std::min(diagonal, a_len);
-
-    while (x_min < x_max)
-    {
-        OffsetT x_pivot = (x_min + x_max) >> 1;
-        if (a[x_pivot] <= b[diagonal - x_pivot - 1])
-            x_min = x_pivot + 1;    // Contract range up A (down B)
-        else
-            x_max = x_pivot;        // Contract range down A (up B)
-    }
-
-    path_coordinate.x = std::min(x_min, a_len);
-    path_coordinate.y = diagonal - x_min;
-}
+int                     g_expected_calls    = -1;           // SpMV calls to amortize setup over, also passed to Setup() (-1: the timing iterations)
+bool                    g_replicate_x       = false;        // Whether to replicate vector_x onto each NUMA node
+bool                    g_timing_stats      = false;        // Whether to record per-iteration times and report their distribution
+double                  g_max_variation     = 0.05;         // Coefficient of variation above which a run is reported as noisy
+bool                    g_cold              = false;        // Whether to also time each method with caches evicted before every iteration
+bool                    g_cold_clflush      = false;        // Whether to evict by clflush-ing the matrix and vectors (else by streaming a buffer)
+int                     g_cold_iterations   = 100;          // Maximum number of cold timing iterations
+bool                    g_perf_counters     = false;        // Whether to read hardware performance counters around the timed loop
+bool                    g_cache_sim         = false;        // Whether to model vector_x traffic with an LRU simulation per merge-path partition
+size_t                  g_cache_sim_bytes   = 0;            // Simulated cache (--cache-sim=<KB>, 0 for the last-level cache size)
+bool                    g_energy            = false;        // Whether to read RAPL package and DRAM energy around the timed loop
+RaplCounters            g_rapl;                             // Opened at startup (--energy)
+bool                    g_roofline          = false;        // Whether to report each method against the calibrated machine bandwidth
+MachineBandwidth        g_machine;                          // Calibrated at startup (--roofline)
+CpuTopology             g_topology;                         // Physical cores and SMT siblings available to the process
+std::vector<int>        g_sweep_threads;                    // Thread counts to sweep (--sweep-threads), empty to run at g_omp_threads
+double                  g_deadline          = 0;            // WallClockSeconds() after which no further method is started (0 for none)
+std::string             g_affinity;                         // Thread affinity settings, recorded with results
+bool                    g_autotune          = false;        // Whether to pick one method per matrix (cached by matrix fingerprint)
+std::string             g_layout;                           // Storage layout the methods run on (--layout=ends,base1; empty for the CsrMatrix itself)
+int                     g_updates           = 0;            // Batch size of the incremental update study (--updates, 0 for none)
+int                     g_update_batches    = 100;          // Batches applied by the update study
+double                  g_merge_fraction    = DYNAMIC_CSR_MERGE_FRACTION;  // Delta buffer size, as a fraction of the nonzeros, that triggers a merge
 
 
 
@@ -277,711 +144,2672 @@ void SpmvGold(
 }
 
 
-
 //---------------------------------------------------------------------
-// CPU merge-based SpMV
+// Storage layouts
 //---------------------------------------------------------------------
 
-
 /**
- * OpenMP CPU merge-based SpMV
+ * Copy of a CSR matrix in another storage layout (--layout), to run the
+ * methods through each layout a CsrView covers.  "ends" stores separate row
+ * start and end arrays, with a gap before the first row and after every
+ * other row; gaps hold NaN values, so a method that reads them fails
+ * verification.  "base1" makes the offsets and column indices one-based.
  */
 template <
     typename ValueT,
     typename OffsetT>
-void OmpMergeCsrmv(
-    int2*                         thread_coords,
-    int2*                         thread_coord_ends,
-    int                           num_threads,
-    OffsetT                       num_rows,
-    OffsetT                       num_nonzeros,
-    OffsetT*    __restrict        row_offsets,
-    OffsetT*    __restrict        column_indices,
-    ValueT*     __restrict        values,
-    ValueT*     __restrict        vector_x,
-    ValueT*     __restrict        vector_y_out)
+struct CsrLayoutCopy
 {
-    // Temporary storage for inter-thread fix-up after load-balanced work
-    OffsetT     row_carry_out[256];     // The last row-id each worked on by each thread when it finished its path segment
-    ValueT      value_carry_out[256];   // The running total within each thread when it finished its path segment
+    bool                        ends;
+    int                         index_base;
+    OffsetT                     num_rows;
+    OffsetT                     num_cols;
+    OffsetT                     num_stored;         // Entries in the arrays, gaps included
+    OffsetT*                    row_offsets;
+    OffsetT*                    row_end_offsets;
+    OffsetT*                    column_indices;
+    ValueT*                     values;
+
+    CsrLayoutCopy() :
+        ends(false), index_base(0), num_rows(0), num_cols(0), num_stored(0),
+        row_offsets(NULL), row_end_offsets(NULL), column_indices(NULL), values(NULL)
+    {}
+
+    ~CsrLayoutCopy()
+    {
+        Clear();
+    }
 
-    #pragma omp parallel for schedule(static) num_threads(num_threads)
-    for (int tid = 0; tid < num_threads; tid++)
+    /**
+     * Parse a comma-separated list of "ends" and "base1"
+     */
+    bool Parse(const std::string &spec)
     {
-	int2 thread_coord = thread_coords[tid];
-        int2 thread_coord_end = thread_coord_ends[tid];
-        // Consume whole rows
-        for (; thread_coord.x < thread_coord_end.x; ++thread_coord.x)
+        std::istringstream tokens(spec);
+        std::string token;
+        while (std::getline(tokens, token, ','))
         {
-            ValueT running_total = 0.0;
-            for (; thread_coord.y < row_offsets[thread_coord.x + 1]; ++thread_coord.y)
+            if (token == "ends")
+                ends = true;
+            else if (token == "base1")
+                index_base = 1;
+            else
             {
-                running_total += values[thread_coord.y] * vector_x[column_indices[thread_coord.y]];
+                fprintf(stderr, "Unknown --layout '%s' (ends, base1)\n", token.c_str());
+                return false;
             }
-
-            vector_y_out[thread_coord.x] = running_total;
         }
+        return true;
+    }
+
+    /// Whether the methods run on a copy at all
+    bool Enabled() const
+    {
+        return ends || (index_base != 0);
+    }
 
-        // Consume partial portion of thread's last row
-        ValueT running_total = 0.0;
-        for (; thread_coord.y < thread_coord_end.y; ++thread_coord.y)
+    void Init(CsrMatrix<ValueT, OffsetT> &a)
+    {
+        Clear();
+        num_rows    = a.num_rows;
+        num_cols    = a.num_cols;
+        num_stored  = a.num_nonzeros + ((ends) ? 1 + a.num_rows / 2 : 0);
+
+        row_offsets     = (OffsetT*) HostMalloc(sizeof(OffsetT) * (num_rows + 1), 0);
+        row_end_offsets = (ends) ? (OffsetT*) HostMalloc(sizeof(OffsetT) * num_rows, 0) : row_offsets + 1;
+        column_indices  = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_stored, 0);
+        values          = (ValueT*) HostMalloc(sizeof(ValueT) * num_stored, 0);
+
+        OffsetT stored = 0;
+        for (OffsetT row = 0; row <= num_rows; ++row)
         {
-            running_total += values[thread_coord.y] * vector_x[column_indices[thread_coord.y]];
-        }
+            // Gap before the first row and after every other row
+            if (ends && ((row == 0) || ((row % 2 == 0) && (row < num_rows))))
+            {
+                column_indices[stored]  = index_base;
+                values[stored]          = std::numeric_limits<ValueT>::quiet_NaN();
+                ++stored;
+            }
+            if (row == num_rows)
+                break;
 
-        // Save carry-outs
-        row_carry_out[tid] = thread_coord_end.x;
-        value_carry_out[tid] = running_total;
+            row_offsets[row] = stored + index_base;
+            for (OffsetT offset = a.row_offsets[row]; offset < a.row_offsets[row + 1]; ++offset, ++stored)
+            {
+                column_indices[stored]  = a.column_indices[offset] + index_base;
+                values[stored]          = a.values[offset];
+            }
+            row_end_offsets[row] = stored + index_base;
+        }
+        if (!ends)
+            row_offsets[num_rows] = stored + index_base;
     }
 
-    // Carry-out fix-up (rows spanning multiple threads)
-    for (int tid = 0; tid < num_threads - 1; ++tid)
+    CsrView<ValueT, OffsetT> View()
     {
-        if (row_carry_out[tid] < num_rows)
-            vector_y_out[row_carry_out[tid]] += value_carry_out[tid];
+        CsrView<ValueT, OffsetT> view;
+        view.Init(num_rows, num_cols, row_offsets, row_end_offsets, column_indices, values, index_base);
+        return view;
     }
-}
 
-
-template <typename OffsetT>
-void OmpMergePartitionMatrix(
-    int2*                         thread_coords,
-    int2*                         thread_coord_ends,
-    int                           num_threads,
-    OffsetT                       num_rows,
-    OffsetT                       num_nonzeros,
-    OffsetT*    __restrict        row_offsets)
-{
-    #pragma omp parallel for schedule(static) num_threads(num_threads)
-    for (int tid = 0; tid < num_threads; tid++)
+    void Clear()
     {
-        // Merge list B (NZ indices)
-        CountingInputIterator<OffsetT>  nonzero_indices(0);
+        if (row_offsets == NULL)
+            return;
+        HostFree(row_offsets, sizeof(OffsetT) * (num_rows + 1));
+        if (ends)
+            HostFree(row_end_offsets, sizeof(OffsetT) * num_rows);
+        HostFree(column_indices, sizeof(OffsetT) * num_stored);
+        HostFree(values, sizeof(ValueT) * num_stored);
+        row_offsets = row_end_offsets = column_indices = NULL;
+        values = NULL;
+    }
+};
 
-        OffsetT num_merge_items     = num_rows + num_nonzeros;                          // Merge path total length
-        OffsetT items_per_thread    = (num_merge_items + num_threads - 1) / num_threads;    // Merge items per thread
 
-        // Find starting and ending MergePath coordinates (row-idx, nonzero-idx) for each thread
-        int     start_diagonal      = std::min(items_per_thread * tid, num_merge_items);
-        int     end_diagonal        = std::min(start_diagonal + items_per_thread, num_merge_items);
+#ifdef CUB_SPMV_PROFILE
+MergeLoadProfile g_merge_profile;      // Filled by the merge-based kernels during the timed loop
+#endif
 
-        MergePathSearch(start_diagonal, row_offsets + 1, nonzero_indices, num_rows, num_nonzeros, thread_coords[tid]);
-        MergePathSearch(end_diagonal, row_offsets + 1, nonzero_indices, num_rows, num_nonzeros, thread_coord_ends[tid]);
-    }
-}
-    
 
+//---------------------------------------------------------------------
+// SpMV method selection
+//---------------------------------------------------------------------
 
 /**
- * Run OmpMergeCsrmv
+ * Selects the methods named in method_names (in registry order), or every
+ * default-enabled method if method_names is empty.  Exits on unknown names.
  */
 template <
     typename ValueT,
     typename OffsetT>
-float TestOmpMergeCsrmv(
-    CsrMatrix<ValueT, OffsetT>&     a,
-    ValueT*                         vector_x,
-    ValueT*                         reference_vector_y_out,
-    ValueT*                         vector_y_out,
-    int                             timing_iterations,
-    float                           &setup_ms)
+void SelectSpmvMethods(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>   &registry,
+    const std::vector<std::string>              &method_names,
+    std::vector<SpmvMethod<ValueT, OffsetT>*>   &selected)
 {
-    setup_ms = 0.0;
-
-    if (g_omp_threads == -1)
-        g_omp_threads = omp_get_num_procs();
-    int num_threads = g_omp_threads;
-
-    CpuTimer setupTimer;
-    setupTimer.Start();
-    
-    int2 *thread_coords = new int2[num_threads];
-    int2 *thread_coord_ends = new int2[num_threads];
-    
-    OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads,
-			    a.num_rows, a.num_nonzeros, a.row_offsets);
-    
-    setupTimer.Stop();
-    setup_ms = setupTimer.ElapsedMillis();
-    
-    // Warmup/correctness
-    memset(vector_y_out, -1, sizeof(ValueT) * a.num_rows);
-    OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads,
-		  a.num_rows, a.num_nonzeros, a.row_offsets, a.column_indices, a.values,
-		  vector_x, vector_y_out);
-    if (!g_quiet)
+    for (int i = 0; i < int(method_names.size()); ++i)
     {
-        // Check answer
-        int compare = CompareResults(vector_y_out, reference_vector_y_out, a.num_rows, true);
-        printf("\t%s\n", compare ? "FAIL" : "PASS"); fflush(stdout);
+        bool found = false;
+        for (int j = 0; j < int(registry.size()); ++j)
+            found |= (method_names[i] == registry[j]->name);
+
+        if (!found)
+        {
+            fprintf(stderr, "Unknown SpMV method '%s'\n", method_names[i].c_str());
+            exit(1);
+        }
     }
-    if (!g_quiet)
-        printf("\tUsing %d threads on %d procs\n", g_omp_threads, omp_get_num_procs());
- 
-    // Re-populate caches, etc.
-    OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads,
-		  a.num_rows, a.num_nonzeros, a.row_offsets, a.column_indices, a.values,
-		  vector_x, vector_y_out);
-    OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads,
-		  a.num_rows, a.num_nonzeros, a.row_offsets, a.column_indices, a.values,
-		  vector_x, vector_y_out);
-    OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads,
-		  a.num_rows, a.num_nonzeros, a.row_offsets, a.column_indices, a.values,
-		  vector_x, vector_y_out);
 
-    // Timing
-    float elapsed_ms = 0.0;
-    CpuTimer timer;
-    timer.Start();
-    for(int it = 0; it < timing_iterations; ++it)
+    for (int j = 0; j < int(registry.size()); ++j)
     {
-        OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads,
-		  a.num_rows, a.num_nonzeros, a.row_offsets, a.column_indices, a.values,
-		  vector_x, vector_y_out);
-    }
-    timer.Stop();
-    elapsed_ms += timer.ElapsedMillis();
+        bool enabled = method_names.empty() && registry[j]->default_enabled;
+        for (int i = 0; i < int(method_names.size()); ++i)
+            enabled |= (method_names[i] == registry[j]->name);
 
-    delete[] thread_coords;
-    delete[] thread_coord_ends;
-    
-    return elapsed_ms / timing_iterations;
+        if (enabled)
+            selected.push_back(registry[j]);
+    }
 }
 
 
-//---------------------------------------------------------------------
-// CPU merge-based CSRLenGoto SpMV
-//---------------------------------------------------------------------
-
 /**
- * OpenMP CPU merge-based SpMV
+ * Display the names of the registered methods
  */
-void csrLenGotoKernel(
-    int*     __restrict row_offsets,
-    int*     __restrict column_indices,
-    double*  __restrict values,
-    double*  __restrict vector_x,
-    double*  __restrict vector_y_out,
-    int                 N);
-
-void csrLenGotoKernel(
-    int*     __restrict row_offsets,
-    int*     __restrict column_indices,
-    float*  __restrict values,
-    float*  __restrict vector_x,
-    float*  __restrict vector_y_out,
-    int                 N)
+void DisplaySpmvMethods()
 {
-    //
-    // CAUTION: csrLenGotoKernel for float value type is not properly implemented yet.
-    //
-    for (int i = 0; i < N; ++i)
+    std::vector<SpmvMethod<double, int>*> registry;
+    RegisterSpmvMethods(registry);
+
+    printf("SpMV methods:\n");
+    for (int j = 0; j < int(registry.size()); ++j)
     {
-        float running_total = 0.0;
-        for (int k = row_offsets[i]; k < row_offsets[i + 1]; ++k)
-        {
-            running_total += values[k] * vector_x[column_indices[k]];
-        }
-        vector_y_out[i] = running_total;
+        printf("\t%-12s %s%s\n", registry[j]->name, registry[j]->label,
+            registry[j]->default_enabled ? "" : " (not run by default)");
+        delete registry[j];
     }
 }
 
-template <
-    typename ValueT,
-    typename OffsetT>
-void OmpMergeCsrLenGotomv(
-    int2*                         thread_coords,
-    int2*                         thread_coord_ends,
-    int                           num_threads,
-    OffsetT                       num_rows,
-    OffsetT                       num_nonzeros,
-    OffsetT**   __restrict        row_jump_distances,
-    OffsetT*    __restrict        row_offsets,
-    OffsetT*    __restrict        column_indices,
-    ValueT*     __restrict        values,
-    ValueT*     __restrict        vector_x,
-    ValueT*     __restrict        vector_y_out)
-{
-    // Temporary storage for inter-thread fix-up after load-balanced work
-    OffsetT     row_carry_out[256];     // The last row-id each worked on by each thread when it finished its path segment
-    ValueT      value_carry_out[256];   // The running total within each thread when it finished its path segment
-
-    #pragma omp parallel for schedule(static) num_threads(num_threads)
-    for (int tid = 0; tid < num_threads; tid++)
-    {
-        int2 thread_coord = thread_coords[tid];
-        int2 thread_coord_end = thread_coord_ends[tid];
 
-        // Consume first row if partial
-        if (thread_coord.y > row_offsets[thread_coord.x]) {
-            ValueT running_total = 0.0;
-            for (; thread_coord.y < row_offsets[thread_coord.x + 1]; ++thread_coord.y)
-            {
-                running_total += values[thread_coord.y] * vector_x[column_indices[thread_coord.y]];
-            }
-            vector_y_out[thread_coord.x] = running_total;
-            ++thread_coord.x;
-        }
+//---------------------------------------------------------------------
+// Test generation
+//---------------------------------------------------------------------
 
-        // Consume whole rows
-        int N =  thread_coord_end.x -  thread_coord.x;
-        int firstValueIdx = row_offsets[thread_coord.x];
-        csrLenGotoKernel(row_jump_distances[tid], column_indices + firstValueIdx, values + firstValueIdx, vector_x, vector_y_out + thread_coord.x, N);
+/**
+ * Display perf
+ */
+template <typename ValueT, typename OffsetT>
+void DisplayPerf(
+    double                          setup_ms,
+    double                          avg_ms,
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix)
+{
+    double nz_throughput, effective_bandwidth;
+    size_t total_bytes = (csr_matrix.num_nonzeros * (sizeof(ValueT) * 2 + sizeof(OffsetT))) +
+        (csr_matrix.num_rows) * (sizeof(OffsetT) + sizeof(ValueT));
 
-        // Consume partial portion of thread's last row
-        ValueT running_total = 0.0;
-        for (int k = row_offsets[thread_coord_end.x]; k < thread_coord_end.y; ++k)
-        {
-            running_total += values[k] * vector_x[column_indices[k]];
-        }
+    nz_throughput       = double(csr_matrix.num_nonzeros) / avg_ms / 1.0e6;
+    effective_bandwidth = double(total_bytes) / avg_ms / 1.0e6;
 
-        // Save carry-outs
-        row_carry_out[tid] = thread_coord_end.x;
-        value_carry_out[tid] = running_total;
-    }
+    if (!g_quiet)
+        printf("fp%d: %.4f setup ms, %.4f avg ms, %.5f gflops, %.3lf effective GB/s\n",
+            int(sizeof(ValueT) * 8),
+            setup_ms,
+            avg_ms,
+            2 * nz_throughput,
+            effective_bandwidth);
+    else
+        printf("%.5f, %.5f, %.6f, %.3lf, ",
+            setup_ms, avg_ms,
+            2 * nz_throughput,
+            effective_bandwidth);
 
-    // Carry-out fix-up (rows spanning multiple threads)
-    for (int tid = 0; tid < num_threads - 1; ++tid)
-    {
-        if (row_carry_out[tid] < num_rows)
-            vector_y_out[row_carry_out[tid]] += value_carry_out[tid];
-    }
+    fflush(stdout);
 }
 
 
 /**
- * Run OmpMergeCsrLenGotomv
+ * Measurements from one trial of an SpMV method
+ */
+struct SpmvTrial
+{
+    float           setup_ms;           // Median over the trials of a method (see TestSpmvMethods)
+    float           setup_min_ms;
+    float           setup_max_ms;
+    float           avg_ms;             // Warm: back-to-back iterations
+    TimingStats     stats;              // Warm per-iteration distribution (--stats)
+    float           cold_avg_ms;        // Cold: caches evicted before every iteration (--cold)
+    TimingStats     cold_stats;
+    bool            cold_partial;       // Whether clflush could not reach some of the method's data (see SpmvMethod::AddFlushRegions)
+
+    std::vector<PerfCounterValues>  thread_counters;    // Per-thread counts over the warm timed loop (--counters)
+    double                          dram_bytes;         // DRAM bytes over the warm timed loop (-1 if unavailable)
+    double                          package_joules;     // RAPL package energy over the warm timed loop (-1 if unavailable, --energy)
+    double                          dram_joules;        // RAPL DRAM energy over the warm timed loop (-1 if unavailable)
+    MergeLoadProfile                load_profile;       // Merge-path load balance over the warm timed loop (-DCUB_SPMV_PROFILE)
+
+    bool                            correct;            // Whether the first SpMV matched SpmvGold
+    const char*                     unsupported;        // Why the method was not run on this matrix (see SpmvMethod::Unsupported)
+
+    SpmvTrial() : setup_ms(0), setup_min_ms(0), setup_max_ms(0), avg_ms(0), cold_avg_ms(0), cold_partial(false), dram_bytes(-1), package_joules(-1), dram_joules(-1), correct(false), unsupported(NULL) {}
+};
+
+
+/**
+ * Run an SpMV method: setup (hinted with expected_calls), warmup/correctness
+ * check, timing, teardown.  Returns the average milliseconds per SpMV.
  */
 template <
     typename ValueT,
     typename OffsetT>
-float TestOmpMergeCsrLenGotomv(
-    CsrMatrix<ValueT, OffsetT>&     a,
+float TestSpmvMethod(
+    SpmvMethod<ValueT, OffsetT>&    method,
+    const CsrView<ValueT, OffsetT>& a,
     ValueT*                         vector_x,
     ValueT*                         reference_vector_y_out,
     ValueT*                         vector_y_out,
     int                             timing_iterations,
-    float                           &setup_ms)
+    int                             expected_calls,
+    CacheFlusher*                   flusher,
+    PerfCounters*                   counters,
+    SpmvTrial                       &trial)
 {
-    setup_ms = 0.0;
-
-    if (g_omp_threads == -1)
-        g_omp_threads = omp_get_num_procs();
-    int num_threads = g_omp_threads;
-
-    // Conversion from CSR to CSRLen
     CpuTimer setupTimer;
     setupTimer.Start();
 
-    int2 *thread_coords = new int2[num_threads];
-    int2 *thread_coord_ends = new int2[num_threads];
-    
-    OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads,
-			    a.num_rows, a.num_nonzeros, a.row_offsets);
-
-    int **row_jump_distances = new int*[num_threads];
-    #pragma omp parallel for schedule(static) num_threads(num_threads)
-    for (int tid = 0; tid < num_threads; tid++)
-    {
-        int2 thread_coord = thread_coords[tid];
-        int2 thread_coord_end = thread_coord_ends[tid];
-        if (thread_coord.y > a.row_offsets[thread_coord.x]) {
-            ++thread_coord.x; // skip the first row because it's partial
-        }
-
-        row_jump_distances[tid] = new int[thread_coord_end.x - thread_coord.x + 1];
-        int j = 0;
-        for (int i = thread_coord.x; i < thread_coord_end.x; i++, j++) {
-            int length = a.row_offsets[i + 1] - a.row_offsets[i];
-            row_jump_distances[tid][j] = -(length * 22);
-        }
-        row_jump_distances[tid][j] = 6 + 3 + 3 + 4 + 7 + 3 + 3;
-    }
+    method.Setup(a, g_omp_threads, expected_calls);
 
     setupTimer.Stop();
-    setup_ms = setupTimer.ElapsedMillis();
+    trial.setup_ms = setupTimer.ElapsedMillis();
 
     // Warmup/correctness
     memset(vector_y_out, -1, sizeof(ValueT) * a.num_rows);
-    OmpMergeCsrLenGotomv(thread_coords, thread_coord_ends, g_omp_threads,
-			 a.num_rows, a.num_nonzeros, row_jump_distances, a.row_offsets,
-			 a.column_indices, a.values, vector_x, vector_y_out);
+    method.Execute(vector_x, vector_y_out);
+    int compare = CompareResults(vector_y_out, reference_vector_y_out, a.num_rows, !g_quiet);
+    trial.correct = (compare == 0);
     if (!g_quiet)
     {
         // Check answer
-        int compare = CompareResults(vector_y_out, reference_vector_y_out, a.num_rows, true);
         printf("\t%s\n", compare ? "FAIL" : "PASS"); fflush(stdout);
     }
     if (!g_quiet)
         printf("\tUsing %d threads on %d procs\n", g_omp_threads, omp_get_num_procs());
- 
+    if (!g_quiet && method.Variant())
+        printf("\tvariant: %s\n", method.Variant());
+
     // Re-populate caches, etc.
-    OmpMergeCsrLenGotomv(thread_coords, thread_coord_ends, g_omp_threads,
-			 a.num_rows, a.num_nonzeros, row_jump_distances, a.row_offsets,
-			 a.column_indices, a.values, vector_x, vector_y_out);
-    OmpMergeCsrLenGotomv(thread_coords, thread_coord_ends, g_omp_threads,
-			 a.num_rows, a.num_nonzeros, row_jump_distances, a.row_offsets,
-			 a.column_indices, a.values, vector_x, vector_y_out);
-    OmpMergeCsrLenGotomv(thread_coords, thread_coord_ends, g_omp_threads,
-			 a.num_rows, a.num_nonzeros, row_jump_distances, a.row_offsets,
-			 a.column_indices, a.values, vector_x, vector_y_out);
+    method.Execute(vector_x, vector_y_out);
+    method.Execute(vector_x, vector_y_out);
+    method.Execute(vector_x, vector_y_out);
 
     // Timing
     float elapsed_ms = 0.0;
-    CpuTimer timer;
-    timer.Start();
-    for(int it = 0; it < timing_iterations; ++it)
+    CUB_SPMV_PROFILE_STMT(g_merge_profile.Reset(g_omp_threads);)
+    if (g_energy)
+        g_rapl.Start();
+    if (counters)
+        counters->Start();
+    if (g_timing_stats)
+    {
+        // Timestamp every iteration
+        IterationTimer timer(timing_iterations);
+        for(int it = 0; it < timing_iterations; ++it)
+        {
+            timer.Mark(it);
+            method.Execute(vector_x, vector_y_out);
+        }
+        timer.Mark(timing_iterations);
+        elapsed_ms += timer.ElapsedMillis();
+        trial.stats.Compute(timer);
+    }
+    else
     {
-        OmpMergeCsrLenGotomv(thread_coords, thread_coord_ends, g_omp_threads,
-			 a.num_rows, a.num_nonzeros, row_jump_distances, a.row_offsets,
-			 a.column_indices, a.values, vector_x, vector_y_out);
+        CpuTimer timer;
+        timer.Start();
+        for(int it = 0; it < timing_iterations; ++it)
+        {
+            method.Execute(vector_x, vector_y_out);
+        }
+        timer.Stop();
+        elapsed_ms += timer.ElapsedMillis();
     }
-    timer.Stop();
-    elapsed_ms += timer.ElapsedMillis();
+    if (counters)
+    {
+        counters->Stop();
+        counters->Read(trial.thread_counters, trial.dram_bytes);
+    }
+    if (g_energy)
+        g_rapl.Stop(trial.package_joules, trial.dram_joules);
+    CUB_SPMV_PROFILE_STMT(trial.load_profile = g_merge_profile; g_merge_profile.Reset(0);)
+    trial.avg_ms = elapsed_ms / timing_iterations;
 
-    for (int tid = 0; tid < num_threads; tid++)
+    // Cold timing: evict caches before every iteration and time only the SpMV
+    if (flusher)
     {
-        delete[] row_jump_distances[tid];
+        // Also evict what Setup() built (clflush mode only: streaming evicts everything)
+        size_t shared_regions = flusher->regions.size();
+        trial.cold_partial = flusher->clflush && !method.AddFlushRegions(*flusher);
+
+        int cold_iterations = std::min(timing_iterations, g_cold_iterations);
+        std::vector<double> samples(cold_iterations);
+        for (int it = 0; it < cold_iterations; ++it)
+        {
+            flusher->Flush();
+            double start = WallClockSeconds();
+            method.Execute(vector_x, vector_y_out);
+            samples[it] = (WallClockSeconds() - start) * 1000.0;
+        }
+        trial.cold_stats.Compute(samples);
+        trial.cold_avg_ms = trial.cold_stats.mean_ms;
+        flusher->RemoveRegions(shared_regions);
     }
-    delete[] row_jump_distances;
 
-    delete[] thread_coords;
-    delete[] thread_coord_ends;
-    
-    return elapsed_ms / timing_iterations;
+    method.Teardown();
+
+    return trial.avg_ms;
 }
 
-//---------------------------------------------------------------------
-// MKL SpMV
-//---------------------------------------------------------------------
 
 /**
- * MKL CPU SpMV (specialized for fp32)
+ * Energy per SpMV of a trial in millijoules (package plus DRAM, or package
+ * alone if DRAM is unavailable), or -1 if unavailable
  */
-void MklCsrmv(
-    const sparse_matrix_t &A,
-    const struct matrix_descr &descr,
-    float* __restrict vector_x,
-    float* __restrict vector_y_out)
+inline double SpmvMillijoules(const SpmvTrial &trial, int timing_iterations)
 {
-    const float alpha = 1.0;
-    const float beta = 0.0;
-    sparse_status_t status = mkl_sparse_s_mv(SPARSE_OPERATION_NON_TRANSPOSE,
-					     alpha,
-					     A,
-					     descr,
-					     vector_x,
-					     beta,
-					     vector_y_out);
-    if (status != SPARSE_STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to do mv operation. Error code: %d\n", status);
-        exit(1);
-    }
+    if (trial.package_joules < 0)
+        return -1;
+    return (trial.package_joules + std::max(trial.dram_joules, 0.0)) * 1000.0 / timing_iterations;
 }
 
-template <typename OffsetT>
-void MklCreateMatrix(CsrMatrix<float, OffsetT> &a, sparse_matrix_t &mklMatrix)
-{
-    sparse_status_t status;
-    status = mkl_sparse_s_create_csr(&mklMatrix, SPARSE_INDEX_BASE_ZERO, a.num_rows, a.num_cols,
-				     a.row_offsets, a.row_offsets + 1, a.column_indices, a.values);
-    if (status != SPARSE_STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to create csr. Error code: %d\n", status);
-        exit(1);
-    }
-}
 
 /**
- * MKL CPU SpMV (specialized for fp64)
+ * Display energy per SpMV and GFLOPS/W next to the perf numbers (--energy)
  */
-void MklCsrmv(
-    const sparse_matrix_t &A,
-    const struct matrix_descr &descr,
-    double* __restrict vector_x,
-    double* __restrict vector_y_out)
+template <typename ValueT, typename OffsetT>
+void DisplayEnergy(
+    const SpmvTrial&                trial,
+    int                             timing_iterations,
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix)
 {
-    const double alpha = 1.0;
-    const double beta = 0.0;
-    sparse_status_t status = mkl_sparse_d_mv(SPARSE_OPERATION_NON_TRANSPOSE,
-					     alpha,
-					     A,
-					     descr,
-					     vector_x,
-					     beta,
-					     vector_y_out);
-    if (status != SPARSE_STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to do mv operation. Error code: %d\n", status);
-        exit(1);
-    }
-}
+    double total_mj     = SpmvMillijoules(trial, timing_iterations);
+    double package_mj   = (trial.package_joules >= 0) ? trial.package_joules * 1000.0 / timing_iterations : -1;
+    double dram_mj      = (trial.dram_joules >= 0) ? trial.dram_joules * 1000.0 / timing_iterations : -1;
+    double gflops_per_w = (total_mj > 0) ? 2 * double(csr_matrix.num_nonzeros) / (total_mj / 1000.0) / 1.0e9 : -1;
+    double watts        = (total_mj > 0) ? total_mj / trial.avg_ms : -1;
 
-template <typename OffsetT>
-void MklCreateMatrix(CsrMatrix<double, OffsetT> &a, sparse_matrix_t &mklMatrix)
-{
-    sparse_status_t status;
-    status = mkl_sparse_d_create_csr(&mklMatrix, SPARSE_INDEX_BASE_ZERO, a.num_rows, a.num_cols,
-				     a.row_offsets, a.row_offsets + 1, a.column_indices, a.values);
-    if (status != SPARSE_STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to create csr. Error code: %d\n", status);
-        exit(1);
+    if (g_quiet)
+    {
+        printf("%.6f, %.6f, %.4f, ", package_mj, dram_mj, gflops_per_w);
     }
+    else if (total_mj < 0)
+    {
+        printf("\tenergy: n/a\n");
+    }
+    else
+    {
+        printf("\tenergy: %.6f mJ per SpMV (package %.6f, DRAM ", total_mj, package_mj);
+        if (dram_mj >= 0) printf("%.6f", dram_mj); else printf("n/a");
+        printf("), %.4f GFLOPS/W, %.1f W\n", gflops_per_w, watts);
+        if (trial.avg_ms * timing_iterations < 100)
+            printf("\tenergy: timed loop under 100 ms; RAPL's ~1 ms update interval makes this imprecise (raise --i)\n");
+    }
+    fflush(stdout);
 }
 
+
 /**
- * Run MKL CsrMV
+ * Display cold-cache perf next to the warm numbers
  */
-template <
+template <typename ValueT, typename OffsetT>
+void DisplayColdPerf(
+    double                          cold_avg_ms,
+    double                          warm_avg_ms,
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix)
+{
+    size_t total_bytes = (csr_matrix.num_nonzeros * (sizeof(ValueT) * 2 + sizeof(OffsetT))) +
+        (csr_matrix.num_rows) * (sizeof(OffsetT) + sizeof(ValueT));
+
+    double nz_throughput        = double(csr_matrix.num_nonzeros) / cold_avg_ms / 1.0e6;
+    double effective_bandwidth  = double(total_bytes) / cold_avg_ms / 1.0e6;
+
+    if (!g_quiet)
+        printf("\tcold: %.4f avg ms, %.5f gflops, %.3lf effective GB/s (%.2fx warm time)\n",
+            cold_avg_ms,
+            2 * nz_throughput,
+            effective_bandwidth,
+            cold_avg_ms / warm_avg_ms);
+    else
+        printf("%.5f, %.6f, %.3lf, ",
+            cold_avg_ms,
+            2 * nz_throughput,
+            effective_bandwidth);
+
+    fflush(stdout);
+}
+
+
+/**
+ * Display the per-iteration time distribution of a method's best trial, and
+ * warn (on stderr) when its variation is too high for the mean to be trusted
+ */
+void DisplayTimingStats(
+    const char*         label,
+    const TimingStats&  stats,
+    bool                cold = false)
+{
+    if (!g_quiet)
+        printf("\t%sper-iteration ms: %.4f min, %.4f median, %.4f p90, %.4f p99, %.4f max, %.4f cv (%d samples)\n",
+            cold ? "cold " : "",
+            stats.min_ms,
+            stats.median_ms,
+            stats.p90_ms,
+            stats.p99_ms,
+            stats.max_ms,
+            stats.variation,
+            stats.num_samples);
+    else
+        printf("%.5f, %.5f, %.5f, %.5f, %.5f, %.5f, ",
+            stats.min_ms,
+            stats.median_ms,
+            stats.p90_ms,
+            stats.p99_ms,
+            stats.max_ms,
+            stats.variation);
+
+    if (stats.Noisy(g_max_variation))
+        fprintf(stderr, "WARNING: %s %stiming is noisy (cv %.3f > %.3f, p99/median %.2f); results may not be trustworthy\n",
+            label, cold ? "cold " : "", stats.variation, g_max_variation, stats.p99_ms / stats.median_ms);
+    if (stats.num_samples < 100)
+        fprintf(stderr, "WARNING: %s has only %d %stiming samples; p99 is not meaningful\n",
+            label, stats.num_samples, cold ? "cold " : "");
+
+    fflush(stdout);
+}
+
+
+/**
+ * Display a method's attained bandwidth as a fraction of the calibrated triad
+ * peak, and how far it is from the predicted lower bound on SpMV time
+ */
+void DisplayRooflinePerf(
+    double                          avg_ms,
+    const SpmvTrafficModel&         model)
+{
+    double modeled_bytes    = model.stream_bytes + model.x_misses * 64;
+    double attained_gbs     = modeled_bytes / avg_ms / 1.0e6;
+    double fraction_of_peak = attained_gbs / g_machine.triad_gbs;
+    double bound_ms         = model.BoundMillis(g_machine);
+
+    if (!g_quiet)
+        printf("\troofline: %.3lf GB/s modeled traffic, %.1f%% of triad peak, %.4f ms lower bound (%.2fx from bound)\n",
+            attained_gbs,
+            fraction_of_peak * 100.0,
+            bound_ms,
+            avg_ms / bound_ms);
+    else
+        printf("%.3lf, %.4f, %.5f, ",
+            attained_gbs,
+            fraction_of_peak,
+            bound_ms);
+
+    fflush(stdout);
+}
+
+
+/**
+ * Display a method's bandwidth against both the naive traffic (one vector_x
+ * load per nonzero, as in DisplayPerf) and the traffic modeled by the LRU
+ * simulation of vector_x (--cache-sim)
+ */
+void DisplayCacheSimPerf(
+    double                          avg_ms,
+    const SpmvTrafficModel&         model)
+{
+    double naive_gbs    = model.naive_bytes / avg_ms / 1.0e6;
+    double modeled_gbs  = model.ModeledBytes() / avg_ms / 1.0e6;
+
+    if (!g_quiet)
+        printf("	cache-sim: %.3lf GB/s of naive traffic (%.1f MB), %.3lf GB/s of LRU-modeled traffic (%.1f MB)\n",
+            naive_gbs,
+            model.naive_bytes / (1 << 20),
+            modeled_gbs,
+            model.ModeledBytes() / (1 << 20));
+    else
+        printf("%.3lf, ", modeled_gbs);
+
+    fflush(stdout);
+}
+
+
+/**
+ * Display hardware counters of a method's best trial, normalized per SpMV.
+ * Unavailable counts are shown as n/a (-1 in CSV).
+ */
+template <typename ValueT, typename OffsetT>
+void DisplayPerfCounters(
+    const SpmvTrial&                trial,
+    int                             timing_iterations,
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix)
+{
+    PerfCounterValues total;
+    for (int tid = 0; tid < int(trial.thread_counters.size()); ++tid)
+        total += trial.thread_counters[tid];
+
+    double nnz              = double(csr_matrix.num_nonzeros) * timing_iterations;
+    double ipc              = total.Ratio(PERF_EVENT_INSTRUCTIONS, PERF_EVENT_CYCLES);
+    double llc_miss_rate    = total.Ratio(PERF_EVENT_LLC_MISSES, PERF_EVENT_LLC_REFERENCES);
+    double instr_per_nnz    = total.Per(PERF_EVENT_INSTRUCTIONS, nnz);
+    double llc_per_nnz      = total.Per(PERF_EVENT_LLC_MISSES, nnz);
+    double dtlb_per_nnz     = total.Per(PERF_EVENT_DTLB_MISSES, nnz);
+    double dram_per_nnz     = (trial.dram_bytes >= 0) ? trial.dram_bytes / nnz : -1.0;
+
+    if (g_quiet)
+    {
+        printf("%.3f, %.3f, %.4f, %.5f, %.6f, %.3f, ",
+            ipc, instr_per_nnz, llc_miss_rate, llc_per_nnz, dtlb_per_nnz, dram_per_nnz);
+        fflush(stdout);
+        return;
+    }
+
+    #define CUB_PERF_FIELD(fmt, value) if ((value) >= 0) printf(fmt, (value)); else printf("n/a");
+    printf("\tcounters: IPC ");                CUB_PERF_FIELD("%.3f", ipc);
+    printf(", instructions/nnz ");              CUB_PERF_FIELD("%.3f", instr_per_nnz);
+    printf(", LLC miss rate ");                 CUB_PERF_FIELD("%.4f", llc_miss_rate);
+    printf(", LLC misses/nnz ");                CUB_PERF_FIELD("%.5f", llc_per_nnz);
+    printf(", DTLB misses/nnz ");               CUB_PERF_FIELD("%.6f", dtlb_per_nnz);
+    printf(", DRAM bytes/nnz ");                CUB_PERF_FIELD("%.3f", dram_per_nnz);
+    printf("\n");
+
+    if (g_verbose)
+    {
+        for (int tid = 0; tid < int(trial.thread_counters.size()); ++tid)
+        {
+            const PerfCounterValues &values = trial.thread_counters[tid];
+            printf("\t\tthread %d: IPC ", tid);     CUB_PERF_FIELD("%.3f", values.Ratio(PERF_EVENT_INSTRUCTIONS, PERF_EVENT_CYCLES));
+            printf(", cycles ");                    CUB_PERF_FIELD("%.0f", values.Per(PERF_EVENT_CYCLES, 1));
+            printf(", LLC misses ");                CUB_PERF_FIELD("%.0f", values.Per(PERF_EVENT_LLC_MISSES, 1));
+            printf(", DTLB misses ");               CUB_PERF_FIELD("%.0f", values.Per(PERF_EVENT_DTLB_MISSES, 1));
+            printf("\n");
+        }
+    }
+    #undef CUB_PERF_FIELD
+
+    fflush(stdout);
+}
+
+
+/**
+ * Display the cost of replicating vector_x per SpMV and whether it paid off
+ * for each (single-copy, replicated) pair of methods that ran (-1 ms if not).
+ *
+ * Replication writes num_cols items to every node, whereas gathering from a
+ * single copy makes (nodes - 1) / nodes of the num_nonzeros x-accesses remote.
+ * Ignoring x reuse, replication can only pay off when
+ * num_cols * nodes < num_nonzeros * (nodes - 1) / nodes.
+ */
+template <typename ValueT, typename OffsetT>
+void DisplayReplicationReport(
+    ValueT*                         vector_x,
+    int                             timing_iterations,
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix,
+    float                           merge_ms,
+    float                           merge_replicated_ms,
+    float                           lengoto_ms,
+    float                           lengoto_replicated_ms)
+{
+    const char* labels[2]           = {"Merge CsrMV", "Merge CsrLenGotoMV"};
+    float       single_ms[2]        = {merge_ms, lengoto_ms};
+    float       replicated_ms[2]    = {merge_replicated_ms, lengoto_replicated_ms};
+
+    NumaReplicatedVector<ValueT> x_replicas;
+    x_replicas.Init(csr_matrix.num_cols, g_omp_threads);
+
+    // Time the replication alone
+    x_replicas.Replicate(vector_x);
+    CpuTimer timer;
+    timer.Start();
+    for (int it = 0; it < timing_iterations; ++it)
+        x_replicas.Replicate(vector_x);
+    timer.Stop();
+    float replicate_ms = timer.ElapsedMillis() / timing_iterations;
+
+    int     nodes           = x_replicas.num_nodes;
+    double  cols_per_nnz    = double(csr_matrix.num_cols) / csr_matrix.num_nonzeros;
+    double  break_even      = (nodes > 1) ? double(nodes - 1) / (double(nodes) * nodes) : 0.0;
+    bool    model_pays_off  = (cols_per_nnz < break_even);
+
+    if (!g_quiet)
+    {
+        printf("\n\nReplicated x: %d node(s), %.4f copy ms per SpMV, num_cols/num_nonzeros %.5f (break-even below %.5f)\n",
+            nodes, replicate_ms, cols_per_nnz, break_even);
+        printf("\tpredicted: %s\n", model_pays_off ? "pays off" : "does not pay off");
+        for (int p = 0; p < 2; ++p)
+        {
+            if ((single_ms[p] > 0) && (replicated_ms[p] > 0))
+                printf("\tmeasured: %s %.2fx (%s)\n",
+                    labels[p], single_ms[p] / replicated_ms[p],
+                    (replicated_ms[p] < single_ms[p]) ? "pays off" : "does not pay off");
+        }
+        if (nodes == 1)
+            printf("\tonly one NUMA node in use; replication cannot reduce remote traffic\n");
+    }
+    else
+    {
+        // Per pair: 1 if it paid off, 0 if not, -1 if the pair did not run
+        printf("%d, %.5f, %.5f, ", nodes, replicate_ms, cols_per_nnz);
+        for (int p = 0; p < 2; ++p)
+            printf("%d, ", ((single_ms[p] > 0) && (replicated_ms[p] > 0)) ? int(replicated_ms[p] < single_ms[p]) : -1);
+    }
+    fflush(stdout);
+}
+
+
+/**
+ * Run each selected method three times at g_omp_threads threads, display the
+ * best of each, and record it in method_trials with the median, min, and max
+ * setup time of the three trials.  Methods not started before g_deadline,
+ * and methods that do not support the matrix, are skipped and recorded with
+ * avg_ms of -1.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void TestSpmvMethods(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>&  methods,
+    CsrMatrix<ValueT, OffsetT>&                 csr_matrix,
+    const CsrView<ValueT, OffsetT>&             layout,         // csr_matrix as the methods run it (a view of it, or its --layout copy)
+    ValueT*                                     vector_x,
+    ValueT*                                     reference_vector_y_out,
+    ValueT*                                     vector_y_out,
+    int                                         timing_iterations,
+    CacheFlusher*                               flusher,
+    const SpmvTrafficModel&                     traffic,
+    std::vector<SpmvTrial>&                     method_trials)
+{
+    method_trials.assign(methods.size(), SpmvTrial());
+    for (int m = 0; m < int(methods.size()); ++m)
+        method_trials[m].avg_ms = -1;
+
+    GraphStats stats = csr_matrix.RowLengthStats();
+    int expected_calls = (g_expected_calls > 0) ? g_expected_calls : timing_iterations;
+
+    // Hardware counters for the warm timed loop
+    PerfCounters *counters = NULL;
+    if (g_perf_counters)
+    {
+        counters = new PerfCounters();
+        if (!counters->Init(g_omp_threads))
+            fprintf(stderr, "WARNING: core performance counters unavailable (no PMU access; check /proc/sys/kernel/perf_event_paranoid)\n");
+        if (!counters->dram_available)
+            fprintf(stderr, "WARNING: uncore memory-controller counters unavailable; DRAM bytes not reported\n");
+    }
+
+    // Run each method three times and keep the best
+    for (int m = 0; m < int(methods.size()); ++m)
+    {
+        float avg_ms[3];
+        SpmvTrial trials[3];
+
+        if ((g_deadline > 0) && (WallClockSeconds() > g_deadline))
+        {
+            fprintf(stderr, "WARNING: time limit reached; skipping %s\n", methods[m]->label);
+            continue;
+        }
+
+        method_trials[m].unsupported = methods[m]->Unsupported(stats);
+        if (method_trials[m].unsupported)
+        {
+            fprintf(stderr, "WARNING: skipping %s (%s)\n", methods[m]->label, method_trials[m].unsupported);
+            continue;
+        }
+        method_trials[m].unsupported = methods[m]->UnsupportedLayout(layout);
+        if (method_trials[m].unsupported)
+        {
+            fprintf(stderr, "WARNING: skipping %s (%s)\n", methods[m]->label, method_trials[m].unsupported);
+            continue;
+        }
+
+        if (!g_quiet) printf("\n\n");
+        printf("%s, ", methods[m]->label); fflush(stdout);
+        avg_ms[0] = TestSpmvMethod(*methods[m], layout, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, expected_calls, flusher, counters, trials[0]);
+        avg_ms[1] = TestSpmvMethod(*methods[m], layout, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, expected_calls, flusher, counters, trials[1]);
+        avg_ms[2] = TestSpmvMethod(*methods[m], layout, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, expected_calls, flusher, counters, trials[2]);
+        int best = (avg_ms[0] <= avg_ms[1]) ? ((avg_ms[0] <= avg_ms[2]) ? 0 : 2) : ((avg_ms[1] <= avg_ms[2]) ? 1 : 2);
+
+        float setup_ms[3] = {trials[0].setup_ms, trials[1].setup_ms, trials[2].setup_ms};
+        std::sort(setup_ms, setup_ms + 3);
+
+        method_trials[m] = trials[best];
+        method_trials[m].setup_ms = setup_ms[1];
+        method_trials[m].setup_min_ms = setup_ms[0];
+        method_trials[m].setup_max_ms = setup_ms[2];
+        method_trials[m].correct = trials[0].correct && trials[1].correct && trials[2].correct;
+        if (!g_quiet)
+            printf("\tsetup ms per trial: %.4f, %.4f, %.4f\n", trials[0].setup_ms, trials[1].setup_ms, trials[2].setup_ms);
+        DisplayPerf(method_trials[m].setup_ms, avg_ms[best], csr_matrix);
+        if (g_energy)
+            DisplayEnergy(trials[best], timing_iterations, csr_matrix);
+        if (g_timing_stats)
+            DisplayTimingStats(methods[m]->label, trials[best].stats);
+        if (g_roofline)
+            DisplayRooflinePerf(avg_ms[best], traffic);
+        if (g_cache_sim)
+            DisplayCacheSimPerf(avg_ms[best], traffic);
+        if (counters)
+            DisplayPerfCounters(trials[best], timing_iterations, csr_matrix);
+        trials[best].load_profile.Display(g_quiet, g_verbose);
+
+        if (flusher)
+        {
+            int cold_best = (trials[0].cold_avg_ms <= trials[1].cold_avg_ms) ?
+                ((trials[0].cold_avg_ms <= trials[2].cold_avg_ms) ? 0 : 2) :
+                ((trials[1].cold_avg_ms <= trials[2].cold_avg_ms) ? 1 : 2);
+            method_trials[m].cold_avg_ms = trials[cold_best].cold_avg_ms;
+            method_trials[m].cold_stats = trials[cold_best].cold_stats;
+            method_trials[m].cold_partial = trials[cold_best].cold_partial;
+            DisplayColdPerf(trials[cold_best].cold_avg_ms, avg_ms[best], csr_matrix);
+            if (trials[cold_best].cold_partial && !g_quiet)
+                printf("\tcold: %s keeps data clflush cannot reach, so its cold time is optimistic\n", methods[m]->label);
+            if (g_timing_stats)
+                DisplayTimingStats(methods[m]->label, trials[cold_best].cold_stats, true);
+        }
+    }
+
+    delete counters;
+}
+
+
+/**
+ * Display the total time of each timed method for setup plus expected_calls
+ * SpMVs, the best method for that many calls, and the call counts at which
+ * a method with costlier setup but faster SpMVs overtakes another.
+ */
+template <typename ValueT, typename OffsetT>
+void DisplayAmortization(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>&  methods,
+    const std::vector<SpmvTrial>&               method_trials,
+    int                                         expected_calls)
+{
+    std::vector<int> timed;
+    for (int m = 0; m < int(methods.size()); ++m)
+        if (method_trials[m].avg_ms > 0)
+            timed.push_back(m);
+    if (g_quiet || (timed.size() < 2))
+        return;
+
+    printf("\n\nAmortization over %d calls:\n", expected_calls);
+    int best = -1;
+    double best_ms = 0;
+    for (int t = 0; t < int(timed.size()); ++t)
+    {
+        const SpmvTrial &trial = method_trials[timed[t]];
+        double total_ms = trial.setup_ms + double(expected_calls) * trial.avg_ms;
+        printf("\t%s: %.4f setup ms + %d x %.4f ms = %.3f ms\n",
+            methods[timed[t]]->label, trial.setup_ms, expected_calls, trial.avg_ms, total_ms);
+        if ((best < 0) || (total_ms < best_ms))
+        {
+            best = timed[t];
+            best_ms = total_ms;
+        }
+    }
+    printf("\tbest for %d calls: %s\n", expected_calls, methods[best]->label);
+
+    for (int i = 0; i < int(timed.size()); ++i)
+    {
+        for (int j = 0; j < int(timed.size()); ++j)
+        {
+            const SpmvTrial &costly = method_trials[timed[i]];
+            const SpmvTrial &cheap  = method_trials[timed[j]];
+            if ((costly.setup_ms > cheap.setup_ms) && (costly.avg_ms < cheap.avg_ms))
+            {
+                double break_even = (costly.setup_ms - cheap.setup_ms) / (cheap.avg_ms - costly.avg_ms);
+                printf("\tbreak-even: %s overtakes %s after %.0f calls\n",
+                    methods[timed[i]]->label, methods[timed[j]]->label, ceil(break_even));
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+
+/**
+ * Display speedup and parallel efficiency of each method over a thread sweep,
+ * and the thread count past which bandwidth saturates (the first count within
+ * 90% of the method's best throughput).  Counts that fit on distinct physical
+ * cores and counts that add SMT siblings are reported as separate sweeps.
+ */
+template <typename ValueT, typename OffsetT>
+void DisplayThreadSweep(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>&  methods,
+    const std::vector<int>&                     sweep_threads,
+    const std::vector<std::vector<float> >&     sweep_ms,
+    const std::vector<std::vector<double> >&    sweep_mj,
+    const CpuTopology&                          topology,
+    CsrMatrix<ValueT, OffsetT>&                 csr_matrix)
+{
+    size_t total_bytes = (csr_matrix.num_nonzeros * (sizeof(ValueT) * 2 + sizeof(OffsetT))) +
+        (csr_matrix.num_rows) * (sizeof(OffsetT) + sizeof(ValueT));
+
+    for (int m = 0; m < int(methods.size()); ++m)
+    {
+        bool complete = true;
+        for (int s = 0; s < int(sweep_threads.size()); ++s)
+            complete &= (sweep_ms[s][m] > 0);
+        if (!complete)
+            continue;
+
+        float   base_ms     = sweep_ms[0][m];
+        int     base_threads = sweep_threads[0];
+        float   best_ms     = base_ms;
+        int     cores_s     = -1;       // Sweep entry that uses every physical core
+        for (int s = 0; s < int(sweep_threads.size()); ++s)
+        {
+            best_ms = std::min(best_ms, sweep_ms[s][m]);
+            if (sweep_threads[s] <= topology.NumCores())
+                cores_s = s;
+        }
+
+        int saturation_threads = -1;
+        for (int s = 0; (s < int(sweep_threads.size())) && (saturation_threads < 0); ++s)
+            if (best_ms / sweep_ms[s][m] >= 0.9)
+                saturation_threads = sweep_threads[s];
+
+        // Least energy per SpMV (--energy)
+        int energy_threads = -1;
+        double least_mj = 0;
+        for (int s = 0; s < int(sweep_threads.size()); ++s)
+        {
+            if ((sweep_mj[s][m] > 0) && ((energy_threads < 0) || (sweep_mj[s][m] < least_mj)))
+            {
+                energy_threads = sweep_threads[s];
+                least_mj = sweep_mj[s][m];
+            }
+        }
+
+        if (!g_quiet)
+        {
+            printf("\n\n%s thread sweep (%d physical cores, %d hardware threads):\n",
+                methods[m]->label, topology.NumCores(), topology.NumCpus());
+            printf("\t%-8s %-9s %10s %10s %10s %12s", "sweep", "threads", "avg ms", "speedup", "efficiency", "eff. GB/s");
+            if (g_energy)
+                printf(" %12s %10s", "mJ/SpMV", "GFLOPS/W");
+            printf("\n");
+        }
+
+        for (int s = 0; s < int(sweep_threads.size()); ++s)
+        {
+            bool    smt         = (sweep_threads[s] > topology.NumCores());
+            const char *sweep   = (sweep_threads[s] > topology.NumCpus()) ? "oversub" : (smt ? "smt" : "physical");
+            double  speedup     = base_ms / sweep_ms[s][m];
+            double  efficiency  = speedup * base_threads / sweep_threads[s];
+            double  bandwidth   = double(total_bytes) / sweep_ms[s][m] / 1.0e6;
+
+            // SMT counts are measured against the all-core run
+            if (smt && (cores_s >= 0))
+                efficiency = (sweep_ms[cores_s][m] / sweep_ms[s][m]) * sweep_threads[cores_s] / sweep_threads[s];
+
+            double  gflops_per_w = (sweep_mj[s][m] > 0) ? 2 * double(csr_matrix.num_nonzeros) / (sweep_mj[s][m] / 1000.0) / 1.0e9 : -1;
+
+            if (!g_quiet)
+            {
+                printf("\t%-8s %-9d %10.4f %10.2f %10.2f %12.3f",
+                    sweep, sweep_threads[s], sweep_ms[s][m], speedup, efficiency, bandwidth);
+                if (g_energy && (sweep_mj[s][m] > 0))
+                    printf(" %12.6f %10.4f", sweep_mj[s][m], gflops_per_w);
+                else if (g_energy)
+                    printf(" %12s %10s", "n/a", "n/a");
+                printf("\n");
+            }
+            else
+            {
+                printf("%s, %s, %d, %.5f, %.3f, %.3f, %.3lf",
+                    methods[m]->label, sweep, sweep_threads[s], sweep_ms[s][m], speedup, efficiency, bandwidth);
+                if (g_energy)
+                    printf(", %.6f, %.4f", sweep_mj[s][m], gflops_per_w);
+                printf("\n");
+            }
+        }
+
+        if (!g_quiet)
+            printf("\tbandwidth saturates at %d threads\n", saturation_threads);
+        else
+            printf("%s, saturation, %d\n", methods[m]->label, saturation_threads);
+        if (energy_threads > 0)
+        {
+            if (!g_quiet)
+                printf("\tleast energy per SpMV at %d threads (%.6f mJ)\n", energy_threads, least_mj);
+            else
+                printf("%s, least_energy, %d\n", methods[m]->label, energy_threads);
+        }
+    }
+    fflush(stdout);
+}
+
+
+//---------------------------------------------------------------------
+// Autotuning
+//---------------------------------------------------------------------
+
+/**
+ * Tuning cache: one line per (matrix fingerprint, value type, thread count)
+ * holding the winning method and its trial milliseconds per SpMV
+ */
+struct TuningCache
+{
+    std::string filename;
+
+    TuningCache(const std::string &filename) : filename(filename) {}
+
+    bool Lookup(unsigned long long fingerprint, int value_bytes, int threads, std::string &method, float &trial_ms)
+    {
+        std::ifstream ifs(filename.c_str());
+        std::string line;
+        bool found = false;
+        while (std::getline(ifs, line))
+        {
+            std::istringstream iss(line);
+            unsigned long long  entry_fingerprint;
+            int                 entry_value_bytes, entry_threads;
+            std::string         entry_method;
+            float               entry_ms;
+            if ((iss >> std::hex >> entry_fingerprint >> std::dec >> entry_value_bytes >> entry_threads >> entry_method >> entry_ms) &&
+                (entry_fingerprint == fingerprint) && (entry_value_bytes == value_bytes) && (entry_threads == threads))
+            {
+                // Later entries (re-tunes) take precedence
+                method      = entry_method;
+                trial_ms    = entry_ms;
+                found       = true;
+            }
+        }
+        return found;
+    }
+
+    void Store(unsigned long long fingerprint, int value_bytes, int threads, const std::string &method, float trial_ms)
+    {
+        FILE *file = fopen(filename.c_str(), "a");
+        if (!file)
+        {
+            fprintf(stderr, "WARNING: could not write tuning cache '%s'\n", filename.c_str());
+            return;
+        }
+        fprintf(file, "%016llx %d %d %s %.6f\n", fingerprint, value_bytes, threads, method.c_str(), trial_ms);
+        fclose(file);
+    }
+};
+
+
+/**
+ * Shortlist candidate methods by heuristics on the row-length statistics:
+ *
+ * - only methods that support the matrix (e.g., CSRLenGoto needs every row
+ *   shorter than the generated kernel's body, and fp64)
+ * - the row-split native CSR only when row lengths are regular (low
+ *   variation and no long tail of long rows), as it balances rows rather
+ *   than nonzeros
+ * - replicated-x methods only on multi-node machines when vector_x does not
+ *   fit in the last-level caches
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void ShortlistSpmvMethods(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>   &candidates,
+    const GraphStats                            &stats,
+    size_t                                      llc_bytes,
+    int                                         num_nodes,
+    std::vector<SpmvMethod<ValueT, OffsetT>*>   &shortlist)
+{
+    bool long_tail      = (stats.row_length_skewness > 2.0) && (stats.row_length_variation > 0.1);
+    bool regular_rows   = (stats.row_length_variation < 0.5) && !long_tail;
+    bool x_spills       = (double(sizeof(ValueT)) * stats.num_cols > double(llc_bytes));
+
+    for (int m = 0; m < int(candidates.size()); ++m)
+    {
+        std::string name(candidates[m]->name);
+        const char *excluded = NULL;
+
+        const char *unsupported = candidates[m]->Unsupported(stats);
+
+        if (unsupported)
+            excluded = unsupported;
+        else if ((name == "csr") && !regular_rows)
+            excluded = "irregular row lengths";
+        else if ((name.find("-rx") != std::string::npos) && ((num_nodes < 2) || !x_spills))
+            excluded = (num_nodes < 2) ? "single NUMA node" : "vector_x fits in cache";
+
+        if (excluded)
+        {
+            if (!g_quiet)
+                printf("\tautotune: excluding %s (%s)\n", candidates[m]->name, excluded);
+        }
+        else
+        {
+            shortlist.push_back(candidates[m]);
+        }
+    }
+}
+
+
+/**
+ * Short timed trial of a method: setup, correctness check, and the average
+ * of trial_iterations warm SpMVs.  Returns -1 if the result is wrong.
+ */
+template <
     typename ValueT,
     typename OffsetT>
-float TestMklCsrmv(
+float TrialSpmvMethod(
+    SpmvMethod<ValueT, OffsetT>&    method,
     CsrMatrix<ValueT, OffsetT>&     a,
     ValueT*                         vector_x,
     ValueT*                         reference_vector_y_out,
     ValueT*                         vector_y_out,
-    int                             timing_iterations,
-    float                           &setup_ms)
+    int                             trial_iterations)
 {
-    setup_ms = 0.0;
-    sparse_status_t status;
-    sparse_matrix_t mklMatrix;
-    struct matrix_descr matrixDescr;
-    matrixDescr.type = SPARSE_MATRIX_TYPE_GENERAL;
-    
-    // MKL Inspection
-    CpuTimer setupTimer;
-    setupTimer.Start();
+    method.Setup(a, g_omp_threads, trial_iterations);
+
+    memset(vector_y_out, -1, sizeof(ValueT) * a.num_rows);
+    method.Execute(vector_x, vector_y_out);
+    bool correct = (CompareResults(vector_y_out, reference_vector_y_out, a.num_rows, false) == 0);
+    method.Execute(vector_x, vector_y_out);
+
+    CpuTimer timer;
+    timer.Start();
+    for (int it = 0; it < trial_iterations; ++it)
+        method.Execute(vector_x, vector_y_out);
+    timer.Stop();
+
+    method.Teardown();
+
+    return correct ? timer.ElapsedMillis() / trial_iterations : -1.0f;
+}
+
+
+/**
+ * Replace csr_matrix by P A P^T for the relabelling step (step[old] = new).
+ * The first call keeps the matrix in original_matrix and allocates relabel,
+ * which accumulates the steps (original to current labels).
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void RelabelMatrix(
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix,
+    OffsetT*                        step,
+    CsrMatrix<ValueT, OffsetT>&     original_matrix,
+    OffsetT*&                       relabel)
+{
+    CooMatrix<ValueT, OffsetT> coo_matrix;
+    coo_matrix.InitCsrRelabel(csr_matrix, step);
+
+    if (relabel == NULL)
+    {
+        relabel = new OffsetT[csr_matrix.num_rows];
+        std::copy(step, step + csr_matrix.num_rows, relabel);
+        original_matrix.Swap(csr_matrix);
+    }
+    else
+    {
+        for (OffsetT row = 0; row < csr_matrix.num_rows; ++row)
+            relabel[row] = step[relabel[row]];
+        csr_matrix.Clear();
+    }
+    csr_matrix.Init(coo_matrix);
+}
+
+
+/**
+ * Rows owned by each thread under merge-path partitioning (and, as the
+ * matrix is square, the vector_x and vector_y entries with the same
+ * indices), and the vector_x gathers each thread makes from rows owned by
+ * other threads and by threads on other NUMA nodes
+ */
+struct PartitionOwnership
+{
+    int                     num_threads;
+    std::vector<int>        row_starts;         // First row of each thread, then num_rows
+    std::vector<int>        thread_nodes;
+    std::vector<long long>  thread_nonzeros;
+    std::vector<long long>  remote_thread;      // Gathers outside the thread's rows
+    std::vector<long long>  remote_node;        // Gathers outside the rows of the thread's node
+
+    PartitionOwnership() : num_threads(0) {}
+
+    template <typename ValueT, typename OffsetT>
+    void Init(CsrMatrix<ValueT, OffsetT> &csr_matrix, int num_threads)
+    {
+        this->num_threads = num_threads;
+        int2 *starts    = new int2[num_threads];
+        int2 *ends      = new int2[num_threads];
+        OmpMergePartitionMatrix(starts, ends, num_threads, CsrView<ValueT, OffsetT>(csr_matrix));
+
+        row_starts.resize(num_threads + 1);
+        thread_nodes.resize(num_threads);
+        thread_nonzeros.resize(num_threads);
+        remote_thread.assign(num_threads, 0);
+        remote_node.assign(num_threads, 0);
+        for (int tid = 0; tid < num_threads; ++tid)
+        {
+            row_starts[tid]         = starts[tid].x;
+            thread_nonzeros[tid]    = ends[tid].y - starts[tid].y;
+        }
+        row_starts[num_threads] = csr_matrix.num_rows;
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; ++tid)
+            thread_nodes[tid] = CurrentNumaNode();
+
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; ++tid)
+        {
+            long long other_thread = 0, other_node = 0;
+            for (OffsetT nz = starts[tid].y; nz < ends[tid].y; ++nz)
+            {
+                int owner = int(std::upper_bound(row_starts.begin(), row_starts.end() - 1, int(csr_matrix.column_indices[nz])) - row_starts.begin()) - 1;
+                owner = std::max(owner, 0);
+                if (owner != tid)
+                    other_thread++;
+                if (thread_nodes[owner] != thread_nodes[tid])
+                    other_node++;
+            }
+            remote_thread[tid]  = other_thread;
+            remote_node[tid]    = other_node;
+        }
+
+        delete[] starts;
+        delete[] ends;
+    }
+
+    int NumNodes() const
+    {
+        std::vector<int> nodes(thread_nodes);
+        std::sort(nodes.begin(), nodes.end());
+        return int(std::unique(nodes.begin(), nodes.end()) - nodes.begin());
+    }
+
+    double RemoteFraction(bool across_nodes = false) const
+    {
+        long long remote = 0, total = 0;
+        for (int tid = 0; tid < num_threads; ++tid)
+        {
+            remote  += across_nodes ? remote_node[tid] : remote_thread[tid];
+            total   += thread_nonzeros[tid];
+        }
+        return (total > 0) ? double(remote) / total : 0.0;
+    }
+
+    /**
+     * Bind the pages of a vector indexed like the rows to the nodes of the
+     * threads owning them (before first touch; pages straddling two threads
+     * go to the later one).  Does nothing without libnuma or on one node.
+     */
+    void PlaceOnNodes(void *vector, size_t item_bytes) const
+    {
+#ifdef CUB_NUMA
+        if (!NumaMallocAvailable() || (NumNodes() < 2))
+            return;
+
+        size_t page_bytes = sysconf(_SC_PAGESIZE);
+        for (int tid = 0; tid < num_threads; ++tid)
+        {
+            size_t begin    = (tid == 0) ? 0 : (size_t(row_starts[tid]) * item_bytes + page_bytes - 1) / page_bytes * page_bytes;
+            size_t end      = (size_t(row_starts[tid + 1]) * item_bytes + page_bytes - 1) / page_bytes * page_bytes;
+            if (end > begin)
+                numa_tonode_memory((char*) vector + begin, end - begin, thread_nodes[tid]);
+        }
+#endif
+    }
+};
+
+
+/**
+ * Display the quality of a graph partition and the remote vector_x gathers
+ * of each thread before and after grouping the rows by part (--partition)
+ */
+void DisplayPartitionReport(
+    int                             partitions,
+    const PartitionStats&           partition,
+    float                           partition_ms,
+    float                           rebuild_ms,
+    const PartitionOwnership&       before,
+    const PartitionOwnership&       after)
+{
+    if (g_quiet)
+    {
+        printf("%d, %.3f, %.3f, %lld, %.4f, %.5f, %.5f, ",
+            partitions, partition_ms, rebuild_ms, partition.edge_cut, partition.imbalance,
+            before.RemoteFraction(), after.RemoteFraction());
+        fflush(stdout);
+        return;
+    }
+
+    printf("\n\tpartition: %d parts in %.3f ms (+ %.3f ms to rebuild the CSR), %d levels; edge cut %lld of %lld, imbalance %.3f\n",
+        partitions, partition_ms, rebuild_ms, partition.levels, partition.edge_cut, partition.total_edges, partition.imbalance);
+    printf("\tremote x gathers (merge-path partitions of %d threads): %.2f%% -> %.2f%% of nonzeros\n",
+        after.num_threads, 100.0 * before.RemoteFraction(), 100.0 * after.RemoteFraction());
+    if (after.NumNodes() > 1)
+        printf("\tremote x gathers across %d NUMA nodes: %.2f%% -> %.2f%% of nonzeros\n",
+            after.NumNodes(), 100.0 * before.RemoteFraction(true), 100.0 * after.RemoteFraction(true));
+    for (int tid = 0; tid < after.num_threads; ++tid)
+        printf("\t\tthread %d (node %d): %lld of %lld -> %lld of %lld gathers remote\n",
+            tid, after.thread_nodes[tid],
+            before.remote_thread[tid], before.thread_nonzeros[tid],
+            after.remote_thread[tid], after.thread_nonzeros[tid]);
+    fflush(stdout);
+}
+
+
+/**
+ * Time each method on the matrix before reordering (best of three trials of
+ * timing_iterations) and display the speedup of the reordered one (--reorder)
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void DisplayReorderSpeedup(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>&  methods,
+    CsrMatrix<ValueT, OffsetT>&                 original_matrix,
+    ValueT*                                     original_vector_x,
+    ValueT*                                     original_reference,
+    ValueT*                                     vector_y_out,
+    int                                         timing_iterations,
+    const std::vector<SpmvTrial>&               method_trials)
+{
+    if (!g_quiet)
+        printf("\n\nReordering speedup (original matrix, best of three trials):\n");
+
+    for (int m = 0; m < int(methods.size()); ++m)
+    {
+        if (method_trials[m].avg_ms <= 0)
+            continue;
+
+        float original_ms = -1;
+        for (int trial = 0; trial < 3; ++trial)
+        {
+            float trial_ms = TrialSpmvMethod(*methods[m], original_matrix, original_vector_x, original_reference, vector_y_out, timing_iterations);
+            if ((trial_ms > 0) && ((original_ms < 0) || (trial_ms < original_ms)))
+                original_ms = trial_ms;
+        }
+        if (original_ms < 0)
+        {
+            fprintf(stderr, "WARNING: %s gives a wrong result on the original matrix\n", methods[m]->label);
+            continue;
+        }
+
+        if (!g_quiet)
+            printf("\t%s: %.4f ms original, %.4f ms reordered (%.2fx)\n",
+                methods[m]->label, original_ms, method_trials[m].avg_ms, original_ms / method_trials[m].avg_ms);
+        else
+            printf("%s, reorder_speedup, %.5f, %.5f, %.3f\n",
+                methods[m]->label, original_ms, method_trials[m].avg_ms, original_ms / method_trials[m].avg_ms);
+    }
+    fflush(stdout);
+}
+
+/**
+ * The rebuild that DynamicCsrMatrix avoids: the matrix's tuples with the
+ * updates appended, stable-sorted by (row, col) and resolved in order into a
+ * new CSR
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void RebuildWithUpdates(
+    CsrMatrix<ValueT, OffsetT>&                             csr_matrix,
+    const std::vector<DynamicCsrUpdate<ValueT, OffsetT> >&  updates,
+    CsrMatrix<ValueT, OffsetT>&                             rebuilt)
+{
+    typedef DynamicCsrUpdate<ValueT, OffsetT> Update;
+
+    std::vector<Update> tuples(csr_matrix.num_nonzeros);
+    for (OffsetT row = 0; row < csr_matrix.num_rows; ++row)
+    {
+        for (OffsetT offset = csr_matrix.row_offsets[row]; offset < csr_matrix.row_offsets[row + 1]; ++offset)
+        {
+            tuples[offset].row  = row;
+            tuples[offset].col  = csr_matrix.column_indices[offset];
+            tuples[offset].val  = csr_matrix.values[offset];
+            tuples[offset].op   = DYNAMIC_CSR_INSERT;
+        }
+    }
+    tuples.insert(tuples.end(), updates.begin(), updates.end());
+    std::stable_sort(tuples.begin(), tuples.end(), typename CsrMatrix<ValueT, OffsetT>::CooComparator());
+
+    // Resolve each (row, col) in order
+    size_t num_resolved = 0;
+    for (size_t i = 0; i < tuples.size();)
+    {
+        bool    present = false;
+        ValueT  value   = 0.0;
+        size_t  first   = i;
+        for (; (i < tuples.size()) && (tuples[i].row == tuples[first].row) && (tuples[i].col == tuples[first].col); ++i)
+            tuples[i].ApplyTo(present, value);
+        if (present)
+        {
+            tuples[num_resolved]        = tuples[first];
+            tuples[num_resolved].val    = value;
+            ++num_resolved;
+        }
+    }
+
+    rebuilt.Clear();
+    rebuilt.num_rows        = csr_matrix.num_rows;
+    rebuilt.num_cols        = csr_matrix.num_cols;
+    rebuilt.num_nonzeros    = OffsetT(num_resolved);
+    rebuilt.row_offsets     = (OffsetT*) HostMalloc(sizeof(OffsetT) * (rebuilt.num_rows + 1), 0);
+    rebuilt.column_indices  = (OffsetT*) HostMalloc(sizeof(OffsetT) * rebuilt.num_nonzeros, 0);
+    rebuilt.values          = (ValueT*) HostMalloc(sizeof(ValueT) * rebuilt.num_nonzeros, 0);
+
+    std::fill(rebuilt.row_offsets, rebuilt.row_offsets + rebuilt.num_rows + 1, OffsetT(0));
+    for (size_t i = 0; i < num_resolved; ++i)
+    {
+        rebuilt.row_offsets[tuples[i].row + 1]++;
+        rebuilt.column_indices[i]   = tuples[i].col;
+        rebuilt.values[i]           = tuples[i].val;
+    }
+    for (OffsetT row = 0; row < rebuilt.num_rows; ++row)
+        rebuilt.row_offsets[row + 1] += rebuilt.row_offsets[row];
+}
+
+
+/**
+ * Incremental update study (--updates=<batch size>): applies
+ * g_update_batches random batches to a DynamicCsrMatrix copy of the matrix,
+ * each half inserts at random positions and a quarter each updates and
+ * deletes of the matrix's entries, with an SpMV after each batch.  Reports
+ * the time per batch, the SpMV time with the delta buffers against the
+ * merge-based SpMV of the unchanged matrix, the merges, and the time to
+ * rebuild the CSR from COO instead, and verifies the SpMV with buffered
+ * changes and after a final merge against that rebuild.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void RunUpdateStudy(
+    CsrMatrix<ValueT, OffsetT>&     csr_matrix,
+    ValueT*                         vector_x,
+    ValueT*                         vector_y_out,
+    OffsetT                         batch_size)
+{
+    typedef DynamicCsrUpdate<ValueT, OffsetT> Update;
+
+    if ((csr_matrix.num_nonzeros == 0) || (g_update_batches < 1))
+        return;
+
+    // Merge-based SpMV of the unchanged matrix
+    CsrView<ValueT, OffsetT> a(csr_matrix);
+    int2 *thread_coords     = new int2[g_omp_threads];
+    int2 *thread_coord_ends = new int2[g_omp_threads];
+    OmpMergePartitionMatrix(thread_coords, thread_coord_ends, g_omp_threads, a);
+    OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads, a, vector_x, vector_y_out);
+    double start = WallClockSeconds();
+    for (int it = 0; it < g_update_batches; ++it)
+        OmpMergeCsrmv(thread_coords, thread_coord_ends, g_omp_threads, a, vector_x, vector_y_out);
+    double base_spmv_ms = (WallClockSeconds() - start) * 1000 / g_update_batches;
+    delete[] thread_coords;
+    delete[] thread_coord_ends;
+
+    DynamicCsrMatrix<ValueT, OffsetT> dynamic;
+    dynamic.Init(a, g_omp_threads, g_merge_fraction);
+
+    mersenne::State state;
+    unsigned int key[2] = {(unsigned int) batch_size, (unsigned int) csr_matrix.num_nonzeros};
+    mersenne::init_by_array(state, key, 2);
+
+    std::vector<Update> batch(batch_size), all_updates;
+    double apply_ms = 0, merge_ms = 0, spmv_ms = 0;
+    int    num_searched = 0;
+    for (int b = 0; b < g_update_batches; ++b)
+    {
+        for (OffsetT i = 0; i < batch_size; ++i)
+        {
+            Update &update  = batch[i];
+            double kind     = RandomMatrixParams::Uniform(state);
+            if (kind < 0.5)
+            {
+                update.row  = OffsetT(RandomMatrixParams::Below(state, csr_matrix.num_rows));
+                update.col  = OffsetT(RandomMatrixParams::Below(state, csr_matrix.num_cols));
+                update.op   = DYNAMIC_CSR_INSERT;
+            }
+            else
+            {
+                OffsetT offset  = OffsetT(RandomMatrixParams::Below(state, csr_matrix.num_nonzeros));
+                update.row      = OffsetT(std::upper_bound(csr_matrix.row_offsets, csr_matrix.row_offsets + csr_matrix.num_rows + 1, offset)
+                                    - csr_matrix.row_offsets) - 1;
+                update.col      = csr_matrix.column_indices[offset];
+                update.op       = (kind < 0.75) ? DYNAMIC_CSR_UPDATE : DYNAMIC_CSR_DELETE;
+            }
+            update.val = ValueT(1.0 + RandomMatrixParams::Uniform(state));
+        }
+        all_updates.insert(all_updates.end(), batch.begin(), batch.end());
+
+        int prior_merges = dynamic.num_merges;
+        start = WallClockSeconds();
+        OffsetT num_rejected = dynamic.Apply(&batch[0], batch_size);
+        double elapsed_ms = (WallClockSeconds() - start) * 1000;
+        if (num_rejected > 0)
+        {
+            fprintf(stderr, "%lld updates of batch %d fall outside the %lld x %lld matrix\n",
+                (long long) num_rejected, b, (long long) csr_matrix.num_rows, (long long) csr_matrix.num_cols);
+            exit(1);
+        }
+        bool merged = (dynamic.num_merges > prior_merges);
+        if (merged)
+        {
+            merge_ms        += elapsed_ms;
+            num_searched    += dynamic.num_searched;
+        }
+        else
+        {
+            apply_ms        += elapsed_ms;
+        }
+
+        start = WallClockSeconds();
+        dynamic.Spmv(vector_x, vector_y_out);
+        spmv_ms += (WallClockSeconds() - start) * 1000;
+    }
+    int num_merges  = dynamic.num_merges;
+    int num_applies = g_update_batches - num_merges;
+
+    // Rebuild from COO with every update, and verify against it
+    CsrMatrix<ValueT, OffsetT> rebuilt;
+    start = WallClockSeconds();
+    RebuildWithUpdates(csr_matrix, all_updates, rebuilt);
+    double rebuild_ms = (WallClockSeconds() - start) * 1000;
+
+    ValueT *reference = (ValueT*) HostMalloc(sizeof(ValueT) * csr_matrix.num_rows, 0);
+    SpmvGold(rebuilt.num_rows, rebuilt.row_offsets, rebuilt.column_indices, rebuilt.values, vector_x, reference);
+
+    OffsetT num_deltas = dynamic.num_deltas;
+    dynamic.Spmv(vector_x, vector_y_out);
+    int buffered_compare = CompareResults(vector_y_out, reference, csr_matrix.num_rows, !g_quiet);
+    dynamic.Merge();
+    dynamic.Spmv(vector_x, vector_y_out);
+    int merged_compare = CompareResults(vector_y_out, reference, csr_matrix.num_rows, !g_quiet);
+    if (dynamic.base.num_nonzeros != rebuilt.num_nonzeros)
+        merged_compare = 1;
+
+    if (!g_quiet)
+    {
+        printf("\n\nIncremental updates (%d batches of %d: 1/2 inserts, 1/4 updates, 1/4 deletes; merge past %.1f%% of nonzeros):\n",
+            g_update_batches, int(batch_size), 100.0 * g_merge_fraction);
+        printf("\tapply: %.4f ms per batch without a merge (%d batches)\n",
+            apply_ms / std::max(num_applies, 1), num_applies);
+        printf("\tmerge: %.4f ms per batch with a merge (%d merges, %d of %d partition boundaries searched again)\n",
+            merge_ms / std::max(num_merges, 1), num_merges, num_searched, num_merges * (g_omp_threads - 1));
+        printf("\tspmv: %.4f ms with delta buffers vs. %.4f ms merge-based on the original matrix\n",
+            spmv_ms / g_update_batches, base_spmv_ms);
+        printf("\trebuild from COO: %.4f ms (%d nonzeros -> %d)\n",
+            rebuild_ms, int(csr_matrix.num_nonzeros), int(rebuilt.num_nonzeros));
+        printf("\tbuffered (%d entries): %s, merged: %s\n",
+            int(num_deltas), buffered_compare ? "FAIL" : "PASS", merged_compare ? "FAIL" : "PASS");
+    }
+    else
+    {
+        printf("updates, %d, %d, %.5f, %d, %.5f, %d, %.5f, %.5f, %.5f, %s, %s\n",
+            g_update_batches, int(batch_size),
+            apply_ms / std::max(num_applies, 1), num_merges, merge_ms / std::max(num_merges, 1), num_searched,
+            spmv_ms / g_update_batches, base_spmv_ms, rebuild_ms,
+            buffered_compare ? "FAIL" : "PASS", merged_compare ? "FAIL" : "PASS");
+    }
+    fflush(stdout);
+
+    HostFree(reference, sizeof(ValueT) * csr_matrix.num_rows);
+}
+
+
+
+/**
+ * Choose one of the candidate methods for this matrix and thread count:
+ * from the tuning cache if the matrix fingerprint has been tuned before,
+ * else by short trials of the heuristic shortlist (stored in the cache).
+ * With --autotune=model, the trained selector (spmv_selector.h) picks from
+ * the shortlist instead of trials, which are only run when its prediction
+ * is not on the shortlist.  Replaces candidates with the winner, or returns
+ * false if no method produces a correct result.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+bool AutotuneSpmvMethod(
+    std::vector<SpmvMethod<ValueT, OffsetT>*>   &candidates,
+    CsrMatrix<ValueT, OffsetT>&                 csr_matrix,
+    const GraphStats&                           stats,
+    ValueT*                                     vector_x,
+    ValueT*                                     reference_vector_y_out,
+    ValueT*                                     vector_y_out,
+    CommandLineArgs&                            args)
+{
+    std::string mode;
+    args.GetCmdLineArgument("autotune", mode);
+    if (!mode.empty() && (mode != "model"))
+    {
+        fprintf(stderr, "Unknown autotune mode '%s' (expected --autotune or --autotune=model)\n", mode.c_str());
+        exit(1);
+    }
+
+    std::string cache_filename = "spmv_tune.cache";
+    int         trial_iterations = std::min(100, std::max(5, int((1 << 24) / std::max(1, csr_matrix.num_nonzeros))));
+    args.GetCmdLineArgument("tune-cache", cache_filename);
+    args.GetCmdLineArgument("tune-i", trial_iterations);
+
+    CpuTimer tune_timer;
+    tune_timer.Start();
+
+    unsigned long long  fingerprint = csr_matrix.Fingerprint();
+    TuningCache         cache(cache_filename);
+    std::string         cached_method;
+    float               winner_ms   = -1;
+    int                 winner      = -1;
+
+    // (a cached method outside the candidates is ignored, along with its time)
+    float cached_ms = -1;
+    if (!args.CheckCmdLineFlag("retune") &&
+        cache.Lookup(fingerprint, sizeof(ValueT), g_omp_threads, cached_method, cached_ms))
+    {
+        for (int m = 0; m < int(candidates.size()); ++m)
+            if (cached_method == candidates[m]->name)
+            {
+                winner      = m;
+                winner_ms   = cached_ms;
+            }
+    }
+
+    bool cached     = (winner >= 0);
+    bool predicted  = false;
+    if (!cached)
+    {
+        // Shortlist from cheap row-length statistics
+        int num_nodes = 1;
+#ifdef CUB_NUMA
+        if (NumaMallocAvailable())
+            num_nodes = numa_num_configured_nodes();
+#endif
+        size_t llc_bytes = CacheFlusher::LastLevelCacheBytes() * num_nodes;
+
+        std::vector<SpmvMethod<ValueT, OffsetT>*> shortlist;
+        ShortlistSpmvMethods(candidates, stats, llc_bytes, num_nodes, shortlist);
+        if (shortlist.empty())
+        {
+            // Fall back to every candidate that can run the matrix
+            for (int m = 0; m < int(candidates.size()); ++m)
+                if (!candidates[m]->Unsupported(stats))
+                    shortlist.push_back(candidates[m]);
+        }
+
+        // Trained selector
+        if (mode == "model")
+        {
+            static bool warned = false;
+            std::string trained_cpu(SPMV_SELECTOR_CPU_MODEL);
+            char trained_threads[32];
+            if (SPMV_SELECTOR_MIN_THREADS == SPMV_SELECTOR_MAX_THREADS)
+                snprintf(trained_threads, sizeof(trained_threads), "%d", SPMV_SELECTOR_MIN_THREADS);
+            else
+                snprintf(trained_threads, sizeof(trained_threads), "%d-%d", SPMV_SELECTOR_MIN_THREADS, SPMV_SELECTOR_MAX_THREADS);
+
+            if (!warned && ((g_omp_threads < SPMV_SELECTOR_MIN_THREADS) || (g_omp_threads > SPMV_SELECTOR_MAX_THREADS)))
+                fprintf(stderr, "WARNING: the selector model was trained at thread count %s, not %d; its picks are extrapolated (retrain with train_selector.py)\n",
+                    trained_threads, g_omp_threads);
+            else if (!warned && !trained_cpu.empty() && (trained_cpu != CpuModelName()))
+                fprintf(stderr, "WARNING: the selector model was trained on %s, not %s; its picks may not hold here (retrain with train_selector.py)\n",
+                    trained_cpu.c_str(), CpuModelName().c_str());
+            warned = true;
+
+            const char *prediction = SpmvSelectorPredict(stats, sizeof(ValueT), g_omp_threads);
+            for (int m = 0; m < int(candidates.size()); ++m)
+                if ((std::string(prediction) == candidates[m]->name) &&
+                    (std::find(shortlist.begin(), shortlist.end(), candidates[m]) != shortlist.end()))
+                {
+                    winner      = m;
+                    predicted   = true;
+                }
+            if (!predicted && !g_quiet)
+                printf("\tautotune: model predicts %s, which is not shortlisted; running trials\n", prediction);
+        }
+
+        // Short trials
+        for (int s = 0; !predicted && (s < int(shortlist.size())); ++s)
+        {
+            float trial_ms = TrialSpmvMethod(*shortlist[s], csr_matrix, vector_x, reference_vector_y_out, vector_y_out, trial_iterations);
+            if (!g_quiet)
+                printf("\tautotune: %s %.4f ms per SpMV%s\n", shortlist[s]->name, trial_ms, (trial_ms < 0) ? " (FAIL)" : "");
+            if ((trial_ms > 0) && ((winner_ms < 0) || (trial_ms < winner_ms)))
+            {
+                winner_ms = trial_ms;
+                for (int m = 0; m < int(candidates.size()); ++m)
+                    if (candidates[m] == shortlist[s])
+                        winner = m;
+            }
+        }
+
+        if (winner < 0)
+            return false;
+        if (!predicted)
+            cache.Store(fingerprint, sizeof(ValueT), g_omp_threads, candidates[winner]->name, winner_ms);
+    }
+
+    tune_timer.Stop();
+
+    if (!g_quiet && predicted)
+        printf("\tautotune: %s (model, %.3f ms tuning, fingerprint %016llx)\n",
+            candidates[winner]->name, tune_timer.ElapsedMillis(), fingerprint);
+    else if (!g_quiet)
+        printf("\tautotune: %s (%.4f ms trial, %s, %.3f ms tuning, fingerprint %016llx)\n",
+            candidates[winner]->name, winner_ms, cached ? "cached" : "tuned", tune_timer.ElapsedMillis(), fingerprint);
+    else
+        printf("%s, %d, %.3f, ", candidates[winner]->name, int(cached), tune_timer.ElapsedMillis());
+    fflush(stdout);
+
+    SpmvMethod<ValueT, OffsetT> *chosen = candidates[winner];
+    candidates.assign(1, chosen);
+    return true;
+}
+
+
+/**
+ * Results of one matrix: a record per (method, thread count)
+ */
+struct MatrixResults
+{
+    struct Record
+    {
+        std::string     method;
+        int             threads;
+        std::string     affinity;
+        SpmvTrial       trial;
+
+        Record() : threads(0) {}
+    };
+
+    std::string             status;             // "skipped" or "failed" when the matrix was not run
+    std::string             skip_reason;        // Why the matrix was not run (empty if it was)
+    GraphStats              stats;
+    int                     value_bytes;        // sizeof(ValueT), sizeof(OffsetT) (0 until the matrix is built)
+    int                     offset_bytes;
+    int                     timing_iterations;
+    int                     expected_calls;     // SpMV calls setup is amortized over (total_ms)
+    double                  modeled_bytes;      // LRU-modeled bytes per SpMV (0 without --cache-sim)
+    std::string             reorder;            // Ordering the matrix was run in (--reorder, empty for the original)
+    double                  reorder_ms;         // Time to compute the ordering
+    int                     partitions;         // Graph partitions the rows were grouped by (--partition, 0 if not)
+    double                  partition_ms;       // Time to compute the partition
+    double                  remote_x_before;    // Fraction of vector_x gathers outside the gathering thread's rows
+    double                  remote_x_after;
+    std::vector<Record>     records;
+
+    MatrixResults() : value_bytes(0), offset_bytes(0), timing_iterations(0), expected_calls(0), modeled_bytes(0), reorder_ms(0),
+        partitions(0), partition_ms(0), remote_x_before(0), remote_x_after(0)
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    void Add(const char* method, int threads, const std::string &affinity, const SpmvTrial& trial)
+    {
+        Record record;
+        record.method   = method;
+        record.threads  = threads;
+        record.affinity = affinity;
+        record.trial    = trial;
+        records.push_back(record);
+    }
+};
+
+
+/**
+ * Run tests.  In batch mode (results is non-NULL) every (method, thread count)
+ * is recorded in results, and matrices that cannot be run return false with
+ * a reason instead of ending the process.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+bool RunTests(
+    const std::string&  mtx_filename,
+    int                 grid2d,
+    int                 grid3d,
+    int                 wheel,
+    int                 dense,
+    int                         rmat,
+    const RandomMatrixParams*   random_matrix,
+    int                         timing_iterations,
+    CommandLineArgs&            args,
+    MatrixResults*              results = NULL)
+{
+    // Initialize matrix in COO form (R-MAT and random matrices are generated directly in CSR form)
+    CooMatrix<ValueT, OffsetT> coo_matrix;
+    CsrMatrix<ValueT, OffsetT> csr_matrix;
+
+    if (!mtx_filename.empty())
+    {
+        // Parse matrix market file
+        if (!coo_matrix.InitMarket(mtx_filename, 1.0, !g_quiet))
+        {
+            if (!results) exit(1);
+            results->status = "failed";
+            results->skip_reason = "unreadable or malformed matrix file";
+            return false;
+        }
+
+        if ((coo_matrix.num_rows == 1) || (coo_matrix.num_cols == 1) || (coo_matrix.num_nonzeros == 1))
+        {
+            if (!g_quiet) printf("Trivial dataset\n");
+            if (!results) exit(0);
+            results->status = "skipped";
+            results->skip_reason = "trivial dataset";
+            return false;
+        }
+        printf("%s, ", mtx_filename.c_str()); fflush(stdout);
+    }
+    else if (grid2d > 0)
+    {
+        // Generate 2D lattice
+        printf("grid2d_%d, ", grid2d); fflush(stdout);
+        coo_matrix.InitGrid2d(grid2d, false);
+    }
+    else if (grid3d > 0)
+    {
+        // Generate 3D lattice
+        printf("grid3d_%d, ", grid3d); fflush(stdout);
+        coo_matrix.InitGrid3d(grid3d, false);
+    }
+    else if (wheel > 0)
+    {
+        // Generate wheel graph
+        printf("wheel_%d, ", wheel); fflush(stdout);
+        coo_matrix.InitWheel(wheel);
+    }
+    else if (dense > 0)
+    {
+        // Generate dense graph
+        OffsetT rows = (1<<24) / dense;               // 16M nnz
+        printf("dense_%d_x_%d, ", rows, dense); fflush(stdout);
+        coo_matrix.InitDense(rows, dense);
+    }
+    else if (rmat > 0)
+    {
+        // Generate R-MAT graph
+        int             edge_factor = 16;
+        unsigned int    seed        = 0;
+        args.GetCmdLineArgument("edge-factor", edge_factor);
+        args.GetCmdLineArgument("seed", seed);
+        std::vector<double> abc;
+        args.GetCmdLineArguments("rmat-abc", abc);
+        if (abc.empty())
+        {
+            // Graph500 parameters
+            abc.push_back(0.57);
+            abc.push_back(0.19);
+            abc.push_back(0.19);
+        }
+        if ((abc.size() != 3) || (abc[0] < 0) || (abc[1] < 0) || (abc[2] < 0) || (abc[0] + abc[1] + abc[2] > 1))
+        {
+            fprintf(stderr, "--rmat-abc needs three non-negative probabilities a,b,c with a + b + c <= 1\n");
+            exit(1);
+        }
+        printf("rmat_%d_%d, ", rmat, edge_factor); fflush(stdout);
+        csr_matrix.InitRmat(rmat, edge_factor, abc[0], abc[1], abc[2], seed, !args.CheckCmdLineFlag("no-permute"));
+    }
+    else if (random_matrix)
+    {
+        // Generate random matrix (the name is quoted as it contains commas)
+        printf("\"%s\", ", random_matrix->Name().c_str()); fflush(stdout);
+        csr_matrix.InitRandom(*random_matrix);
+        if (csr_matrix.num_nonzeros == 0)
+        {
+            if (!results) exit(0);
+            results->status = "skipped";
+            results->skip_reason = "no nonzeros";
+            return false;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "No graph type specified.\n");
+        exit(1);
+    }
+
+    if (coo_matrix.coo_tuples)
+    {
+        csr_matrix.Init(coo_matrix);
+        coo_matrix.Clear();
+    }
+
+    // Column-locality reordering (--reorder) and graph partitioning
+    // (--partition): run on P A P^T, keeping the original matrix to verify
+    // and time against.  relabel maps original to current labels.
+    std::string reorder;
+    int         partitions = 0;
+    args.GetCmdLineArgument("reorder", reorder);
+    if (args.CheckCmdLineFlag("partition"))
+    {
+        partitions = g_omp_threads;
+        args.GetCmdLineArgument("partition", partitions);
+    }
+
+    CsrMatrix<ValueT, OffsetT>  original_matrix;
+    OffsetT*                    relabel = NULL;
+    PartitionOwnership          ownership;
+    if ((!reorder.empty() || (partitions > 0)) && (csr_matrix.num_rows != csr_matrix.num_cols))
+    {
+        fprintf(stderr, "WARNING: --reorder and --partition need a square matrix; running in the original order\n");
+        reorder.clear();
+        partitions = 0;
+    }
+
+    if (!reorder.empty())
+    {
+        OrderingStats before, after;
+        before.Compute(csr_matrix);
+        std::vector<OffsetT> step(csr_matrix.num_rows);
+
+        CpuTimer order_timer;
+        order_timer.Start();
+        ComputeOrdering(reorder, csr_matrix, &step[0]);
+        order_timer.Stop();
+
+        CpuTimer rebuild_timer;
+        rebuild_timer.Start();
+        RelabelMatrix(csr_matrix, &step[0], original_matrix, relabel);
+        rebuild_timer.Stop();
+
+        after.Compute(csr_matrix);
+        if (!g_quiet)
+            printf("\n\treorder: %s in %.3f ms (+ %.3f ms to rebuild the CSR); bandwidth %lld -> %lld, profile %.0f -> %.0f\n",
+                reorder.c_str(), order_timer.ElapsedMillis(), rebuild_timer.ElapsedMillis(),
+                before.bandwidth, after.bandwidth, before.profile, after.profile);
+        else
+            printf("%s, %.3f, %.3f, %lld, %lld, %.0f, %.0f, ",
+                reorder.c_str(), order_timer.ElapsedMillis(), rebuild_timer.ElapsedMillis(),
+                before.bandwidth, after.bandwidth, before.profile, after.profile);
+        if (results)
+        {
+            results->reorder    = reorder;
+            results->reorder_ms = order_timer.ElapsedMillis();
+        }
+    }
+
+    if (partitions > 0)
+    {
+        PartitionOwnership before;
+        before.Init(csr_matrix, g_omp_threads);
+        std::vector<OffsetT> step(csr_matrix.num_rows);
+
+        CpuTimer partition_timer;
+        partition_timer.Start();
+        PartitionStats partition = PartitionOrdering(csr_matrix, partitions, &step[0]);
+        partition_timer.Stop();
+
+        CpuTimer rebuild_timer;
+        rebuild_timer.Start();
+        RelabelMatrix(csr_matrix, &step[0], original_matrix, relabel);
+        rebuild_timer.Stop();
+
+        ownership.Init(csr_matrix, g_omp_threads);
+        DisplayPartitionReport(partitions, partition, partition_timer.ElapsedMillis(), rebuild_timer.ElapsedMillis(), before, ownership);
+        if (results)
+        {
+            results->partitions         = partitions;
+            results->partition_ms       = partition_timer.ElapsedMillis();
+            results->remote_x_before    = before.RemoteFraction();
+            results->remote_x_after     = ownership.RemoteFraction();
+        }
+    }
+
+    // Display matrix info
+    GraphStats stats = csr_matrix.Stats();
+    stats.Display(!g_quiet);
+    if (results)
+    {
+        results->stats          = stats;
+        results->value_bytes    = sizeof(ValueT);
+        results->offset_bytes   = sizeof(OffsetT);
+    }
+    if (!g_quiet)
+    {
+        printf("\n");
+        csr_matrix.DisplayHistogram();
+        printf("\n");
+        if (g_verbose2)
+            csr_matrix.Display();
+        printf("\n");
+    }
+    fflush(stdout);
+
+    // Determine # of timing iterations (aim to run 16 billion nonzeros through, total)
+    if (timing_iterations == -1)
+    {
+        timing_iterations = std::min(200000ull, std::max(100ull, ((16ull << 30) / csr_matrix.num_nonzeros)));
+        if (!g_quiet)
+            printf("\t%d timing iterations\n", timing_iterations);
+    }
+    if (results)
+    {
+        results->timing_iterations  = timing_iterations;
+        results->expected_calls     = (g_expected_calls > 0) ? g_expected_calls : timing_iterations;
+    }
+
+    // Allocate input and output vectors (if available, use NUMA allocation to force storage on the 
+    // sockets for performance consistency)
+    ValueT *vector_x                = (ValueT*) HostMalloc(sizeof(ValueT) * csr_matrix.num_cols, 0);
+    ValueT *reference_vector_y_out  = (ValueT*) HostMalloc(sizeof(ValueT) * csr_matrix.num_rows, 0);
+    ValueT *vector_y_out            = (ValueT*) HostMalloc(sizeof(ValueT) * csr_matrix.num_rows, 0);
+
+    // Place each thread's part of the vectors on its node (--partition)
+    if (partitions > 0)
+    {
+        ownership.PlaceOnNodes(vector_x, sizeof(ValueT));
+        ownership.PlaceOnNodes(vector_y_out, sizeof(ValueT));
+    }
+
+    for (int col = 0; col < csr_matrix.num_cols; ++col)
+        vector_x[col] = csr_matrix.num_cols - col + 2.0;
+
+    // Compute reference answer
+    ValueT *original_vector_x   = NULL;
+    ValueT *original_reference  = NULL;
+    if (relabel)
+    {
+        // Solve the original problem, then permute x and y to match: (P A P^T)(P x) = P y
+        original_vector_x   = (ValueT*) HostMalloc(sizeof(ValueT) * csr_matrix.num_cols, 0);
+        original_reference  = (ValueT*) HostMalloc(sizeof(ValueT) * csr_matrix.num_rows, 0);
+        memcpy(original_vector_x, vector_x, sizeof(ValueT) * csr_matrix.num_cols);
+        SpmvGold(original_matrix.num_rows, original_matrix.row_offsets, original_matrix.column_indices, original_matrix.values,
+            original_vector_x, original_reference);
+
+        for (OffsetT i = 0; i < csr_matrix.num_rows; ++i)
+        {
+            vector_x[relabel[i]]                = original_vector_x[i];
+            reference_vector_y_out[relabel[i]]  = original_reference[i];
+        }
+    }
+    else
+    {
+        SpmvGold(csr_matrix.num_rows, csr_matrix.row_offsets, csr_matrix.column_indices, csr_matrix.values, vector_x, reference_vector_y_out);
+    }
+
+    // Select methods (--replicate-x adds the replicated-x variants to the defaults)
+    std::vector<SpmvMethod<ValueT, OffsetT>*> registry, methods;
+    RegisterSpmvMethods(registry);
+
+    std::vector<std::string> method_names;
+    args.GetCmdLineArguments("methods", method_names);
+    if (method_names.empty() && g_replicate_x)
+    {
+        for (int j = 0; j < int(registry.size()); ++j)
+            if (registry[j]->default_enabled)
+                method_names.push_back(registry[j]->name);
+        method_names.push_back("merge-rx");
+        method_names.push_back("lengoto-rx");
+    }
+
+    // Autotuning considers every registered method unless --methods narrows them
+    if (g_autotune && method_names.empty())
+        methods = registry;
+    else
+        SelectSpmvMethods(registry, method_names, methods);
+
+    if (g_autotune && !AutotuneSpmvMethod(methods, csr_matrix, stats, vector_x, reference_vector_y_out, vector_y_out, args))
+    {
+        fprintf(stderr, "Autotuning found no method that produces a correct result\n");
+        if (!results) exit(1);
+        results->status = "failed";
+        results->skip_reason = "autotuning found no correct method";
+
+        for (int j = 0; j < int(registry.size()); ++j)
+            delete registry[j];
+        HostFree(vector_x, sizeof(ValueT) * csr_matrix.num_cols);
+        HostFree(reference_vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
+        HostFree(vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
+        if (relabel)
+        {
+            HostFree(original_vector_x, sizeof(ValueT) * csr_matrix.num_cols);
+            HostFree(original_reference, sizeof(ValueT) * csr_matrix.num_rows);
+            delete[] relabel;
+        }
+        return false;
+    }
+
+    // Storage the methods run on (--layout)
+    CsrLayoutCopy<ValueT, OffsetT>  layout_copy;
+    CsrView<ValueT, OffsetT>        layout(csr_matrix);
+    layout_copy.Parse(g_layout);
+    if (layout_copy.Enabled())
+    {
+        layout_copy.Init(csr_matrix);
+        layout = layout_copy.View();
+        if (!g_quiet)
+            printf("\tlayout: %s, %d-based\n",
+                (layout_copy.ends) ? "separate row starts and ends with gaps" : "row offsets", layout_copy.index_base);
+    }
+
+    // Cache eviction for cold timing
+    CacheFlusher *flusher = NULL;
+    if (g_cold)
+    {
+        int llc_instances = 1;
+#ifdef CUB_NUMA
+        if (NumaMallocAvailable())
+            llc_instances = numa_num_configured_nodes();
+#endif
+        size_t cold_bytes = 0;
+        args.GetCmdLineArgument("cold-bytes", cold_bytes);
+
+        flusher = new CacheFlusher();
+        flusher->Init(g_cold_clflush, cold_bytes, llc_instances);
+        if (layout_copy.Enabled())
+        {
+            flusher->AddRegion(layout_copy.row_offsets, sizeof(OffsetT) * (csr_matrix.num_rows + 1));
+            if (layout_copy.ends)
+                flusher->AddRegion(layout_copy.row_end_offsets, sizeof(OffsetT) * csr_matrix.num_rows);
+            flusher->AddRegion(layout_copy.column_indices, sizeof(OffsetT) * layout_copy.num_stored);
+            flusher->AddRegion(layout_copy.values, sizeof(ValueT) * layout_copy.num_stored);
+        }
+        else
+        {
+            flusher->AddRegion(csr_matrix.row_offsets, sizeof(OffsetT) * (csr_matrix.num_rows + 1));
+            flusher->AddRegion(csr_matrix.column_indices, sizeof(OffsetT) * csr_matrix.num_nonzeros);
+            flusher->AddRegion(csr_matrix.values, sizeof(ValueT) * csr_matrix.num_nonzeros);
+        }
+        flusher->AddRegion(vector_x, sizeof(ValueT) * csr_matrix.num_cols);
+        flusher->AddRegion(vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
+
+        if (!g_quiet)
+        {
+            if (flusher->clflush)
+                printf("\tcold: clflush of matrix, vectors, and per-method data before each of up to %d iterations\n", g_cold_iterations);
+            else
+                printf("\tcold: streaming %.1f MB before each of up to %d iterations\n",
+                    double(flusher->buffer_bytes) / (1 << 20), g_cold_iterations);
+        }
+    }
+
+    // Traffic model against the calibrated machine bandwidth
+    SpmvTrafficModel traffic;
+    if (g_roofline)
+    {
+        traffic.Init(csr_matrix, g_machine.llc_bytes);
+        if (!g_quiet)
+            printf("\troofline: %.1f MB streamed, %.0f x line accesses, %.0f estimated x misses; bound %.4f ms streaming, %.4f ms with x misses\n",
+                traffic.stream_bytes / (1 << 20),
+                traffic.x_line_accesses,
+                traffic.x_misses,
+                traffic.StreamBoundMillis(g_machine),
+                traffic.BoundMillis(g_machine));
+        if (!g_quiet && (traffic.stream_bytes < g_machine.llc_bytes))
+            printf("\troofline: working set fits in the last-level cache; warm runs can exceed the DRAM bound\n");
+    }
 
-    MklCreateMatrix(a, mklMatrix);
-    
-    status = mkl_sparse_set_mv_hint(mklMatrix, SPARSE_OPERATION_NON_TRANSPOSE, matrixDescr, timing_iterations);
-    if (status != SPARSE_STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to set mv hint. Error code: %d\n", status);
-        exit(1);
+    // LRU simulation of vector_x reuse within the merge-path partitions of g_omp_threads threads
+    if (g_cache_sim)
+    {
+        int2 *partition_starts  = new int2[g_omp_threads];
+        int2 *partition_ends    = new int2[g_omp_threads];
+        OmpMergePartitionMatrix(partition_starts, partition_ends, g_omp_threads,
+                                CsrView<ValueT, OffsetT>(csr_matrix));
+
+        size_t cache_bytes = (g_cache_sim_bytes > 0) ? g_cache_sim_bytes : CacheFlusher::LastLevelCacheBytes();
+        traffic.SimulateXCache(csr_matrix, partition_starts, partition_ends, g_omp_threads, cache_bytes);
+
+        delete[] partition_starts;
+        delete[] partition_ends;
+
+        if (!g_quiet)
+            printf("\tcache-sim: %d partitions x %.0f KB %d-way LRU: %.0f x line misses for %d nonzeros (%.1f%% hit rate), %.1f MB of x lines; "
+                "modeled traffic %.1f MB vs. naive %.1f MB\n",
+                traffic.cache_partitions,
+                double(traffic.cache_bytes) / traffic.cache_partitions / 1024,
+                traffic.cache_ways,
+                traffic.x_lru_misses,
+                csr_matrix.num_nonzeros,
+                100.0 * (1.0 - traffic.x_lru_misses / std::max(1, csr_matrix.num_nonzeros)),
+                traffic.x_lru_misses * 64 / (1 << 20),
+                traffic.ModeledBytes() / (1 << 20),
+                traffic.naive_bytes / (1 << 20));
+        if (results)
+            results->modeled_bytes = traffic.ModeledBytes();
     }
 
-    status = mkl_sparse_optimize(mklMatrix);
-    if (status != SPARSE_STATUS_SUCCESS) {
-        fprintf(stderr, "Failed to optimize mkl. Error code: %d\n", status);
-        exit(1);
+    // Run the methods at the configured thread count, or at each count of a
+    // sweep with threads pinned to distinct physical cores before SMT siblings
+    std::vector<SpmvTrial> method_trials;
+    if (g_sweep_threads.empty())
+    {
+        TestSpmvMethods(methods, csr_matrix, layout, vector_x, reference_vector_y_out, vector_y_out,
+            timing_iterations, flusher, traffic, method_trials);
+        DisplayAmortization(methods, method_trials, (g_expected_calls > 0) ? g_expected_calls : timing_iterations);
+        if (relabel)
+            DisplayReorderSpeedup(methods, original_matrix, original_vector_x, original_reference, vector_y_out,
+                timing_iterations, method_trials);
+        if (results)
+            for (int m = 0; m < int(methods.size()); ++m)
+                results->Add(methods[m]->name, g_omp_threads, g_affinity, method_trials[m]);
     }
-    
-    setupTimer.Stop();
-    setup_ms = setupTimer.ElapsedMillis();
-    
-    // Warmup/correctness
-    memset(vector_y_out, -1, sizeof(ValueT) * a.num_rows);
-    MklCsrmv(mklMatrix, matrixDescr, vector_x, vector_y_out);
-    if (!g_quiet)
+    else
     {
-        // Check answer
-        int compare = CompareResults(vector_y_out, reference_vector_y_out, a.num_rows, true);
-        printf("\t%s\n", compare ? "FAIL" : "PASS"); fflush(stdout);
+        int configured_threads = g_omp_threads;
+        std::vector<std::vector<float> > sweep_ms(g_sweep_threads.size());
+        std::vector<std::vector<double> > sweep_mj(g_sweep_threads.size());
+        for (int s = 0; s < int(g_sweep_threads.size()); ++s)
+        {
+            g_omp_threads = g_sweep_threads[s];
+            if (!g_topology.PinThreads(g_omp_threads))
+                fprintf(stderr, "WARNING: could not pin %d threads; sweep placement is up to the OS\n", g_omp_threads);
+            if (!g_quiet)
+                printf("\n\n==== %d threads (%s) ====", g_omp_threads,
+                    (g_omp_threads > g_topology.NumCpus()) ? "oversubscribed" :
+                        ((g_omp_threads > g_topology.NumCores()) ? "smt" : "physical cores"));
+
+            TestSpmvMethods(methods, csr_matrix, layout, vector_x, reference_vector_y_out, vector_y_out,
+                timing_iterations, flusher, traffic, method_trials);
+            for (int m = 0; m < int(methods.size()); ++m)
+            {
+                sweep_ms[s].push_back(method_trials[m].avg_ms);
+                sweep_mj[s].push_back(SpmvMillijoules(method_trials[m], timing_iterations));
+                if (results)
+                    results->Add(methods[m]->name, g_omp_threads, "sweep: physical cores, then smt siblings", method_trials[m]);
+            }
+        }
+        g_omp_threads = configured_threads;
+
+        DisplayThreadSweep(methods, g_sweep_threads, sweep_ms, sweep_mj, g_topology, csr_matrix);
+        method_trials.assign(methods.size(), SpmvTrial());     // No single thread count to compare replication at
     }
 
-    // Re-populate caches, etc.
-    MklCsrmv(mklMatrix, matrixDescr, vector_x, vector_y_out);
-    MklCsrmv(mklMatrix, matrixDescr, vector_x, vector_y_out);
-    MklCsrmv(mklMatrix, matrixDescr, vector_x, vector_y_out);
+    // Report whether gathering from per-node replicas of vector_x paid off
+    float merge_ms = -1, merge_replicated_ms = -1, lengoto_ms = -1, lengoto_replicated_ms = -1;
+    for (int m = 0; m < int(methods.size()); ++m)
+    {
+        if (std::string(methods[m]->name) == "merge")       merge_ms = method_trials[m].avg_ms;
+        if (std::string(methods[m]->name) == "merge-rx")    merge_replicated_ms = method_trials[m].avg_ms;
+        if (std::string(methods[m]->name) == "lengoto")     lengoto_ms = method_trials[m].avg_ms;
+        if (std::string(methods[m]->name) == "lengoto-rx")  lengoto_replicated_ms = method_trials[m].avg_ms;
+    }
+    if (((merge_ms > 0) && (merge_replicated_ms > 0)) || ((lengoto_ms > 0) && (lengoto_replicated_ms > 0)))
+        DisplayReplicationReport(vector_x, timing_iterations, csr_matrix, merge_ms, merge_replicated_ms, lengoto_ms, lengoto_replicated_ms);
 
-    // Timing
-    float elapsed_ms = 0.0;
-    CpuTimer timer;
-    timer.Start();
-    for(int it = 0; it < timing_iterations; ++it)
+    if (g_updates > 0)
+        RunUpdateStudy(csr_matrix, vector_x, vector_y_out, OffsetT(g_updates));
+
+    for (int j = 0; j < int(registry.size()); ++j)
+        delete registry[j];
+    delete flusher;
+
+    // Cleanup
+    HostFree(vector_x, sizeof(ValueT) * csr_matrix.num_cols);
+    HostFree(reference_vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
+    HostFree(vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
+    if (relabel)
     {
-        MklCsrmv(mklMatrix, matrixDescr, vector_x, vector_y_out);
+        HostFree(original_vector_x, sizeof(ValueT) * csr_matrix.num_cols);
+        HostFree(original_reference, sizeof(ValueT) * csr_matrix.num_rows);
+        delete[] relabel;
     }
-    timer.Stop();
-    elapsed_ms += timer.ElapsedMillis();
 
-    return elapsed_ms / timing_iterations;
+    return true;
 }
 
 
 //---------------------------------------------------------------------
-// Test generation
+// Structured results
 //---------------------------------------------------------------------
 
 /**
- * Display perf
+ * Results file with one record per (matrix, method, thread count), in CSV or
+ * JSON Lines (chosen by a ".json"/".jsonl" extension) with a fixed schema.
+ * Unavailable values are empty in CSV and null in JSON.  Records are appended
+ * one matrix at a time, and matrices already in the file are reported by Done
+ * so that batch runs can resume.
+ *
+ * Batch runs also keep the name of the matrix being run in a
+ * "<results>.pending" file; opening the results finds a stale pending file
+ * and records that matrix as failed (the previous process crashed, was
+ * killed, or hit the --timeout watchdog).
  */
-template <typename ValueT, typename OffsetT>
-void DisplayPerf(
-    double                          setup_ms,
-    double                          avg_ms,
-    CsrMatrix<ValueT, OffsetT>&     csr_matrix)
+struct ResultsFile
 {
-    double nz_throughput, effective_bandwidth;
-    size_t total_bytes = (csr_matrix.num_nonzeros * (sizeof(ValueT) * 2 + sizeof(OffsetT))) +
-        (csr_matrix.num_rows) * (sizeof(OffsetT) + sizeof(ValueT));
+    struct Field
+    {
+        const char*     key;
+        std::string     value;
+        bool            quoted;
+    };
 
-    nz_throughput       = double(csr_matrix.num_nonzeros) / avg_ms / 1.0e6;
-    effective_bandwidth = double(total_bytes) / avg_ms / 1.0e6;
+    std::string             filename;
+    std::string             pending_filename;
+    bool                    jsonl;
+    FILE*                   file;
+    std::set<std::string>   done;
 
-    if (!g_quiet)
-        printf("fp%d: %.4f setup ms, %.4f avg ms, %.5f gflops, %.3lf effective GB/s\n",
-            int(sizeof(ValueT) * 8),
-            setup_ms,
-            avg_ms,
-            2 * nz_throughput,
-            effective_bandwidth);
-    else
-        printf("%.5f, %.5f, %.6f, %.3lf, ",
-            setup_ms, avg_ms,
-            2 * nz_throughput,
-            effective_bandwidth);
+    // Run metadata common to every record
+    std::string             compiler;
+    std::string             cpu_model;
+    std::string             host;
 
-    fflush(stdout);
-}
+    ResultsFile() : jsonl(false), file(NULL) {}
 
+    ~ResultsFile()
+    {
+        if (file) fclose(file);
+    }
 
-/**
- * Run tests
- */
-template <
-    typename ValueT,
-    typename OffsetT>
-void RunTests(
-    const std::string&  mtx_filename,
-    int                 grid2d,
-    int                 grid3d,
-    int                 wheel,
-    int                 dense,
-    int                 timing_iterations,
-    CommandLineArgs&    args)
-{
-    // Initialize matrix in COO form
-    CooMatrix<ValueT, OffsetT> coo_matrix;
+    static Field Text(const char *key, const std::string &value)
+    {
+        Field field = { key, value, true };
+        return field;
+    }
 
-    if (!mtx_filename.empty())
+    static Field Number(const char *key, double value, const char *format = "%.6g", bool available = true)
     {
-        // Parse matrix market file
-        coo_matrix.InitMarket(mtx_filename, 1.0, !g_quiet);
+        char buffer[64] = "";
+        if (available)
+            snprintf(buffer, sizeof(buffer), format, value);
+        Field field = { key, buffer, false };
+        return field;
+    }
 
-        if ((coo_matrix.num_rows == 1) || (coo_matrix.num_cols == 1) || (coo_matrix.num_nonzeros == 1))
+    static Field Flag(const char *key, bool value, bool available = true)
+    {
+        Field field = { key, available ? (value ? "true" : "false") : "", false };
+        return field;
+    }
+
+    /// Schema of every record (values left empty)
+    static std::vector<Field> Schema()
+    {
+        MatrixResults results;
+        MatrixResults::Record record;
+        return Fields("", "", "", results, &record);
+    }
+
+    /**
+     * Fields of one record, in schema order.  Pass record == NULL for a matrix
+     * that was not run.
+     */
+    static std::vector<Field> Fields(
+        const std::string&              matrix,
+        const std::string&              status,
+        const std::string&              reason,
+        const MatrixResults&            results,
+        const MatrixResults::Record*    record)
+    {
+        bool                has_stats   = (results.value_bytes > 0);
+        bool                has_trial   = record && (record->trial.avg_ms > 0);
+        bool                has_samples = has_trial && (record->trial.stats.num_samples > 0);
+        bool                has_cold    = has_trial && (record->trial.cold_avg_ms > 0);
+        bool                has_energy  = has_trial && (record->trial.package_joules >= 0);
+        const GraphStats&   g           = results.stats;
+        const SpmvTrial*    t           = record ? &record->trial : NULL;
+        const TimingStats*  ts          = t ? &t->stats : NULL;
+
+        double gflops = 0, bandwidth = 0;
+        if (has_trial)
         {
-            if (!g_quiet) printf("Trivial dataset\n");
-            exit(0);
+            size_t total_bytes = (size_t(g.num_nonzeros) * (results.value_bytes * 2 + results.offset_bytes)) +
+                size_t(g.num_rows) * (results.offset_bytes + results.value_bytes);
+            gflops      = 2 * double(g.num_nonzeros) / t->avg_ms / 1.0e6;
+            bandwidth   = double(total_bytes) / t->avg_ms / 1.0e6;
         }
-        printf("%s, ", mtx_filename.c_str()); fflush(stdout);
+
+        std::vector<Field> fields;
+        fields.push_back(Text("matrix", matrix));
+        fields.push_back(Text("status", status));
+        fields.push_back(Text("reason", reason));
+        fields.push_back(Text("value_type", has_stats ? ((results.value_bytes == 4) ? "fp32" : "fp64") : ""));
+        fields.push_back(Number("num_rows", g.num_rows, "%.0f", has_stats));
+        fields.push_back(Number("num_cols", g.num_cols, "%.0f", has_stats));
+        fields.push_back(Number("num_nonzeros", g.num_nonzeros, "%.0f", has_stats));
+        fields.push_back(Number("row_length_mean", g.row_length_mean, "%.5f", has_stats));
+        fields.push_back(Number("row_length_max", g.row_length_max, "%.0f", has_stats));
+        fields.push_back(Number("row_length_std_dev", g.row_length_std_dev, "%.5f", has_stats));
+        fields.push_back(Number("row_length_variation", g.row_length_variation, "%.5f", has_stats));
+        fields.push_back(Number("row_length_skewness", g.row_length_skewness, "%.5f", has_stats));
+        fields.push_back(Number("pearson_r", g.pearson_r, "%.5f", has_stats));
+        fields.push_back(Number("diag_distance_mean", g.diag_distance_mean, "%.5f", has_stats));
+        fields.push_back(Number("diag_distance_max", g.diag_distance_max, "%.5f", has_stats));
+        fields.push_back(Number("x_line_reuse", g.x_line_reuse, "%.5f", has_stats));
+        fields.push_back(Text("reorder", results.reorder));
+        fields.push_back(Number("reorder_ms", results.reorder_ms, "%.3f", !results.reorder.empty()));
+        fields.push_back(Number("partitions", results.partitions, "%.0f", results.partitions > 0));
+        fields.push_back(Number("partition_ms", results.partition_ms, "%.3f", results.partitions > 0));
+        fields.push_back(Number("remote_x_before", results.remote_x_before, "%.5f", results.partitions > 0));
+        fields.push_back(Number("remote_x_after", results.remote_x_after, "%.5f", results.partitions > 0));
+        fields.push_back(Text("method", record ? record->method : ""));
+        fields.push_back(Number("threads", record ? record->threads : 0, "%.0f", record != NULL));
+        fields.push_back(Text("affinity", record ? record->affinity : ""));
+        fields.push_back(Number("timing_iterations", results.timing_iterations, "%.0f", has_stats));
+        fields.push_back(Flag("correct", has_trial && t->correct, has_trial));
+        fields.push_back(Number("setup_ms", t ? t->setup_ms : 0, "%.5f", has_trial));
+        fields.push_back(Number("setup_min_ms", t ? t->setup_min_ms : 0, "%.5f", has_trial));
+        fields.push_back(Number("setup_max_ms", t ? t->setup_max_ms : 0, "%.5f", has_trial));
+        fields.push_back(Number("avg_ms", t ? t->avg_ms : 0, "%.5f", has_trial));
+        fields.push_back(Number("expected_calls", results.expected_calls, "%.0f", has_trial));
+        fields.push_back(Number("total_ms", t ? t->setup_ms + double(results.expected_calls) * t->avg_ms : 0, "%.5f", has_trial));
+        fields.push_back(Number("gflops", gflops, "%.6f", has_trial));
+        fields.push_back(Number("effective_GBs", bandwidth, "%.3f", has_trial));
+        fields.push_back(Number("modeled_MB", results.modeled_bytes / (1 << 20), "%.3f", has_stats && (results.modeled_bytes > 0)));
+        fields.push_back(Number("modeled_GBs", has_trial ? results.modeled_bytes / t->avg_ms / 1.0e6 : 0, "%.3f", has_trial && (results.modeled_bytes > 0)));
+        fields.push_back(Number("samples", ts ? ts->num_samples : 0, "%.0f", has_samples));
+        fields.push_back(Number("min_ms", ts ? ts->min_ms : 0, "%.5f", has_samples));
+        fields.push_back(Number("median_ms", ts ? ts->median_ms : 0, "%.5f", has_samples));
+        fields.push_back(Number("p90_ms", ts ? ts->p90_ms : 0, "%.5f", has_samples));
+        fields.push_back(Number("p99_ms", ts ? ts->p99_ms : 0, "%.5f", has_samples));
+        fields.push_back(Number("max_ms", ts ? ts->max_ms : 0, "%.5f", has_samples));
+        fields.push_back(Number("std_dev_ms", ts ? ts->std_dev_ms : 0, "%.5f", has_samples));
+        fields.push_back(Number("cv", ts ? ts->variation : 0, "%.5f", has_samples));
+        fields.push_back(Number("cold_avg_ms", t ? t->cold_avg_ms : 0, "%.5f", has_cold));
+        double spmv_mj = has_energy ? SpmvMillijoules(*t, results.timing_iterations) : 0;
+        fields.push_back(Number("package_mj", has_energy ? t->package_joules * 1000.0 / results.timing_iterations : 0, "%.6f", has_energy));
+        fields.push_back(Number("dram_mj", has_energy ? t->dram_joules * 1000.0 / results.timing_iterations : 0, "%.6f", has_energy && (t->dram_joules >= 0)));
+        fields.push_back(Number("gflops_per_w", (spmv_mj > 0) ? 2 * double(g.num_nonzeros) / spmv_mj / 1.0e6 : 0, "%.4f", spmv_mj > 0));
+        return fields;
     }
-    else if (grid2d > 0)
+
+    static std::string JsonEscape(const std::string &value)
     {
-        // Generate 2D lattice
-        printf("grid2d_%d, ", grid2d); fflush(stdout);
-        coo_matrix.InitGrid2d(grid2d, false);
+        std::string escaped;
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            char c = value[i];
+            if ((c == '"') || (c == '\\'))      { escaped += '\\'; escaped += c; }
+            else if (c == '\n')                 { escaped += "\\n"; }
+            else if ((unsigned char) c < 0x20)  { escaped += ' '; }
+            else                                { escaped += c; }
+        }
+        return escaped;
     }
-    else if (grid3d > 0)
+
+    static std::string CsvEscape(const std::string &value)
     {
-        // Generate 3D lattice
-        printf("grid3d_%d, ", grid3d); fflush(stdout);
-        coo_matrix.InitGrid3d(grid3d, false);
+        if (value.find_first_of(",\"\n") == std::string::npos)
+            return value;
+        std::string escaped = "\"";
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            if (value[i] == '"') escaped += '"';
+            escaped += value[i];
+        }
+        return escaped + "\"";
     }
-    else if (wheel > 0)
+
+    /// The matrix name of a previously written line
+    std::string MatrixOf(const std::string &line) const
     {
-        // Generate wheel graph
-        printf("wheel_%d, ", grid2d); fflush(stdout);
-        coo_matrix.InitWheel(wheel);
+        if (!jsonl)
+        {
+            if (!line.empty() && (line[0] == '"'))
+                return line.substr(1, line.find('"', 1) - 1);
+            return line.substr(0, line.find(','));
+        }
+        size_t start = line.find("\"matrix\": \"");
+        if (start == std::string::npos)
+            return "";
+        start += 11;
+        return line.substr(start, line.find('"', start) - start);
     }
-    else if (dense > 0)
+
+    void Open(const std::string &filename)
     {
-        // Generate dense graph
-        OffsetT rows = (1<<24) / dense;               // 16M nnz
-        printf("dense_%d_x_%d, ", rows, dense); fflush(stdout);
-        coo_matrix.InitDense(rows, dense);
+        this->filename          = filename;
+        this->pending_filename  = filename + ".pending";
+        this->jsonl             = (filename.find(".json") != std::string::npos);
+        this->compiler          = CompilerDescription();
+        this->cpu_model         = CpuModelName();
+        this->host              = HostName();
+
+        // Matrices already recorded
+        std::ifstream existing(filename.c_str());
+        std::string line;
+        bool has_header = jsonl;
+        bool empty = true;
+        while (std::getline(existing, line))
+        {
+            if (empty && !jsonl) { empty = false; continue; }      // CSV header
+            empty = false;
+            done.insert(MatrixOf(line));
+        }
+        existing.close();
+
+        file = fopen(filename.c_str(), "a");
+        if (!file)
+        {
+            fprintf(stderr, "Could not open results file '%s'\n", filename.c_str());
+            exit(1);
+        }
+        if (!has_header && empty)
+        {
+            std::vector<Field> schema = Schema();
+            for (int f = 0; f < int(schema.size()); ++f)
+                fprintf(file, "%s, ", schema[f].key);
+            fprintf(file, "compiler, cpu_model, host\n");
+            fflush(file);
+        }
     }
-    else
+
+    /// Record a matrix left pending by a previous batch run as failed
+    void RecoverPending()
     {
-        fprintf(stderr, "No graph type specified.\n");
-        exit(1);
+        std::ifstream pending(pending_filename.c_str());
+        std::string name;
+        if (std::getline(pending, name) && !name.empty() && !Done(name))
+        {
+            WriteSkipped(name, "failed", "previous run ended while processing this matrix");
+            fprintf(stderr, "Recorded %s as failed (left pending by a previous run)\n", name.c_str());
+        }
+        pending.close();
+        remove(pending_filename.c_str());
     }
 
-    CsrMatrix<ValueT, OffsetT> csr_matrix(coo_matrix);
-    coo_matrix.Clear();
+    bool Done(const std::string &name) const
+    {
+        return done.count(name) > 0;
+    }
 
-    // Display matrix info
-    csr_matrix.Stats().Display(!g_quiet);
-    if (!g_quiet)
+    /// Mark a matrix as in progress
+    void Begin(const std::string &name)
     {
-        printf("\n");
-        csr_matrix.DisplayHistogram();
-        printf("\n");
-        if (g_verbose2)
-            csr_matrix.Display();
-        printf("\n");
+        FILE *pending = fopen(pending_filename.c_str(), "w");
+        if (pending)
+        {
+            fprintf(pending, "%s\n", name.c_str());
+            fclose(pending);
+        }
     }
-    fflush(stdout);
 
-    // Determine # of timing iterations (aim to run 16 billion nonzeros through, total)
-    if (timing_iterations == -1)
+    /// Format one record
+    std::string Format(std::vector<Field> fields) const
     {
-        timing_iterations = std::min(200000ull, std::max(100ull, ((16ull << 30) / csr_matrix.num_nonzeros)));
-        if (!g_quiet)
-            printf("\t%d timing iterations\n", timing_iterations);
+        fields.push_back(Text("compiler", compiler));
+        fields.push_back(Text("cpu_model", cpu_model));
+        fields.push_back(Text("host", host));
+
+        std::string line = jsonl ? "{" : "";
+        for (int f = 0; f < int(fields.size()); ++f)
+        {
+            if (jsonl)
+            {
+                line += std::string((f > 0) ? ", " : "") + "\"" + fields[f].key + "\": ";
+                if (fields[f].value.empty() && !fields[f].quoted)
+                    line += "null";
+                else if (fields[f].quoted)
+                    line += "\"" + JsonEscape(fields[f].value) + "\"";
+                else
+                    line += fields[f].value;
+            }
+            else
+            {
+                line += std::string((f > 0) ? ", " : "") + CsvEscape(fields[f].value);
+            }
+        }
+        return line + (jsonl ? "}\n" : "\n");
     }
 
-    // Allocate input and output vectors (if available, use NUMA allocation to force storage on the 
-    // sockets for performance consistency)
-    ValueT *vector_x, *reference_vector_y_out, *vector_y_out;
-    if (csr_matrix.IsNumaMalloc())
+    /// Record a matrix that was not run
+    void WriteSkipped(const std::string &name, const char *status, const std::string &reason)
     {
-        vector_x                = (ValueT*) numa_alloc_onnode(sizeof(ValueT) * csr_matrix.num_cols, 0);
-        reference_vector_y_out  = (ValueT*) numa_alloc_onnode(sizeof(ValueT) * csr_matrix.num_rows, 0);
-        vector_y_out            = (ValueT*) numa_alloc_onnode(sizeof(ValueT) * csr_matrix.num_rows, 0);
+        MatrixResults results;
+        fputs(Format(Fields(name, status, reason, results, NULL)).c_str(), file);
+        fflush(file);
+        done.insert(name);
     }
-    else
+
+    /// Record every (method, thread count) of a matrix
+    void Write(const std::string &name, const MatrixResults &results)
     {
-        vector_x                = (ValueT*) mkl_malloc(sizeof(ValueT) * csr_matrix.num_cols, 4096);
-        reference_vector_y_out  = (ValueT*) mkl_malloc(sizeof(ValueT) * csr_matrix.num_rows, 4096);
-        vector_y_out            = (ValueT*) mkl_malloc(sizeof(ValueT) * csr_matrix.num_rows, 4096);
+        if (!results.skip_reason.empty())
+        {
+            WriteSkipped(name, results.status.c_str(), results.skip_reason);
+        }
+        else
+        {
+            for (int r = 0; r < int(results.records.size()); ++r)
+            {
+                const MatrixResults::Record &record = results.records[r];
+                if (record.trial.unsupported)
+                    fputs(Format(Fields(name, "skipped", record.trial.unsupported, results, &record)).c_str(), file);
+                else if (record.trial.avg_ms < 0)
+                    fputs(Format(Fields(name, "timeout", "time limit reached before this method", results, &record)).c_str(), file);
+                else if (!record.trial.correct)
+                    fputs(Format(Fields(name, "fail", "result does not match reference", results, &record)).c_str(), file);
+                else
+                    fputs(Format(Fields(name, "ok", "", results, &record)).c_str(), file);
+            }
+            fflush(file);
+            done.insert(name);
+        }
+        remove(pending_filename.c_str());
     }
+};
 
-    for (int col = 0; col < csr_matrix.num_cols; ++col)
-        vector_x[col] = csr_matrix.num_cols - col + 2.0;
 
-    // Compute reference answer
-    SpmvGold(csr_matrix.num_rows, csr_matrix.row_offsets, csr_matrix.column_indices, csr_matrix.values, vector_x, reference_vector_y_out);
-
-    float avg_ms[3], setup_ms;
-
-    // MKL SpMV
-    if (!g_quiet) printf("\n\n");
-    printf("MKL CsrMV, "); fflush(stdout);
-    avg_ms[0] = TestMklCsrmv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    avg_ms[1] = TestMklCsrmv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    avg_ms[2] = TestMklCsrmv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    DisplayPerf(setup_ms, min(avg_ms[0], min(avg_ms[1], avg_ms[2])), csr_matrix);
-
-    // Merge SpMV
-    if (!g_quiet) printf("\n\n");
-    printf("Merge CsrMV, "); fflush(stdout);
-    avg_ms[0] = TestOmpMergeCsrmv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    avg_ms[1] = TestOmpMergeCsrmv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    avg_ms[2] = TestOmpMergeCsrmv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    DisplayPerf(setup_ms, min(avg_ms[0], min(avg_ms[1], avg_ms[2])), csr_matrix);
-
-    // Merge CSRLenGoto SpMV
-    if (!g_quiet) printf("\n\n");
-    printf("Merge CsrLenGotoMV, "); fflush(stdout);
-    avg_ms[0] = TestOmpMergeCsrLenGotomv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    avg_ms[1] = TestOmpMergeCsrLenGotomv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    avg_ms[2] = TestOmpMergeCsrLenGotomv(csr_matrix, vector_x, reference_vector_y_out, vector_y_out, timing_iterations, setup_ms);
-    DisplayPerf(setup_ms, min(avg_ms[0], min(avg_ms[1], avg_ms[2])), csr_matrix);
+//---------------------------------------------------------------------
+// Batch mode
+//---------------------------------------------------------------------
 
-    // Cleanup
-    if (csr_matrix.IsNumaMalloc())
+/// Watchdog state (the SIGALRM handler may only use async-signal-safe calls)
+static int  g_watchdog_fd = -1;
+static char g_watchdog_line[1024];
+static char g_watchdog_pending[1024];
+
+extern "C" void BatchWatchdog(int)
+{
+    if (g_watchdog_fd >= 0)
+        if (write(g_watchdog_fd, g_watchdog_line, strlen(g_watchdog_line)) < 0) {}
+    unlink(g_watchdog_pending);
+    _exit(2);
+}
+
+
+/**
+ * Run every matrix of a list (lines of "Group/Name", as in matrixNames_*.txt,
+ * resolved to <mtx_dir>/Group/Name/Name.mtx; lines ending in ".mtx" are used
+ * as paths) in this process, streaming results to results_filename (see
+ * ResultsFile).
+ *
+ * With a time limit, methods not started within timeout_s seconds of the
+ * matrix's start are recorded as timeouts; a watchdog at twice the limit
+ * records the matrix as a timeout and ends the process, to be resumed by
+ * running the same command again.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void RunBatch(
+    const std::string&  list_filename,
+    const std::string&  mtx_dir,
+    const std::string&  results_filename,
+    double              timeout_s,
+    int                 timing_iterations,
+    CommandLineArgs&    args)
+{
+    std::ifstream list(list_filename.c_str());
+    if (!list.good())
     {
-        if (vector_x)                   numa_free(vector_x, sizeof(ValueT) * csr_matrix.num_cols);
-        if (reference_vector_y_out)     numa_free(reference_vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
-        if (vector_y_out)               numa_free(vector_y_out, sizeof(ValueT) * csr_matrix.num_rows);
+        fprintf(stderr, "Could not open matrix list '%s'\n", list_filename.c_str());
+        exit(1);
     }
-    else
+
+    ResultsFile results_file;
+    results_file.Open(results_filename);
+    results_file.RecoverPending();
+
+    std::vector<std::string> names;
+    std::string line;
+    while (std::getline(list, line))
+    {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && (line[0] != '#'))
+            names.push_back(line);
+    }
+
+    int num_run = 0, num_resumed = 0;
+    for (int i = 0; i < int(names.size()); ++i)
     {
-        if (vector_x)                   mkl_free(vector_x);
-        if (reference_vector_y_out)     mkl_free(reference_vector_y_out);
-        if (vector_y_out)               mkl_free(vector_y_out);
+        const std::string &name = names[i];
+        if (results_file.Done(name))
+        {
+            num_resumed++;
+            continue;
+        }
+
+        // Generated matrices are listed as "gen:<spec>" (see RandomMatrixParams)
+        RandomMatrixParams  params;
+        RandomMatrixParams* random_matrix = NULL;
+        std::string         path = name;
+        if (name.compare(0, 4, "gen:") == 0)
+        {
+            if (!params.Parse(name.substr(4)))
+            {
+                results_file.WriteSkipped(name, "failed", "malformed generator spec");
+                continue;
+            }
+            random_matrix = &params;
+        }
+        else if ((name.size() < 4) || (name.compare(name.size() - 4, 4, ".mtx") != 0))
+        {
+            path = mtx_dir + "/" + name + "/" + name.substr(name.rfind('/') + 1) + ".mtx";
+        }
+
+        if (!random_matrix && !std::ifstream(path.c_str()).good())
+        {
+            results_file.WriteSkipped(name, "failed", "file not found: " + path);
+            continue;
+        }
+
+        if (!g_quiet)
+            printf("\n\n[%d/%d] %s\n", i + 1, int(names.size()), name.c_str());
+        fflush(stdout);
+
+        results_file.Begin(name);
+        if (timeout_s > 0)
+        {
+            unsigned int watchdog_s = (unsigned int) ceil(2 * timeout_s);
+            std::ostringstream reason;
+            reason << "exceeded " << watchdog_s << " s watchdog";
+            snprintf(g_watchdog_line, sizeof(g_watchdog_line), "%s",
+                results_file.Format(ResultsFile::Fields(name, "timeout", reason.str(), MatrixResults(), NULL)).c_str());
+            snprintf(g_watchdog_pending, sizeof(g_watchdog_pending), "%s", results_file.pending_filename.c_str());
+            g_watchdog_fd = fileno(results_file.file);
+            signal(SIGALRM, BatchWatchdog);
+            alarm(watchdog_s);
+            g_deadline = WallClockSeconds() + timeout_s;
+        }
+
+        MatrixResults results;
+        RunTests<ValueT, OffsetT>(random_matrix ? "" : path, -1, -1, -1, -1, -1, random_matrix, timing_iterations, args, &results);
+        printf("\n");
+
+        if (timeout_s > 0)
+        {
+            alarm(0);
+            g_deadline = 0;
+        }
+
+        results_file.Write(name, results);
+        num_run++;
     }
 
+    if (!g_quiet)
+        printf("\nBatch: %d matrices run, %d already in %s\n", num_run, num_resumed, results_filename.c_str());
 }
 
 
@@ -1002,8 +2830,26 @@ int main(int argc, char **argv)
             "[--threads=<OMP threads>] "
             "[--i=<timing iterations>] "
             "[--fp64 (default) | --fp32] "
+            "[--replicate-x] "
+            "[--methods=<method>,...] "
+            "[--stats [--max-cv=<noise threshold>]] "
+            "[--cold[=clflush] [--cold-i=<iterations>] [--cold-bytes=<flush buffer bytes>]] "
+            "[--counters] "
+            "[--cache-sim[=<KB>]] "
+            "[--reorder=rcm|degree|gorder] "
+            "[--partition[=<parts>]] "
+            "[--energy] "
+            "[--roofline] "
+            "[--sweep-threads[=<threads>|max,...]] "
+            "[--output=<results .csv|.jsonl>] "
+            "[--autotune[=model] [--tune-cache=<file>] [--tune-i=<trial iterations>] [--retune]] "
+            "[--expected-calls=<SpMV calls to amortize setup over>] "
+            "[--layout=ends,base1] "
+            "[--updates=<batch size> [--update-batches=<batches>] [--merge-fraction=<fraction of nonzeros>]] "
             "\n\t"
                 "--mtx=<matrix market file> "
+            "\n\t"
+                "--list=<matrix names file> [--mtx-dir=<dir>] [--results=<csv file>] [--timeout=<seconds per matrix>]"
             "\n\t"
                 "--dense=<cols>"
             "\n\t"
@@ -1012,7 +2858,12 @@ int main(int argc, char **argv)
                 "--grid3d=<width>"
             "\n\t"
                 "--wheel=<spokes>"
+            "\n\t"
+                "--rmat=<scale> [--edge-factor=<edges per row>] [--rmat-abc=<a>,<b>,<c>] [--seed=<seed>] [--no-permute]"
+            "\n\t"
+                "--gen=<uniform|geometric|zipf>[,rows=<n>][,cols=<n>][,mean=<row length>][,alpha=<zipf exponent>][,band=<fraction of cols>][,empty=<fraction of rows>][,seed=<n>]"
             "\n", argv[0]);
+        DisplaySpmvMethods();
         exit(0);
     }
 
@@ -1022,27 +2873,172 @@ int main(int argc, char **argv)
     int                 grid3d              = -1;
     int                 wheel               = -1;
     int                 dense               = -1;
+    int                 rmat                = -1;
+    std::string         gen_spec;
     int                 timing_iterations   = -1;
 
     g_verbose = args.CheckCmdLineFlag("v");
     g_verbose2 = args.CheckCmdLineFlag("v2");
     g_quiet = args.CheckCmdLineFlag("quiet");
     fp32 = args.CheckCmdLineFlag("fp32");
+    g_replicate_x = args.CheckCmdLineFlag("replicate-x");
+    g_timing_stats = args.CheckCmdLineFlag("stats");
+    args.GetCmdLineArgument("max-cv", g_max_variation);
+    g_perf_counters = args.CheckCmdLineFlag("counters");
+    g_roofline = args.CheckCmdLineFlag("roofline");
+    if (args.CheckCmdLineFlag("cache-sim"))
+    {
+        int cache_sim_kb = 0;
+        args.GetCmdLineArgument("cache-sim", cache_sim_kb);
+        g_cache_sim = true;
+        g_cache_sim_bytes = size_t(std::max(cache_sim_kb, 0)) << 10;
+    }
+    std::string reorder;
+    args.GetCmdLineArgument("reorder", reorder);
+    if (!reorder.empty() && !IsOrderingName(reorder))
+    {
+        fprintf(stderr, "Unknown reordering '%s' (expected rcm, degree, or gorder)\n", reorder.c_str());
+        exit(1);
+    }
+    g_energy = args.CheckCmdLineFlag("energy");
+    if (g_energy && !g_rapl.Open())
+    {
+        fprintf(stderr, "WARNING: RAPL energy counters unavailable (no readable /sys/class/powercap/intel-rapl:*/energy_uj); energy not reported\n");
+        g_energy = false;
+    }
+    g_autotune = args.CheckCmdLineFlag("autotune");
+    args.GetCmdLineArgument("updates", g_updates);
+    args.GetCmdLineArgument("layout", g_layout);
+    if (!CsrLayoutCopy<double, int>().Parse(g_layout))
+        exit(1);
+    args.GetCmdLineArgument("update-batches", g_update_batches);
+    args.GetCmdLineArgument("merge-fraction", g_merge_fraction);
+    if (args.CheckCmdLineFlag("cold"))
+    {
+        std::string cold_mode;
+        args.GetCmdLineArgument("cold", cold_mode);
+        g_cold = true;
+        g_cold_clflush = (cold_mode == "clflush");
+        args.GetCmdLineArgument("cold-i", g_cold_iterations);
+    }
     args.GetCmdLineArgument("i", timing_iterations);
+    args.GetCmdLineArgument("expected-calls", g_expected_calls);
     args.GetCmdLineArgument("mtx", mtx_filename);
     args.GetCmdLineArgument("grid2d", grid2d);
     args.GetCmdLineArgument("grid3d", grid3d);
     args.GetCmdLineArgument("dense", dense);
+    args.GetCmdLineArgument("wheel", wheel);
+    args.GetCmdLineArgument("rmat", rmat);
+    args.GetCmdLineArgument("gen", gen_spec);
+    RandomMatrixParams random_params;
+    if (!gen_spec.empty() && !random_params.Parse(gen_spec))
+        exit(1);
     args.GetCmdLineArgument("threads", g_omp_threads);
+    if (g_omp_threads == -1)
+        g_omp_threads = omp_get_num_procs();
+    g_affinity = AffinityDescription();
+
+    // Thread counts to sweep (default: powers of two over the physical cores,
+    // all cores, then all hardware threads)
+    g_topology.Init();
+    if (args.CheckCmdLineFlag("sweep-threads"))
+    {
+        std::vector<std::string> sweep_names;
+        args.GetCmdLineArguments("sweep-threads", sweep_names);
+        for (int i = 0; i < int(sweep_names.size()); ++i)
+        {
+            if (sweep_names[i].empty())
+                continue;
+            int threads = (sweep_names[i] == "max") ? g_topology.NumCpus() : atoi(sweep_names[i].c_str());
+            if ((threads < 1) || (threads > MERGE_SPMV_MAX_THREADS))
+            {
+                fprintf(stderr, "Invalid sweep thread count '%s' (1 to %d).\n", sweep_names[i].c_str(), MERGE_SPMV_MAX_THREADS);
+                exit(1);
+            }
+            g_sweep_threads.push_back(threads);
+        }
+        if (g_sweep_threads.empty())
+        {
+            for (int threads = 1; threads < g_topology.NumCores(); threads *= 2)
+                g_sweep_threads.push_back(threads);
+            g_sweep_threads.push_back(g_topology.NumCores());
+            if (g_topology.NumCpus() > g_topology.NumCores())
+                g_sweep_threads.push_back(g_topology.NumCpus());
+        }
+        std::sort(g_sweep_threads.begin(), g_sweep_threads.end());
+        g_sweep_threads.erase(std::unique(g_sweep_threads.begin(), g_sweep_threads.end()), g_sweep_threads.end());
+    }
+
+    // Calibrate machine bandwidth once, at the configured thread count
+    if (g_roofline)
+    {
+        int llc_instances = 1;
+#ifdef CUB_NUMA
+        if (NumaMallocAvailable())
+            llc_instances = numa_num_configured_nodes();
+#endif
+        g_machine.Calibrate(g_omp_threads, llc_instances);
+        if (!g_quiet)
+            printf("Calibration: %.3lf GB/s triad, %.1f M random gathers/s (%.3lf GB/s of lines), %.1f MB last-level cache, %d threads\n",
+                g_machine.triad_gbs,
+                g_machine.gather_rate / 1.0e6,
+                g_machine.GatherGbs(),
+                double(g_machine.llc_bytes) / (1 << 20),
+                g_omp_threads);
+    }
 
     // Run test(s)
-    if (fp32)
+    std::string list_filename;
+    args.GetCmdLineArgument("list", list_filename);
+    if (!list_filename.empty())
     {
-        RunTests<float, int>(mtx_filename, grid2d, grid3d, wheel, dense, timing_iterations, args);
+        std::string mtx_dir = "./mtx";
+        std::string results_filename = "batch_results.csv";
+        double      timeout_s = 0;
+        args.GetCmdLineArgument("mtx-dir", mtx_dir);
+        args.GetCmdLineArgument("results", results_filename);
+        args.GetCmdLineArgument("timeout", timeout_s);
+
+        if (fp32)
+            RunBatch<float, int>(list_filename, mtx_dir, results_filename, timeout_s, timing_iterations, args);
+        else
+            RunBatch<double, int>(list_filename, mtx_dir, results_filename, timeout_s, timing_iterations, args);
     }
     else
     {
-        RunTests<double, int>(mtx_filename, grid2d, grid3d, wheel, dense, timing_iterations, args);
+        // Record structured results (--output) under the matrix file or generator name
+        std::string output_filename;
+        args.GetCmdLineArgument("output", output_filename);
+        MatrixResults results;
+        MatrixResults *recorded = output_filename.empty() ? NULL : &results;
+
+        if (fp32)
+            RunTests<float, int>(mtx_filename, grid2d, grid3d, wheel, dense, rmat, gen_spec.empty() ? NULL : &random_params, timing_iterations, args, recorded);
+        else
+            RunTests<double, int>(mtx_filename, grid2d, grid3d, wheel, dense, rmat, gen_spec.empty() ? NULL : &random_params, timing_iterations, args, recorded);
+
+        if (recorded)
+        {
+            std::ostringstream name;
+            if (!mtx_filename.empty())  name << mtx_filename;
+            else if (grid2d > 0)        name << "grid2d_" << grid2d;
+            else if (grid3d > 0)        name << "grid3d_" << grid3d;
+            else if (wheel > 0)         name << "wheel_" << wheel;
+            else if (rmat > 0)
+            {
+                int edge_factor = 16;
+                args.GetCmdLineArgument("edge-factor", edge_factor);
+                name << "rmat_" << rmat << "_" << edge_factor;
+            }
+            else if (!gen_spec.empty()) name << random_params.Name();
+            else                        name << "dense_" << dense;
+
+            ResultsFile output;
+            output.Open(output_filename);
+            output.Write(name.str(), results);
+            if (results.status == "failed")
+                exit(1);
+        }
     }
 
     printf("\n");
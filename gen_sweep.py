@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+Controlled scaling study over generated matrices: vary one parameter of the
+random matrix generator (`cpu_spmv --gen=...`, see RandomMatrixParams) with
+the others fixed, benchmark every point in batch mode, and tabulate GFLOP/s
+per method with the point where each method falls off.
+
+Usage:
+    ./gen_sweep.py <parameter> [--base=<spec>] [--values=<v>,...]
+                   [--results=<csv>] [--falloff=<fraction>] [-- <cpu_spmv args>]
+
+<parameter> is one of distribution, rows, mean, alpha, band, or empty.  The
+base spec (default "uniform,rows=1048576,mean=16") supplies the fixed
+parameters.  Results go to gen_sweep_<parameter>.csv by default; rerunning
+resumes the sweep (see --list batch mode).  A method falls off at the first
+point past its best whose GFLOP/s is below --falloff (default 0.5) of the best.
+
+Example:
+    ./gen_sweep.py band --base=zipf,rows=2097152,mean=8 -- --threads=16 --i=200
+"""
+
+import csv
+import os
+import subprocess
+import sys
+from collections import OrderedDict
+
+DEFAULT_VALUES = {
+    "distribution": ["uniform", "geometric", "zipf"],
+    "rows":         [str(1 << s) for s in range(14, 25, 2)],
+    "mean":         [str(1 << s) for s in range(0, 9)],
+    "alpha":        ["1.2", "1.5", "2", "3", "4"],
+    "band":         ["0.0001", "0.001", "0.01", "0.1", "1"],
+    "empty":        ["0", "0.1", "0.25", "0.5", "0.75", "0.9"],
+}
+
+
+def spec_with(base, parameter, value):
+    """The base spec with one parameter replaced"""
+    tokens = base.split(",")
+    if parameter == "distribution":
+        tokens[0] = value
+        return ",".join(tokens)
+    tokens = [t for t in tokens if not t.startswith(parameter + "=")]
+    return ",".join(tokens + ["%s=%s" % (parameter, value)])
+
+
+def run_batch(command, cwd):
+    """
+    Run a cpu_spmv batch to completion: the --timeout watchdog ends the process
+    with status 2 after recording the point that hung, so rerun the same
+    command (which skips the recorded points) until it exits otherwise
+    """
+    while True:
+        status = subprocess.call(command, stdout=subprocess.DEVNULL, cwd=cwd)
+        if status != 2:
+            return status
+        sys.stderr.write("cpu_spmv stopped by its watchdog; resuming\n")
+
+
+def main(argv):
+    if "--" in argv:
+        split = argv.index("--")
+        argv, spmv_args = argv[:split], argv[split + 1:]
+    else:
+        spmv_args = []
+
+    options = dict(a[2:].split("=", 1) for a in argv[1:] if a.startswith("--") and "=" in a)
+    positional = [a for a in argv[1:] if not a.startswith("--")]
+    if len(positional) != 1 or positional[0] not in DEFAULT_VALUES:
+        sys.stderr.write(__doc__)
+        return 1
+
+    parameter = positional[0]
+    base = options.get("base", "uniform,rows=1048576,mean=16")
+    values = options["values"].split(",") if "values" in options else DEFAULT_VALUES[parameter]
+    results = os.path.abspath(options.get("results", "gen_sweep_%s.csv" % parameter))
+    falloff = float(options.get("falloff", "0.5"))
+
+    # Batch run over the generated matrices
+    names = OrderedDict(("gen:" + spec_with(base, parameter, v), v) for v in values)
+    list_filename = results + ".list"
+    with open(list_filename, "w") as f:
+        f.write("\n".join(names) + "\n")
+    # (the cpu_spmv wrapper runs the driver from its own directory)
+    command = ["./cpu_spmv", "--list=" + list_filename, "--results=" + results, "--quiet"] + spmv_args
+    print(" ".join(command))
+    if run_batch(command, os.path.dirname(os.path.abspath(__file__))) != 0:
+        sys.stderr.write("cpu_spmv failed\n")
+        return 1
+    os.remove(list_filename)
+
+    # GFLOP/s per (value, method)
+    gflops = OrderedDict((v, {}) for v in values)
+    status = {}
+    with open(results) as f:
+        for record in csv.DictReader(f, skipinitialspace=True):
+            if record["matrix"] not in names:
+                continue
+            value = names[record["matrix"]]
+            if not record["method"]:
+                status[value] = record["status"]     # The matrix was not run
+            if record["status"] == "ok" and record["correct"] == "true" and not record["affinity"].startswith("sweep"):
+                gflops[value][record["method"]] = float(record["gflops"])
+
+    methods = sorted(set(m for row in gflops.values() for m in row))
+    print("\n%-12s %s" % (parameter, " ".join("%12s" % m for m in methods)))
+    for value in values:
+        cells = ["%12.3f" % gflops[value][m] if m in gflops[value] else "%12s" % "-" for m in methods]
+        note = "" if status.get(value, "ok") == "ok" else "  (%s)" % status[value]
+        print("%-12s %s%s" % (value, " ".join(cells), note))
+
+    print("\nFall-off (first point past the best below %.0f%% of it):" % (100 * falloff))
+    for m in methods:
+        points = [(v, gflops[v][m]) for v in values if m in gflops[v]]
+        best = max(range(len(points)), key=lambda i: points[i][1])
+        drop = next((v for v, g in points[best + 1:] if g < falloff * points[best][1]), None)
+        print("  %-12s best %.3f GFLOP/s at %s=%s; %s" % (
+            m, points[best][1], parameter, points[best][0],
+            "falls off at %s=%s" % (parameter, drop) if drop else "does not fall off"))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -612,7 +612,8 @@ void RunTests(
     if (!mtx_filename.empty())
     {
         // Parse matrix market file
-        coo_matrix.InitMarket(mtx_filename, 1.0, !g_quiet);
+        if (!coo_matrix.InitMarket(mtx_filename, 1.0, !g_quiet))
+            exit(1);
 
         if ((coo_matrix.num_rows == 1) || (coo_matrix.num_cols == 1) || (coo_matrix.num_nonzeros == 1))
         {
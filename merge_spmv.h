@@ -0,0 +1,2351 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIAeBILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * Merge-based SpMV engines (header-only)
+ *
+ * The CPU SpMV methods of the cpu_spmv driver, usable from other C++ code:
+ * merge-path partitioning, the merge-based, row-based, and CSRLenGoto kernels,
+ * and the SpmvMethod wrappers (Setup / Execute / Teardown) around them.
+ * Applications using the lengoto method also link csrlengoto.o.  The C API
+ * over these templates is in mergespmv.h.
+ ******************************************************************************/
+
+#pragma once
+
+#include <omp.h>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#ifdef CUB_MKL
+    #include <mkl.h>
+#endif
+
+#include "sparse_matrix.h"
+#include "utils.h"
+
+
+//---------------------------------------------------------------------
+// Utility types
+//---------------------------------------------------------------------
+
+/// Most threads a merge-based kernel can be run with (its carry-out storage)
+const int MERGE_SPMV_MAX_THREADS = 256;
+
+
+struct int2
+{
+    int x;
+    int y;
+};
+
+
+
+/**
+ * Counting iterator
+ */
+template <
+    typename ValueType,
+    typename OffsetT = ptrdiff_t>
+struct CountingInputIterator
+{
+    // Required iterator traits
+    typedef CountingInputIterator               self_type;              ///< My own type
+    typedef OffsetT                             difference_type;        ///< Type to express the result of subtracting one iterator from another
+    typedef ValueType                           value_type;             ///< The type of the element the iterator can point to
+    typedef ValueType*                          pointer;                ///< The type of a pointer to an element the iterator can point to
+    typedef ValueType                           reference;              ///< The type of a reference to an element the iterator can point to
+    typedef std::random_access_iterator_tag     iterator_category;      ///< The iterator category
+
+    ValueType val;
+
+    /// Constructor
+    inline CountingInputIterator(
+        const ValueType &val)          ///< Starting value for the iterator instance to report
+    :
+        val(val)
+    {}
+
+    /// Postfix increment
+    inline self_type operator++(int)
+    {
+        self_type retval = *this;
+        val++;
+        return retval;
+    }
+
+    /// Prefix increment
+    inline self_type operator++()
+    {
+        val++;
+        return *this;
+    }
+
+    /// Indirection
+    inline reference operator*() const
+    {
+        return val;
+    }
+
+    /// Addition
+    template <typename Distance>
+    inline self_type operator+(Distance n) const
+    {
+        self_type retval(val + n);
+        return retval;
+    }
+
+    /// Addition assignment
+    template <typename Distance>
+    inline self_type& operator+=(Distance n)
+    {
+        val += n;
+        return *this;
+    }
+
+    /// Subtraction
+    template <typename Distance>
+    inline self_type operator-(Distance n) const
+    {
+        self_type retval(val - n);
+        return retval;
+    }
+
+    /// Subtraction assignment
+    template <typename Distance>
+    inline self_type& operator-=(Distance n)
+    {
+        val -= n;
+        return *this;
+    }
+
+    /// Distance
+    inline difference_type operator-(self_type other) const
+    {
+        return val - other.val;
+    }
+
+    /// Array subscript
+    template <typename Distance>
+    inline reference operator[](Distance n) const
+    {
+        return val + n;
+    }
+
+    /// Structure dereference
+    inline pointer operator->()
+    {
+        return &val;
+    }
+
+    /// Equal to
+    inline bool operator==(const self_type& rhs)
+    {
+        return (val == rhs.val);
+    }
+
+    /// Not equal to
+    inline bool operator!=(const self_type& rhs)
+    {
+        return (val != rhs.val);
+    }
+
+    /// ostream operator
+    friend std::ostream& operator<<(std::ostream& os, const self_type& itr)
+    {
+        os << "[" << itr.val << "]";
+        return os;
+    }
+};
+
+
+
+//---------------------------------------------------------------------
+// MergePath Search
+//---------------------------------------------------------------------
+
+
+/**
+ * Computes the begin offsets into A and B for the specific diagonal
+ */
+template <
+    typename AIteratorT,
+    typename BIteratorT,
+    typename OffsetT,
+    typename CoordinateT>
+inline void MergePathSearch(
+    OffsetT         diagonal,           ///< [in]The diagonal to search
+    AIteratorT      a,                  ///< [in]List A
+    BIteratorT      b,                  ///< [in]List B
+    OffsetT         a_len,              ///< [in]Length of A
+    OffsetT         b_len,              ///< [in]Length of B
+    CoordinateT&    path_coordinate)    ///< [out] (x,y) coordinate where diagonal intersects the merge path
+{
+    OffsetT x_min = std::max(diagonal - b_len, 0);
+    OffsetT x_max = std::min(diagonal, a_len);
+
+    while (x_min < x_max)
+    {
+        OffsetT x_pivot = (x_min + x_max) >> 1;
+        if (a[x_pivot] <= b[diagonal - x_pivot - 1])
+            x_min = x_pivot + 1;    // Contract range up A (down B)
+        else
+            x_max = x_pivot;        // Contract range down A (up B)
+    }
+
+    path_coordinate.x = std::min(x_min, a_len);
+    path_coordinate.y = diagonal - x_min;
+}
+
+
+//---------------------------------------------------------------------
+// SpMV method interface
+//---------------------------------------------------------------------
+
+/**
+ * An SpMV method under test.  Setup() builds whatever per-matrix state the
+ * method needs (partitioning, format conversion, inspection) and is charged
+ * as setup time; Execute() computes y = Ax and is what the timing loop
+ * measures; Teardown() releases the state built by Setup().  Methods that
+ * cannot handle some matrices say why in Unsupported().
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct SpmvMethod
+{
+    const char*     name;               // Selection key for --methods
+    const char*     label;              // Display label
+    bool            default_enabled;    // Whether the method runs when --methods is not given
+
+    SpmvMethod(const char* name, const char* label, bool default_enabled = true) :
+        name(name), label(label), default_enabled(default_enabled)
+    {}
+
+    virtual ~SpmvMethod() {}
+
+    /// Why the method cannot run a matrix with these statistics, or NULL if it can
+    virtual const char* Unsupported(const GraphStats &stats)
+    {
+        return NULL;
+    }
+
+    /// Configuration chosen by Setup() (for display), or NULL if the method has only one
+    virtual const char* Variant()
+    {
+        return NULL;
+    }
+
+    /// Why the method cannot run a matrix stored this way (gaps, index base), or NULL if it can
+    virtual const char* UnsupportedLayout(const CsrView<ValueT, OffsetT> &a)
+    {
+        return NULL;
+    }
+
+    virtual void Setup(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        int                             expected_calls) = 0;
+
+    virtual void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out) = 0;
+
+    virtual void Teardown() = 0;
+
+    /// Register the arrays Setup() built for Execute() with a clflush cache flusher; false if some are opaque
+    virtual bool AddFlushRegions(CacheFlusher &flusher)
+    {
+        return true;
+    }
+};
+
+
+//---------------------------------------------------------------------
+// NUMA replication of the input vector
+//---------------------------------------------------------------------
+
+/**
+ * NUMA node of the CPU the calling thread runs on (0 without libnuma)
+ */
+inline int CurrentNumaNode()
+{
+    int node = 0;
+#ifdef CUB_NUMA
+    if (NumaMallocAvailable())
+    {
+        node = numa_node_of_cpu(sched_getcpu());
+        if ((node < 0) || (node > numa_max_node()))
+            node = 0;
+    }
+#endif
+    return node;
+}
+
+
+/**
+ * Per-node replicas of vector_x, so that random x accesses do not cross the
+ * socket interconnect.  The copy is part of each SpMV's parallel region: every
+ * thread copies its chunk of its node's replica (CopyChunk), then gathers from
+ * vector_x itself until all chunks of the replica on the node it runs on have
+ * landed (LandedReplica), and from that replica after.  Chunks are assigned by
+ * the nodes the threads ran on at Init(), but the replica read is that of the
+ * node a thread runs on at each call, so threads that migrate stay local.
+ */
+template <typename ValueT>
+struct NumaReplicatedVector
+{
+    int         num_threads;
+    int         num_nodes;          // Number of nodes hosting at least one thread
+    int         max_nodes;
+    bool        numa;               // Whether replicas are NUMA-allocated
+    size_t      num_items;
+    int*        thread_nodes;       // NUMA node of each thread
+    int*        thread_ranks;       // Rank of each thread among the threads of its node
+    int*        node_threads;       // Number of threads on each node
+    int*        node_copied;        // Number of threads of each node done copying their chunk in the current call
+    ValueT**    node_replicas;      // Replica resident on each node (NULL if node is unused)
+
+    NumaReplicatedVector() :
+        num_threads(0), num_nodes(0), max_nodes(0), numa(false), num_items(0), thread_nodes(NULL), thread_ranks(NULL),
+        node_threads(NULL), node_copied(NULL), node_replicas(NULL)
+    {}
+
+    ~NumaReplicatedVector()
+    {
+        Clear();
+    }
+
+    /**
+     * Map threads to nodes and allocate one replica per populated node
+     */
+    void Init(size_t num_items, int num_threads)
+    {
+        this->num_items     = num_items;
+        this->num_threads   = num_threads;
+        thread_nodes        = new int[num_threads];
+        thread_ranks        = new int[num_threads];
+
+        max_nodes = 1;
+        numa = NumaMallocAvailable();
+#ifdef CUB_NUMA
+        if (numa)
+            max_nodes = numa_max_node() + 1;
+#endif
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+            thread_nodes[tid] = CurrentNumaNode();
+
+        node_threads    = new int[max_nodes];
+        node_copied     = new int[max_nodes];
+        node_replicas   = new ValueT*[max_nodes];
+        for (int node = 0; node < max_nodes; ++node)
+        {
+            node_threads[node] = 0;
+            node_copied[node] = 0;
+            node_replicas[node] = NULL;
+        }
+
+        for (int tid = 0; tid < num_threads; tid++)
+            thread_ranks[tid] = node_threads[thread_nodes[tid]]++;
+
+        num_nodes = 0;
+        for (int node = 0; node < max_nodes; ++node)
+        {
+            if (node_threads[node] == 0)
+                continue;
+            num_nodes++;
+#ifdef CUB_NUMA
+            if (numa)
+            {
+                node_replicas[node] = (ValueT*) numa_alloc_onnode(sizeof(ValueT) * num_items, node);
+                continue;
+            }
+#endif
+            node_replicas[node] = new ValueT[num_items];
+        }
+    }
+
+    /**
+     * Start a call: no replica is filled yet (before the parallel region)
+     */
+    void Reset()
+    {
+        for (int node = 0; node < max_nodes; ++node)
+            node_copied[node] = 0;
+    }
+
+    /**
+     * Copy thread tid's chunk of vector_x into its node's replica.  The threads
+     * of each node fill their node's replica cooperatively, so all nodes copy
+     * concurrently and every page is first touched by a thread local to it.
+     */
+    void CopyChunk(int tid, const ValueT* __restrict vector_x)
+    {
+        int     node            = thread_nodes[tid];
+        size_t  items_per_rank  = (num_items + node_threads[node] - 1) / node_threads[node];
+        size_t  begin           = std::min(items_per_rank * thread_ranks[tid], num_items);
+        size_t  end             = std::min(begin + items_per_rank, num_items);
+
+        memcpy(node_replicas[node] + begin, vector_x + begin, sizeof(ValueT) * (end - begin));
+
+        #pragma omp flush
+        #pragma omp atomic
+        node_copied[node]++;
+    }
+
+    /**
+     * The replica on node if all of its chunks have landed, else NULL
+     */
+    ValueT* LandedReplica(int node)
+    {
+        if ((node >= max_nodes) || (node_replicas[node] == NULL))
+            return NULL;
+
+        int copied;
+        #pragma omp atomic read
+        copied = node_copied[node];
+        if (copied < node_threads[node])
+            return NULL;
+
+        #pragma omp flush
+        return node_replicas[node];
+    }
+
+    /**
+     * Copy vector_x into every replica on its own (to time the copy)
+     */
+    void Replicate(ValueT* __restrict vector_x)
+    {
+        Reset();
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+            CopyChunk(tid, vector_x);
+    }
+
+    /**
+     * Register the replicas with a clflush cache flusher
+     */
+    void AddFlushRegions(CacheFlusher &flusher)
+    {
+        for (int node = 0; node < max_nodes; ++node)
+        {
+            if (node_replicas[node])
+                flusher.AddRegion(node_replicas[node], sizeof(ValueT) * num_items);
+        }
+    }
+
+    void Clear()
+    {
+        if (node_replicas)
+        {
+            for (int tid = 0; tid < num_threads; tid++)
+            {
+                ValueT *replica = node_replicas[thread_nodes[tid]];
+                if (replica == NULL)
+                    continue;
+#ifdef CUB_NUMA
+                if (numa)
+                    numa_free(replica, sizeof(ValueT) * num_items);
+                else
+#endif
+                    delete[] replica;
+                node_replicas[thread_nodes[tid]] = NULL;
+            }
+        }
+
+        delete[] thread_nodes;      thread_nodes = NULL;
+        delete[] thread_ranks;      thread_ranks = NULL;
+        delete[] node_threads;      node_threads = NULL;
+        delete[] node_copied;       node_copied = NULL;
+        delete[] node_replicas;     node_replicas = NULL;
+    }
+};
+
+
+//---------------------------------------------------------------------
+// CPU row-based SpMV
+//---------------------------------------------------------------------
+
+/**
+ * OpenMP CPU row-based SpMV.  Each thread owns a contiguous block of whole
+ * rows (row_splits[tid] to row_splits[tid + 1]); the dot product of each row
+ * is vectorized.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void OmpCsrmv(
+    OffsetT*                            row_splits,
+    int                                 num_threads,
+    const CsrView<ValueT, OffsetT>&     a,
+    ValueT*     __restrict              vector_x,
+    ValueT*     __restrict              vector_y_out)
+{
+    // Offsets and columns are index_base-based
+    OffsetT*    __restrict  row_offsets     = a.row_offsets;
+    OffsetT*    __restrict  row_end_offsets = a.row_end_offsets;
+    OffsetT*    __restrict  column_indices  = a.column_indices - a.index_base;
+    ValueT*     __restrict  values          = a.values - a.index_base;
+    ValueT*     __restrict  x               = vector_x - a.index_base;
+
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int tid = 0; tid < num_threads; tid++)
+    {
+        OffsetT row_first   = row_splits[tid];
+        OffsetT row_last    = row_splits[tid + 1];
+
+        for (OffsetT row = row_first; row < row_last; ++row)
+        {
+            OffsetT row_begin   = row_offsets[row];
+            OffsetT row_end     = row_end_offsets[row];
+            ValueT running_total = 0.0;
+
+            if (row_end - row_begin < 16)
+            {
+                // Short rows: vector setup would cost more than it saves
+                for (OffsetT offset = row_begin; offset < row_end; ++offset)
+                {
+                    running_total += values[offset] * x[column_indices[offset]];
+                }
+            }
+            else
+            {
+                #pragma omp simd reduction(+:running_total)
+                for (OffsetT offset = row_begin; offset < row_end; ++offset)
+                {
+                    running_total += values[offset] * x[column_indices[offset]];
+                }
+            }
+
+            vector_y_out[row] = running_total;
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------
+// Merge-path load-balance profiling (-DCUB_SPMV_PROFILE)
+//---------------------------------------------------------------------
+
+#ifdef CUB_SPMV_PROFILE
+    #define CUB_SPMV_PROFILE_STMT(statement) statement
+#else
+    #define CUB_SPMV_PROFILE_STMT(statement)
+#endif
+
+/**
+ * Accumulates per-thread timestamps from the merge-based kernels over the
+ * timed iterations: each thread's busy time on its path segment and its
+ * wait at the implicit barrier, and the serial carry-out fix-up.
+ */
+struct MergeLoadProfile
+{
+    struct ThreadRecord
+    {
+        double      start;              // This call
+        double      end;
+        double      busy_s;             // Summed over calls
+        double      wait_s;
+        long long   rows;               // Rows and nonzeros of the path segment
+        long long   nonzeros;
+        char        pad[16];            // One record per cache line
+    };
+
+    int                         num_threads;
+    int                         num_calls;
+    double                      region_s;           // Parallel region plus fix-up, summed over calls
+    double                      fixup_s;
+    double                      imbalance_sum;      // Max / mean busy time of each call, summed over calls
+    std::vector<ThreadRecord>   threads;
+
+    MergeLoadProfile() : num_threads(0), num_calls(0), region_s(0), fixup_s(0), imbalance_sum(0) {}
+
+    void Reset(int num_threads)
+    {
+        this->num_threads   = num_threads;
+        num_calls           = 0;
+        region_s            = 0;
+        fixup_s             = 0;
+        imbalance_sum       = 0;
+        threads.assign(num_threads, ThreadRecord());
+    }
+
+    /// Record a thread's path segment (called from within the parallel region)
+    void RecordThread(int tid, double start, double end, long long rows, long long nonzeros)
+    {
+        if (tid >= int(threads.size()))
+            return;
+        threads[tid].start      = start;
+        threads[tid].end        = end;
+        threads[tid].rows       = rows;
+        threads[tid].nonzeros   = nonzeros;
+    }
+
+    /// Record a call after its parallel region (barrier) and fix-up
+    void RecordCall(double region_start, double barrier_end, double fixup_end)
+    {
+        if (threads.empty())
+            return;
+
+        double max_busy = 0, total_busy = 0;
+        for (int tid = 0; tid < num_threads; ++tid)
+        {
+            double busy = threads[tid].end - threads[tid].start;
+            threads[tid].busy_s += busy;
+            threads[tid].wait_s += barrier_end - threads[tid].end;
+            max_busy = std::max(max_busy, busy);
+            total_busy += busy;
+        }
+        if (total_busy > 0)
+            imbalance_sum += max_busy / (total_busy / num_threads);
+
+        region_s += fixup_end - region_start;
+        fixup_s += fixup_end - barrier_end;
+        num_calls++;
+    }
+
+    void Display(bool quiet, bool verbose) const
+    {
+        if (num_calls == 0)
+            return;
+
+        double max_busy = 0, total_busy = 0, total_wait = 0;
+        for (int tid = 0; tid < num_threads; ++tid)
+        {
+            max_busy = std::max(max_busy, threads[tid].busy_s);
+            total_busy += threads[tid].busy_s;
+            total_wait += threads[tid].wait_s;
+        }
+        double mean_busy = total_busy / num_threads;
+
+        if (!quiet)
+        {
+            printf("\tload balance: %.3f max/mean busy per call, %.3f max/mean busy overall, "
+                "%.4f ms barrier wait per thread, %.4f ms fix-up, %.4f ms region per SpMV\n",
+                imbalance_sum / num_calls,
+                (mean_busy > 0) ? max_busy / mean_busy : 0.0,
+                total_wait / num_threads / num_calls * 1000.0,
+                fixup_s / num_calls * 1000.0,
+                region_s / num_calls * 1000.0);
+            if (verbose)
+            {
+                for (int tid = 0; tid < num_threads; ++tid)
+                    printf("\t\tthread %d: %lld rows, %lld nonzeros, %.4f ms busy, %.4f ms wait per SpMV\n",
+                        tid, threads[tid].rows, threads[tid].nonzeros,
+                        threads[tid].busy_s / num_calls * 1000.0,
+                        threads[tid].wait_s / num_calls * 1000.0);
+            }
+        }
+        else
+        {
+            printf("%.4f, %.4f, %.5f, %.5f, ",
+                imbalance_sum / num_calls,
+                (mean_busy > 0) ? max_busy / mean_busy : 0.0,
+                total_wait / num_threads / num_calls * 1000.0,
+                fixup_s / num_calls * 1000.0);
+        }
+        fflush(stdout);
+    }
+};
+
+#ifdef CUB_SPMV_PROFILE
+extern MergeLoadProfile g_merge_profile;    // Filled by the merge-based kernels during the timed loop (defined by the application)
+#endif
+
+
+//---------------------------------------------------------------------
+// CPU merge-based SpMV
+//---------------------------------------------------------------------
+
+
+/**
+ * OpenMP CPU merge-based SpMV
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void OmpMergeCsrmv(
+    int2*                               thread_coords,
+    int2*                               thread_coord_ends,
+    int                                 num_threads,
+    const CsrView<ValueT, OffsetT>&     a,
+    ValueT*     __restrict              vector_x,
+    ValueT*     __restrict              vector_y_out,
+    NumaReplicatedVector<ValueT>*       x_replicas = NULL)      ///< [in] Optional per-node replicas of vector_x (filled during the call)
+{
+    // Offsets and columns are index_base-based
+    OffsetT                 num_rows        = a.num_rows;
+    OffsetT*    __restrict  row_offsets     = a.row_offsets;
+    OffsetT*    __restrict  row_end_offsets = a.row_end_offsets;
+    OffsetT*    __restrict  column_indices  = a.column_indices - a.index_base;
+    ValueT*     __restrict  values          = a.values - a.index_base;
+
+    // Temporary storage for inter-thread fix-up after load-balanced work
+    OffsetT     row_carry_out[MERGE_SPMV_MAX_THREADS];     // The last row-id each worked on by each thread when it finished its path segment
+    ValueT      value_carry_out[MERGE_SPMV_MAX_THREADS];   // The running total within each thread when it finished its path segment
+
+    CUB_SPMV_PROFILE_STMT(double region_start = WallClockSeconds();)
+
+    if (x_replicas)
+        x_replicas->Reset();
+
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int tid = 0; tid < num_threads; tid++)
+    {
+        CUB_SPMV_PROFILE_STMT(double thread_start = WallClockSeconds();)
+
+        // Gather from vector_x until the local replica has landed
+        ValueT* __restrict x = vector_x - a.index_base;
+        int node = 0;
+        if (x_replicas)
+        {
+            x_replicas->CopyChunk(tid, vector_x);
+            node = CurrentNumaNode();
+        }
+        bool local = (x_replicas == NULL);
+
+	int2 thread_coord = thread_coords[tid];
+        int2 thread_coord_end = thread_coord_ends[tid];
+        // Consume whole rows (skipping any gap before each)
+        for (; thread_coord.x < thread_coord_end.x; ++thread_coord.x)
+        {
+            if (!local)
+            {
+                ValueT* replica = x_replicas->LandedReplica(node);
+                if (replica)
+                {
+                    x = replica - a.index_base;
+                    local = true;
+                }
+            }
+
+            ValueT running_total = 0.0;
+            thread_coord.y = std::max(thread_coord.y, row_offsets[thread_coord.x]);
+            for (; thread_coord.y < row_end_offsets[thread_coord.x]; ++thread_coord.y)
+            {
+                running_total += values[thread_coord.y] * x[column_indices[thread_coord.y]];
+            }
+
+            vector_y_out[thread_coord.x] = running_total;
+        }
+
+        // Consume partial portion of thread's last row
+        ValueT running_total = 0.0;
+        if (thread_coord.x < num_rows)
+            thread_coord.y = std::max(thread_coord.y, row_offsets[thread_coord.x]);
+        for (; thread_coord.y < thread_coord_end.y; ++thread_coord.y)
+        {
+            running_total += values[thread_coord.y] * x[column_indices[thread_coord.y]];
+        }
+
+        // Save carry-outs
+        row_carry_out[tid] = thread_coord_end.x;
+        value_carry_out[tid] = running_total;
+
+        CUB_SPMV_PROFILE_STMT(g_merge_profile.RecordThread(tid, thread_start, WallClockSeconds(),
+            thread_coord_end.x - thread_coords[tid].x, thread_coord_end.y - thread_coords[tid].y);)
+    }
+
+    CUB_SPMV_PROFILE_STMT(double barrier_end = WallClockSeconds();)
+
+    // Carry-out fix-up (rows spanning multiple threads)
+    for (int tid = 0; tid < num_threads - 1; ++tid)
+    {
+        if (row_carry_out[tid] < num_rows)
+            vector_y_out[row_carry_out[tid]] += value_carry_out[tid];
+    }
+
+    CUB_SPMV_PROFILE_STMT(g_merge_profile.RecordCall(region_start, barrier_end, WallClockSeconds());)
+}
+
+
+/**
+ * Splits the merge path of the row ends and the nonzero indices evenly among
+ * the threads.  Coordinates are (row, nonzero offset), with offsets as stored
+ * (index_base-based), so a gap before a row is part of the path.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void OmpMergePartitionMatrix(
+    int2*                               thread_coords,
+    int2*                               thread_coord_ends,
+    int                                 num_threads,
+    const CsrView<ValueT, OffsetT>&     a)
+{
+    OffsetT     num_rows        = a.num_rows;
+    OffsetT     num_nonzeros    = a.PathNonzeros();
+    OffsetT     first_nonzero   = (num_rows > 0) ? a.row_offsets[0] : 0;
+
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int tid = 0; tid < num_threads; tid++)
+    {
+        // Merge list B (NZ indices)
+        CountingInputIterator<OffsetT>  nonzero_indices(first_nonzero);
+
+        OffsetT num_merge_items     = num_rows + num_nonzeros;                          // Merge path total length
+        OffsetT items_per_thread    = (num_merge_items + num_threads - 1) / num_threads;    // Merge items per thread
+
+        // Find starting and ending MergePath coordinates (row-idx, nonzero-idx) for each thread
+        int     start_diagonal      = std::min(items_per_thread * tid, num_merge_items);
+        int     end_diagonal        = std::min(start_diagonal + items_per_thread, num_merge_items);
+
+        MergePathSearch(start_diagonal, a.row_end_offsets, nonzero_indices, num_rows, num_nonzeros, thread_coords[tid]);
+        MergePathSearch(end_diagonal, a.row_end_offsets, nonzero_indices, num_rows, num_nonzeros, thread_coord_ends[tid]);
+        thread_coords[tid].y        += first_nonzero;
+        thread_coord_ends[tid].y    += first_nonzero;
+    }
+}
+    
+
+
+/**
+ * Merge-based CsrMV method.  Setup computes the merge-path partitioning.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct OmpMergeCsrmvMethod : SpmvMethod<ValueT, OffsetT>
+{
+    bool                            replicate_x;        // Whether to gather from per-node replicas of vector_x
+    CsrView<ValueT, OffsetT>        a;
+    int                             num_threads;
+    int2*                           thread_coords;
+    int2*                           thread_coord_ends;
+    NumaReplicatedVector<ValueT>*   x_replicas;
+
+    OmpMergeCsrmvMethod(bool replicate_x = false) :
+        SpmvMethod<ValueT, OffsetT>(
+            replicate_x ? "merge-rx" : "merge",
+            replicate_x ? "Merge CsrMV (replicated x)" : "Merge CsrMV",
+            !replicate_x),
+        replicate_x(replicate_x), num_threads(0),
+        thread_coords(NULL), thread_coord_ends(NULL), x_replicas(NULL)
+    {}
+
+    void Setup(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        int                             expected_calls)
+    {
+        this->a             = a;
+        this->num_threads   = num_threads;
+        thread_coords       = new int2[num_threads];
+        thread_coord_ends   = new int2[num_threads];
+
+        OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads, a);
+
+        if (replicate_x)
+        {
+            x_replicas = new NumaReplicatedVector<ValueT>();
+            x_replicas->Init(a.num_cols, num_threads);
+        }
+    }
+
+    void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        OmpMergeCsrmv(thread_coords, thread_coord_ends, num_threads, a,
+                      vector_x, vector_y_out, x_replicas);
+    }
+
+    void Teardown()
+    {
+        delete[] thread_coords;         thread_coords = NULL;
+        delete[] thread_coord_ends;     thread_coord_ends = NULL;
+        delete x_replicas;              x_replicas = NULL;
+    }
+
+    bool AddFlushRegions(CacheFlusher &flusher)
+    {
+        flusher.AddRegion(thread_coords, sizeof(int2) * num_threads);
+        flusher.AddRegion(thread_coord_ends, sizeof(int2) * num_threads);
+        if (x_replicas)
+            x_replicas->AddFlushRegions(flusher);
+        return true;
+    }
+};
+
+
+/**
+ * Native row-based CsrMV method (the default baseline).  Setup splits the rows
+ * into blocks of roughly equal rows + nonzeros at the merge-path diagonals,
+ * rounded to whole rows.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct OmpCsrmvMethod : SpmvMethod<ValueT, OffsetT>
+{
+    CsrView<ValueT, OffsetT>        a;
+    int                             num_threads;
+    OffsetT*                        row_splits;
+
+    OmpCsrmvMethod() :
+        SpmvMethod<ValueT, OffsetT>("csr", "Native CsrMV"),
+        num_threads(0), row_splits(NULL)
+    {}
+
+    void Setup(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        int                             expected_calls)
+    {
+        this->a             = a;
+        this->num_threads   = num_threads;
+        row_splits          = new OffsetT[num_threads + 1];
+
+        int2 *thread_coords     = new int2[num_threads];
+        int2 *thread_coord_ends = new int2[num_threads];
+
+        OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads, a);
+
+        for (int tid = 0; tid < num_threads; tid++)
+            row_splits[tid] = thread_coords[tid].x;
+        row_splits[num_threads] = a.num_rows;
+
+        delete[] thread_coords;
+        delete[] thread_coord_ends;
+    }
+
+    void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        OmpCsrmv(row_splits, num_threads, a, vector_x, vector_y_out);
+    }
+
+    void Teardown()
+    {
+        delete[] row_splits;    row_splits = NULL;
+    }
+
+    bool AddFlushRegions(CacheFlusher &flusher)
+    {
+        flusher.AddRegion(row_splits, sizeof(OffsetT) * (num_threads + 1));
+        return true;
+    }
+};
+
+
+//---------------------------------------------------------------------
+// CPU merge-based CSRLenGoto SpMV
+//---------------------------------------------------------------------
+
+/// The generated csrlengoto.s handles rows shorter than this (BODY_25 in csrlengoto-body-gen.s)
+const int CSRLENGOTO_BODY_ROWS = 25;
+
+/**
+ * OpenMP CPU merge-based SpMV
+ */
+void csrLenGotoKernel(
+    int*     __restrict row_offsets,
+    int*     __restrict column_indices,
+    double*  __restrict values,
+    double*  __restrict vector_x,
+    double*  __restrict vector_y_out,
+    int                 N);
+
+inline void csrLenGotoKernel(
+    int*     __restrict row_offsets,
+    int*     __restrict column_indices,
+    float*  __restrict values,
+    float*  __restrict vector_x,
+    float*  __restrict vector_y_out,
+    int                 N)
+{
+    //
+    // CAUTION: csrLenGotoKernel for float value type is not properly implemented yet.
+    //
+    for (int i = 0; i < N; ++i)
+    {
+        float running_total = 0.0;
+        for (int k = row_offsets[i]; k < row_offsets[i + 1]; ++k)
+        {
+            running_total += values[k] * vector_x[column_indices[k]];
+        }
+        vector_y_out[i] = running_total;
+    }
+}
+
+template <
+    typename ValueT,
+    typename OffsetT>
+void OmpMergeCsrLenGotomv(
+    int2*                               thread_coords,
+    int2*                               thread_coord_ends,
+    int                                 num_threads,
+    OffsetT**   __restrict              row_jump_distances,
+    const CsrView<ValueT, OffsetT>&     a,
+    ValueT*     __restrict              vector_x,
+    ValueT*     __restrict              vector_y_out,
+    NumaReplicatedVector<ValueT>*       x_replicas = NULL)      ///< [in] Optional per-node replicas of vector_x (filled during the call)
+{
+    // Rows are contiguous (see UnsupportedLayout()); offsets and columns are index_base-based
+    OffsetT                 num_rows        = a.num_rows;
+    OffsetT                 path_end        = a.row_offsets[0] + a.PathNonzeros();      // Start of the row past the last
+    OffsetT*    __restrict  row_offsets     = a.row_offsets;
+    OffsetT*    __restrict  row_end_offsets = a.row_end_offsets;
+    OffsetT*    __restrict  column_indices  = a.column_indices - a.index_base;
+    ValueT*     __restrict  values          = a.values - a.index_base;
+
+    // Temporary storage for inter-thread fix-up after load-balanced work
+    OffsetT     row_carry_out[MERGE_SPMV_MAX_THREADS];     // The last row-id each worked on by each thread when it finished its path segment
+    ValueT      value_carry_out[MERGE_SPMV_MAX_THREADS];   // The running total within each thread when it finished its path segment
+
+    CUB_SPMV_PROFILE_STMT(double region_start = WallClockSeconds();)
+
+    if (x_replicas)
+        x_replicas->Reset();
+
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int tid = 0; tid < num_threads; tid++)
+    {
+        CUB_SPMV_PROFILE_STMT(double thread_start = WallClockSeconds();)
+
+        // Gather from vector_x until the local replica has landed
+        ValueT* __restrict x = vector_x - a.index_base;
+        int node = 0;
+        if (x_replicas)
+        {
+            x_replicas->CopyChunk(tid, vector_x);
+            node = CurrentNumaNode();
+        }
+
+        int2 thread_coord = thread_coords[tid];
+        int2 thread_coord_end = thread_coord_ends[tid];
+
+        // Consume first row if partial
+        if (thread_coord.y > ((thread_coord.x < num_rows) ? row_offsets[thread_coord.x] : path_end)) {
+            ValueT running_total = 0.0;
+            for (; thread_coord.y < row_end_offsets[thread_coord.x]; ++thread_coord.y)
+            {
+                running_total += values[thread_coord.y] * x[column_indices[thread_coord.y]];
+            }
+            vector_y_out[thread_coord.x] = running_total;
+            ++thread_coord.x;
+        }
+
+        // Consume whole rows
+        ValueT* replica = (x_replicas) ? x_replicas->LandedReplica(node) : NULL;
+        if (replica)
+            x = replica - a.index_base;
+        int N =  thread_coord_end.x -  thread_coord.x;
+        int firstValueIdx = (thread_coord.x < num_rows) ? row_offsets[thread_coord.x] : path_end;
+        csrLenGotoKernel(row_jump_distances[tid], column_indices + firstValueIdx, values + firstValueIdx, x, vector_y_out + thread_coord.x, N);
+
+        // Consume partial portion of thread's last row
+        ValueT running_total = 0.0;
+        int k = (thread_coord_end.x < num_rows) ? row_offsets[thread_coord_end.x] : path_end;
+        for (; k < thread_coord_end.y; ++k)
+        {
+            running_total += values[k] * x[column_indices[k]];
+        }
+
+        // Save carry-outs
+        row_carry_out[tid] = thread_coord_end.x;
+        value_carry_out[tid] = running_total;
+
+        CUB_SPMV_PROFILE_STMT(g_merge_profile.RecordThread(tid, thread_start, WallClockSeconds(),
+            thread_coord_end.x - thread_coords[tid].x, thread_coord_end.y - thread_coords[tid].y);)
+    }
+
+    CUB_SPMV_PROFILE_STMT(double barrier_end = WallClockSeconds();)
+
+    // Carry-out fix-up (rows spanning multiple threads)
+    for (int tid = 0; tid < num_threads - 1; ++tid)
+    {
+        if (row_carry_out[tid] < num_rows)
+            vector_y_out[row_carry_out[tid]] += value_carry_out[tid];
+    }
+
+    CUB_SPMV_PROFILE_STMT(g_merge_profile.RecordCall(region_start, barrier_end, WallClockSeconds());)
+}
+
+
+/**
+ * Merge-based CsrLenGotoMV method.  Setup computes the merge-path partitioning
+ * and converts each thread's whole rows from CSR to CSRLen jump distances.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct OmpMergeCsrLenGotomvMethod : SpmvMethod<ValueT, OffsetT>
+{
+    bool                            replicate_x;        // Whether to gather from per-node replicas of vector_x
+    CsrView<ValueT, OffsetT>        a;
+    int                             num_threads;
+    int2*                           thread_coords;
+    int2*                           thread_coord_ends;
+    int**                           row_jump_distances;
+    NumaReplicatedVector<ValueT>*   x_replicas;
+
+    OmpMergeCsrLenGotomvMethod(bool replicate_x = false) :
+        SpmvMethod<ValueT, OffsetT>(
+            replicate_x ? "lengoto-rx" : "lengoto",
+            replicate_x ? "Merge CsrLenGotoMV (replicated x)" : "Merge CsrLenGotoMV",
+            !replicate_x),
+        replicate_x(replicate_x), num_threads(0),
+        thread_coords(NULL), thread_coord_ends(NULL), row_jump_distances(NULL), x_replicas(NULL)
+    {}
+
+    const char* Unsupported(const GraphStats &stats)
+    {
+        if (sizeof(ValueT) != sizeof(double))
+            return "no fp32 CSRLenGoto kernel";
+        if (stats.row_length_max >= CSRLENGOTO_BODY_ROWS)
+            return "rows exceed the CSRLenGoto body";
+        return NULL;
+    }
+
+    const char* UnsupportedLayout(const CsrView<ValueT, OffsetT> &a)
+    {
+        if (!a.Contiguous())
+            return "gaps between rows";
+        return NULL;
+    }
+
+    void Setup(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        int                             expected_calls)
+    {
+        this->a             = a;
+        this->num_threads   = num_threads;
+        thread_coords       = new int2[num_threads];
+        thread_coord_ends   = new int2[num_threads];
+
+        OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads, a);
+
+        // Conversion from CSR to CSRLen
+        row_jump_distances = new int*[num_threads];
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            int2 thread_coord = thread_coords[tid];
+            int2 thread_coord_end = thread_coord_ends[tid];
+            if ((thread_coord.x < a.num_rows) && (thread_coord.y > a.row_offsets[thread_coord.x])) {
+                ++thread_coord.x; // skip the first row because it's partial
+            }
+
+            row_jump_distances[tid] = new int[thread_coord_end.x - thread_coord.x + 1];
+            int j = 0;
+            for (int i = thread_coord.x; i < thread_coord_end.x; i++, j++) {
+                int length = a.row_end_offsets[i] - a.row_offsets[i];
+                row_jump_distances[tid][j] = -(length * 22);
+            }
+            row_jump_distances[tid][j] = 6 + 3 + 3 + 4 + 7 + 3 + 3;
+        }
+
+        if (replicate_x)
+        {
+            x_replicas = new NumaReplicatedVector<ValueT>();
+            x_replicas->Init(a.num_cols, num_threads);
+        }
+    }
+
+    void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        OmpMergeCsrLenGotomv(thread_coords, thread_coord_ends, num_threads, row_jump_distances, a,
+                             vector_x, vector_y_out, x_replicas);
+    }
+
+    void Teardown()
+    {
+        if (row_jump_distances)
+        {
+            for (int tid = 0; tid < num_threads; tid++)
+            {
+                delete[] row_jump_distances[tid];
+            }
+            delete[] row_jump_distances;
+            row_jump_distances = NULL;
+        }
+
+        delete[] thread_coords;         thread_coords = NULL;
+        delete[] thread_coord_ends;     thread_coord_ends = NULL;
+        delete x_replicas;              x_replicas = NULL;
+    }
+
+    bool AddFlushRegions(CacheFlusher &flusher)
+    {
+        flusher.AddRegion(thread_coords, sizeof(int2) * num_threads);
+        flusher.AddRegion(thread_coord_ends, sizeof(int2) * num_threads);
+        flusher.AddRegion(row_jump_distances, sizeof(int*) * num_threads);
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            // Same row range as the CSRLen conversion in Setup()
+            int2 thread_coord = thread_coords[tid];
+            if ((thread_coord.x < a.num_rows) && (thread_coord.y > a.row_offsets[thread_coord.x]))
+                ++thread_coord.x;
+            flusher.AddRegion(row_jump_distances[tid], sizeof(int) * (thread_coord_ends[tid].x - thread_coord.x + 1));
+        }
+        if (x_replicas)
+            x_replicas->AddFlushRegions(flusher);
+        return true;
+    }
+};
+
+//---------------------------------------------------------------------
+// CPU specialized merge-based SpMV
+//---------------------------------------------------------------------
+
+/**
+ * Configuration grid of the specialized merge-based kernels, as
+ * X(unroll, accumulators, prefetch): nonzeros per unrolled step, independent
+ * partial sums per row, and how many nonzeros ahead the vector_x gathers are
+ * prefetched (0 for none).  Each entry is instantiated with 16-bit and with
+ * OffsetT column indices, and the dispatch table is generated from this list.
+ */
+#define MERGE_SPEC_GRID(X) \
+    X(1, 1, 0)  X(1, 1, 16)  X(1, 1, 64) \
+    X(2, 1, 0)  X(2, 1, 16)  X(2, 1, 64) \
+    X(2, 2, 0)  X(2, 2, 16)  X(2, 2, 64) \
+    X(4, 1, 0)  X(4, 1, 16)  X(4, 1, 64) \
+    X(4, 2, 0)  X(4, 2, 16)  X(4, 2, 64) \
+    X(4, 4, 0)  X(4, 4, 16)  X(4, 4, 64) \
+    X(8, 1, 0)  X(8, 1, 16)  X(8, 1, 64) \
+    X(8, 4, 0)  X(8, 4, 16)  X(8, 4, 64)
+
+#if defined(__GNUC__)
+    #define MERGE_SPEC_PREFETCH(address) __builtin_prefetch(address)
+#else
+    #define MERGE_SPEC_PREFETCH(address)
+#endif
+
+/// Best-of calls timed per variant by the plan-time autotuner (after one warmup call)
+const int MERGE_SPEC_TUNE_CALLS = 3;
+
+/**
+ * Dot product of the nonzeros [begin, end) with vector_x
+ */
+template <
+    typename ValueT,
+    typename OffsetT,
+    typename ColumnT,
+    int UNROLL,
+    int ACCUMULATORS,
+    int PREFETCH>
+inline ValueT MergeSpecRowDot(
+    const ColumnT*  __restrict      columns,
+    const ValueT*   __restrict      values,
+    const ValueT*   __restrict      x,
+    OffsetT                         begin,
+    OffsetT                         end,
+    OffsetT                         prefetch_end)       ///< [in] End of the nonzeros (nothing past it is prefetched)
+{
+    ValueT partial[ACCUMULATORS];
+    for (int i = 0; i < ACCUMULATORS; ++i)
+        partial[i] = 0.0;
+
+    OffsetT k = begin;
+    for (; k + UNROLL <= end; k += UNROLL)
+    {
+        if ((PREFETCH > 0) && (k + UNROLL + PREFETCH <= prefetch_end))
+        {
+            for (int u = 0; u < UNROLL; ++u)
+                MERGE_SPEC_PREFETCH(x + columns[k + PREFETCH + u]);
+        }
+        for (int u = 0; u < UNROLL; ++u)
+            partial[u % ACCUMULATORS] += values[k + u] * x[columns[k + u]];
+    }
+    for (; k < end; ++k)
+    {
+        if ((PREFETCH > 0) && (k + PREFETCH < prefetch_end))
+            MERGE_SPEC_PREFETCH(x + columns[k + PREFETCH]);
+        partial[0] += values[k] * x[columns[k]];
+    }
+
+    for (int i = 1; i < ACCUMULATORS; ++i)
+        partial[0] += partial[i];
+    return partial[0];
+}
+
+
+/**
+ * OpenMP CPU merge-based SpMV specialized at compile time for the column
+ * index type, unroll factor, accumulator count, and prefetch distance
+ */
+template <
+    typename ValueT,
+    typename OffsetT,
+    typename ColumnT,
+    int UNROLL,
+    int ACCUMULATORS,
+    int PREFETCH>
+void OmpMergeCsrmvSpec(
+    int2*                               thread_coords,
+    int2*                               thread_coord_ends,
+    int                                 num_threads,
+    const CsrView<ValueT, OffsetT>&     a,
+    const void*                         column_indices,     ///< [in] ColumnT column indices, indexed like the offsets (index_base-based)
+    ValueT*     __restrict              vector_x,
+    ValueT*     __restrict              vector_y_out)
+{
+    OffsetT                     num_rows        = a.num_rows;
+    OffsetT                     prefetch_end    = (num_rows > 0) ? a.row_end_offsets[num_rows - 1] : 0;
+    OffsetT*        __restrict  row_offsets     = a.row_offsets;
+    OffsetT*        __restrict  row_end_offsets = a.row_end_offsets;
+    const ColumnT*  __restrict  columns         = (const ColumnT*) column_indices;
+    const ValueT*   __restrict  values          = a.values - a.index_base;
+    const ValueT*   __restrict  x               = vector_x - a.index_base;
+
+    // Temporary storage for inter-thread fix-up after load-balanced work
+    OffsetT     row_carry_out[MERGE_SPMV_MAX_THREADS];     // The last row-id each worked on by each thread when it finished its path segment
+    ValueT      value_carry_out[MERGE_SPMV_MAX_THREADS];   // The running total within each thread when it finished its path segment
+
+    CUB_SPMV_PROFILE_STMT(double region_start = WallClockSeconds();)
+
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int tid = 0; tid < num_threads; tid++)
+    {
+        CUB_SPMV_PROFILE_STMT(double thread_start = WallClockSeconds();)
+
+        int2 thread_coord = thread_coords[tid];
+        int2 thread_coord_end = thread_coord_ends[tid];
+
+        // Consume whole rows (skipping any gap before each)
+        for (; thread_coord.x < thread_coord_end.x; ++thread_coord.x)
+        {
+            OffsetT begin = std::max(thread_coord.y, row_offsets[thread_coord.x]);
+            thread_coord.y = row_end_offsets[thread_coord.x];
+            vector_y_out[thread_coord.x] = MergeSpecRowDot<ValueT, OffsetT, ColumnT, UNROLL, ACCUMULATORS, PREFETCH>(
+                columns, values, x, begin, thread_coord.y, prefetch_end);
+        }
+
+        // Consume partial portion of thread's last row
+        if (thread_coord.x < num_rows)
+            thread_coord.y = std::max(thread_coord.y, row_offsets[thread_coord.x]);
+        ValueT running_total = MergeSpecRowDot<ValueT, OffsetT, ColumnT, UNROLL, ACCUMULATORS, PREFETCH>(
+            columns, values, x, thread_coord.y, thread_coord_end.y, prefetch_end);
+
+        // Save carry-outs
+        row_carry_out[tid] = thread_coord_end.x;
+        value_carry_out[tid] = running_total;
+
+        CUB_SPMV_PROFILE_STMT(g_merge_profile.RecordThread(tid, thread_start, WallClockSeconds(),
+            thread_coord_end.x - thread_coords[tid].x, thread_coord_end.y - thread_coords[tid].y);)
+    }
+
+    CUB_SPMV_PROFILE_STMT(double barrier_end = WallClockSeconds();)
+
+    // Carry-out fix-up (rows spanning multiple threads)
+    for (int tid = 0; tid < num_threads - 1; ++tid)
+    {
+        if (row_carry_out[tid] < num_rows)
+            vector_y_out[row_carry_out[tid]] += value_carry_out[tid];
+    }
+
+    CUB_SPMV_PROFILE_STMT(g_merge_profile.RecordCall(region_start, barrier_end, WallClockSeconds());)
+}
+
+
+/**
+ * One instantiated configuration of the specialized kernel
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct MergeSpecVariant
+{
+    typedef void (*Kernel)(int2*, int2*, int, const CsrView<ValueT, OffsetT>&, const void*, ValueT*, ValueT*);
+
+    int         unroll;
+    int         accumulators;
+    int         prefetch;
+    int         column_bytes;       // Width of the column indices
+    Kernel      kernel;
+};
+
+
+/**
+ * Dispatch table of the specialized kernels: MERGE_SPEC_GRID with 16-bit
+ * column indices, then with OffsetT column indices
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+const MergeSpecVariant<ValueT, OffsetT>* MergeSpecVariants(int &num_variants)
+{
+    #define MERGE_SPEC_NARROW(U, A, P)  { U, A, P, 2, OmpMergeCsrmvSpec<ValueT, OffsetT, unsigned short, U, A, P> },
+    #define MERGE_SPEC_WIDE(U, A, P)    { U, A, P, int(sizeof(OffsetT)), OmpMergeCsrmvSpec<ValueT, OffsetT, OffsetT, U, A, P> },
+
+    static const MergeSpecVariant<ValueT, OffsetT> variants[] =
+    {
+        MERGE_SPEC_GRID(MERGE_SPEC_NARROW)
+        MERGE_SPEC_GRID(MERGE_SPEC_WIDE)
+    };
+
+    #undef MERGE_SPEC_NARROW
+    #undef MERGE_SPEC_WIDE
+
+    num_variants = int(sizeof(variants) / sizeof(variants[0]));
+    return variants;
+}
+
+
+/**
+ * Specialized merge-based CsrMV method.  Setup computes the merge-path
+ * partitioning, narrows the column indices to 16 bits when they fit, and picks
+ * a kernel from the dispatch table, by a heuristic on the row lengths and
+ * vector_x footprint or (tune) by timing variants.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct OmpMergeCsrmvSpecMethod : SpmvMethod<ValueT, OffsetT>
+{
+    typedef MergeSpecVariant<ValueT, OffsetT> KernelVariant;
+
+    bool                            tune;               // Whether to time the variants rather than use the heuristic
+    CsrView<ValueT, OffsetT>        a;
+    int                             num_threads;
+    int2*                           thread_coords;
+    int2*                           thread_coord_ends;
+    unsigned short*                 narrow_columns;     // 16-bit copy of the column indices over the merge path (NULL if they do not fit)
+    OffsetT                         narrow_length;
+    const KernelVariant*            variant;            // Chosen kernel
+    char                            variant_name[64];
+
+    OmpMergeCsrmvSpecMethod(bool tune = false) :
+        SpmvMethod<ValueT, OffsetT>(
+            tune ? "spec-tune" : "spec",
+            tune ? "Merge CsrMV (specialized, tuned)" : "Merge CsrMV (specialized)",
+            false),
+        tune(tune), num_threads(0), thread_coords(NULL), thread_coord_ends(NULL),
+        narrow_columns(NULL), narrow_length(0), variant(NULL)
+    {
+        variant_name[0] = '\0';
+    }
+
+    const char* Variant()
+    {
+        return (variant) ? variant_name : NULL;
+    }
+
+    /// Column indices of the variant's width, indexed like the offsets
+    const void* Columns(const KernelVariant& v)
+    {
+        if (v.column_bytes == 2)
+            return narrow_columns - a.row_offsets[0];
+        return a.column_indices - a.index_base;
+    }
+
+    /**
+     * Whether the variant can run here: 16-bit columns need the narrowed copy,
+     * and fp32 keeps a single accumulator so that its sums round like the
+     * sequential reference (split fp32 partial sums of long rows drift past
+     * the verification tolerance)
+     */
+    bool Usable(const KernelVariant& v)
+    {
+        if ((v.column_bytes == 2) && (narrow_columns == NULL))
+            return false;
+        if ((sizeof(ValueT) < sizeof(double)) && (v.accumulators > 1))
+            return false;
+        return true;
+    }
+
+    /// The usable variant with the given configuration, or NULL
+    const KernelVariant* FindVariant(
+        const KernelVariant*    variants,
+        int                     num_variants,
+        int                     unroll,
+        int                     accumulators,
+        int                     prefetch,
+        int                     column_bytes)
+    {
+        for (int v = 0; v < num_variants; ++v)
+        {
+            if ((variants[v].unroll == unroll) && (variants[v].accumulators == accumulators) &&
+                (variants[v].prefetch == prefetch) && (variants[v].column_bytes == column_bytes) &&
+                Usable(variants[v]))
+                return &variants[v];
+        }
+        return NULL;
+    }
+
+    /**
+     * Unroll and accumulators grow with the mean row length (short rows only
+     * pay for the remainder loop), and vector_x is prefetched when it is too
+     * large to stay cached
+     */
+    const KernelVariant* HeuristicVariant(const KernelVariant* variants, int num_variants)
+    {
+        double  mean_length     = double(a.num_nonzeros) / a.num_rows;
+        double  x_bytes         = double(sizeof(ValueT)) * a.num_cols;
+        int     column_bytes    = (narrow_columns) ? 2 : int(sizeof(OffsetT));
+
+        int unroll = 8, accumulators = 4;
+        if (mean_length < 3)
+            unroll = 1, accumulators = 1;
+        else if (mean_length < 8)
+            unroll = 2, accumulators = 2;
+        else if (mean_length < 24)
+            unroll = 4, accumulators = 2;
+        else if (mean_length < 64)
+            unroll = 4, accumulators = 4;
+
+        if (sizeof(ValueT) < sizeof(double))
+            accumulators = 1;
+
+        int prefetch = (x_bytes > 32.0 * 1024 * 1024) ? 64 : ((x_bytes > 4.0 * 1024 * 1024) ? 16 : 0);
+
+        return FindVariant(variants, num_variants, unroll, accumulators, prefetch, column_bytes);
+    }
+
+    /// Best of MERGE_SPEC_TUNE_CALLS timed calls (after a warmup call)
+    double TimeVariant(const KernelVariant& v, ValueT* vector_x, ValueT* vector_y)
+    {
+        const void* columns = Columns(v);
+        v.kernel(thread_coords, thread_coord_ends, num_threads, a, columns, vector_x, vector_y);
+
+        double best_s = 0;
+        for (int call = 0; call < MERGE_SPEC_TUNE_CALLS; ++call)
+        {
+            double start = WallClockSeconds();
+            v.kernel(thread_coords, thread_coord_ends, num_threads, a, columns, vector_x, vector_y);
+            double elapsed = WallClockSeconds() - start;
+            best_s = (call == 0) ? elapsed : std::min(best_s, elapsed);
+        }
+        return best_s;
+    }
+
+    /**
+     * Search the grid one axis at a time on a vector of ones: unroll and
+     * accumulators without prefetch (at the narrowest available column width),
+     * then the prefetch distances of the best of those, then the other column
+     * width.  This times about a third of the variants.
+     */
+    const KernelVariant* TunedVariant(const KernelVariant* variants, int num_variants)
+    {
+        ValueT *vector_x = new ValueT[a.num_cols];
+        ValueT *vector_y = new ValueT[a.num_rows];
+        std::fill(vector_x, vector_x + a.num_cols, ValueT(1.0));
+
+        int column_bytes = (narrow_columns) ? 2 : int(sizeof(OffsetT));
+
+        const KernelVariant*    best    = NULL;
+        double                  best_s  = 0;
+        for (int v = 0; v < num_variants; ++v)
+        {
+            if ((variants[v].prefetch != 0) || (variants[v].column_bytes != column_bytes) || !Usable(variants[v]))
+                continue;
+
+            double variant_s = TimeVariant(variants[v], vector_x, vector_y);
+            if ((best == NULL) || (variant_s < best_s))
+            {
+                best    = &variants[v];
+                best_s  = variant_s;
+            }
+        }
+
+        const KernelVariant* step = best;
+        for (int v = 0; v < num_variants; ++v)
+        {
+            if ((variants[v].unroll != step->unroll) || (variants[v].accumulators != step->accumulators) ||
+                (variants[v].column_bytes != column_bytes) || (variants[v].prefetch == 0))
+                continue;
+
+            double variant_s = TimeVariant(variants[v], vector_x, vector_y);
+            if (variant_s < best_s)
+            {
+                best    = &variants[v];
+                best_s  = variant_s;
+            }
+        }
+
+        if (narrow_columns)
+        {
+            const KernelVariant* wide = FindVariant(variants, num_variants,
+                best->unroll, best->accumulators, best->prefetch, int(sizeof(OffsetT)));
+            if (wide && (TimeVariant(*wide, vector_x, vector_y) < best_s))
+                best = wide;
+        }
+
+        delete[] vector_x;
+        delete[] vector_y;
+        return best;
+    }
+
+    void Setup(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        int                             expected_calls)
+    {
+        this->a             = a;
+        this->num_threads   = num_threads;
+        thread_coords       = new int2[num_threads];
+        thread_coord_ends   = new int2[num_threads];
+
+        OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads, a);
+
+        // 16-bit column indices (over the whole merge path, gaps included)
+        if ((a.num_rows > 0) && (double(a.num_cols) - 1 + a.index_base <= 65535.0))
+        {
+            narrow_length   = a.PathNonzeros();
+            narrow_columns  = (unsigned short*) HostMalloc(sizeof(unsigned short) * narrow_length);
+            OffsetT* __restrict source = a.column_indices + (a.row_offsets[0] - a.index_base);
+
+            #pragma omp parallel for schedule(static) num_threads(num_threads)
+            for (OffsetT i = 0; i < narrow_length; ++i)
+                narrow_columns[i] = (unsigned short) source[i];
+        }
+
+        int num_variants;
+        const KernelVariant* variants = MergeSpecVariants<ValueT, OffsetT>(num_variants);
+        variant = (tune) ? TunedVariant(variants, num_variants) : HeuristicVariant(variants, num_variants);
+
+        sprintf(variant_name, "unroll %d, %d accumulators, prefetch %d, %d-bit columns",
+            variant->unroll, variant->accumulators, variant->prefetch, variant->column_bytes * 8);
+    }
+
+    void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        variant->kernel(thread_coords, thread_coord_ends, num_threads, a, Columns(*variant), vector_x, vector_y_out);
+    }
+
+    void Teardown()
+    {
+        HostFree(narrow_columns, sizeof(unsigned short) * narrow_length);
+        narrow_columns = NULL;
+        narrow_length = 0;
+        variant = NULL;
+
+        delete[] thread_coords;         thread_coords = NULL;
+        delete[] thread_coord_ends;     thread_coord_ends = NULL;
+    }
+
+    bool AddFlushRegions(CacheFlusher &flusher)
+    {
+        flusher.AddRegion(thread_coords, sizeof(int2) * num_threads);
+        flusher.AddRegion(thread_coord_ends, sizeof(int2) * num_threads);
+        if (narrow_columns)
+            flusher.AddRegion(narrow_columns, sizeof(unsigned short) * narrow_length);
+        return true;
+    }
+};
+
+
+#ifdef CUB_MKL
+
+//---------------------------------------------------------------------
+// MKL SpMV
+//---------------------------------------------------------------------
+
+/**
+ * MKL CPU SpMV (specialized for fp32)
+ */
+inline void MklCsrmv(
+    const sparse_matrix_t &A,
+    const struct matrix_descr &descr,
+    float* __restrict vector_x,
+    float* __restrict vector_y_out)
+{
+    const float alpha = 1.0;
+    const float beta = 0.0;
+    sparse_status_t status = mkl_sparse_s_mv(SPARSE_OPERATION_NON_TRANSPOSE,
+					     alpha,
+					     A,
+					     descr,
+					     vector_x,
+					     beta,
+					     vector_y_out);
+    if (status != SPARSE_STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to do mv operation. Error code: %d\n", status);
+        exit(1);
+    }
+}
+
+template <typename OffsetT>
+void MklCreateMatrix(const CsrView<float, OffsetT> &a, sparse_matrix_t &mklMatrix)
+{
+    sparse_status_t status;
+    status = mkl_sparse_s_create_csr(&mklMatrix, (a.index_base == 1) ? SPARSE_INDEX_BASE_ONE : SPARSE_INDEX_BASE_ZERO,
+				     a.num_rows, a.num_cols, a.row_offsets, a.row_end_offsets, a.column_indices, a.values);
+    if (status != SPARSE_STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to create csr. Error code: %d\n", status);
+        exit(1);
+    }
+}
+
+/**
+ * MKL CPU SpMV (specialized for fp64)
+ */
+inline void MklCsrmv(
+    const sparse_matrix_t &A,
+    const struct matrix_descr &descr,
+    double* __restrict vector_x,
+    double* __restrict vector_y_out)
+{
+    const double alpha = 1.0;
+    const double beta = 0.0;
+    sparse_status_t status = mkl_sparse_d_mv(SPARSE_OPERATION_NON_TRANSPOSE,
+					     alpha,
+					     A,
+					     descr,
+					     vector_x,
+					     beta,
+					     vector_y_out);
+    if (status != SPARSE_STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to do mv operation. Error code: %d\n", status);
+        exit(1);
+    }
+}
+
+template <typename OffsetT>
+void MklCreateMatrix(const CsrView<double, OffsetT> &a, sparse_matrix_t &mklMatrix)
+{
+    sparse_status_t status;
+    status = mkl_sparse_d_create_csr(&mklMatrix, (a.index_base == 1) ? SPARSE_INDEX_BASE_ONE : SPARSE_INDEX_BASE_ZERO,
+				     a.num_rows, a.num_cols, a.row_offsets, a.row_end_offsets, a.column_indices, a.values);
+    if (status != SPARSE_STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to create csr. Error code: %d\n", status);
+        exit(1);
+    }
+}
+
+/**
+ * MKL CsrMV method.  Setup is MKL's inspection (create, hint, optimize).
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct MklCsrmvMethod : SpmvMethod<ValueT, OffsetT>
+{
+    sparse_matrix_t         mklMatrix;
+    struct matrix_descr     matrixDescr;
+
+    MklCsrmvMethod() :
+        SpmvMethod<ValueT, OffsetT>("mkl", "MKL CsrMV")
+    {
+        matrixDescr.type = SPARSE_MATRIX_TYPE_GENERAL;
+    }
+
+    void Setup(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        int                             expected_calls)
+    {
+        sparse_status_t status;
+
+        MklCreateMatrix(a, mklMatrix);
+
+        status = mkl_sparse_set_mv_hint(mklMatrix, SPARSE_OPERATION_NON_TRANSPOSE, matrixDescr, expected_calls);
+        if (status != SPARSE_STATUS_SUCCESS) {
+            fprintf(stderr, "Failed to set mv hint. Error code: %d\n", status);
+            exit(1);
+        }
+
+        status = mkl_sparse_optimize(mklMatrix);
+        if (status != SPARSE_STATUS_SUCCESS) {
+            fprintf(stderr, "Failed to optimize mkl. Error code: %d\n", status);
+            exit(1);
+        }
+    }
+
+    void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        MklCsrmv(mklMatrix, matrixDescr, vector_x, vector_y_out);
+    }
+
+    void Teardown()
+    {
+        mkl_sparse_destroy(mklMatrix);
+    }
+
+    bool AddFlushRegions(CacheFlusher &flusher)
+    {
+        // The handle keeps its optimized copy of the matrix out of reach
+        return false;
+    }
+};
+
+#endif // CUB_MKL
+
+
+//---------------------------------------------------------------------
+// SpMV method registry
+//---------------------------------------------------------------------
+
+/**
+ * Registers every SpMV method, in display order.  Adding a method only
+ * requires an entry here.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+void RegisterSpmvMethods(std::vector<SpmvMethod<ValueT, OffsetT>*> &registry)
+{
+#ifdef CUB_MKL
+    registry.push_back(new MklCsrmvMethod<ValueT, OffsetT>());
+#endif
+    registry.push_back(new OmpCsrmvMethod<ValueT, OffsetT>());
+    registry.push_back(new OmpMergeCsrmvMethod<ValueT, OffsetT>());
+    registry.push_back(new OmpMergeCsrLenGotomvMethod<ValueT, OffsetT>());
+    registry.push_back(new OmpMergeCsrmvMethod<ValueT, OffsetT>(true));
+    registry.push_back(new OmpMergeCsrLenGotomvMethod<ValueT, OffsetT>(true));
+    registry.push_back(new OmpMergeCsrmvSpecMethod<ValueT, OffsetT>());
+    registry.push_back(new OmpMergeCsrmvSpecMethod<ValueT, OffsetT>(true));
+}
+
+
+//---------------------------------------------------------------------
+// SpMV plans
+//---------------------------------------------------------------------
+
+/// SpMV calls a plan's setup is amortized over when the caller does not say (MKL's mv hint)
+const int SPMV_PLAN_EXPECTED_CALLS = 1000;
+
+/**
+ * One registered SpMV method set up for one matrix (the C++ counterpart of
+ * spmv_plan_t in mergespmv.h).  The plan keeps a view of the matrix, so its
+ * arrays must outlive the plan and must not change while the plan exists.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct SpmvPlan
+{
+    SpmvMethod<ValueT, OffsetT>*    method;
+
+    SpmvPlan() : method(NULL) {}
+
+    ~SpmvPlan()
+    {
+        Clear();
+    }
+
+    /**
+     * Select the method named method_name and run its Setup().  Returns NULL,
+     * or why the plan could not be made.
+     */
+    const char* Init(
+        const CsrView<ValueT, OffsetT>& a,
+        const char*                     method_name,
+        int                             num_threads,
+        int                             expected_calls = SPMV_PLAN_EXPECTED_CALLS)
+    {
+        Clear();
+        if ((num_threads < 1) || (num_threads > MERGE_SPMV_MAX_THREADS))
+            return "thread count out of range";
+
+        std::vector<SpmvMethod<ValueT, OffsetT>*> registry;
+        RegisterSpmvMethods(registry);
+        for (int j = 0; j < int(registry.size()); ++j)
+        {
+            if ((method == NULL) && (strcmp(method_name, registry[j]->name) == 0))
+                method = registry[j];
+            else
+                delete registry[j];
+        }
+        if (method == NULL)
+            return "unknown SpMV method";
+
+        const char* reason = method->Unsupported(a.RowLengthStats());
+        if (reason == NULL)
+            reason = method->UnsupportedLayout(a);
+        if (reason != NULL)
+        {
+            delete method;
+            method = NULL;
+            return reason;
+        }
+
+        method->Setup(a, num_threads, expected_calls);
+        return NULL;
+    }
+
+    /// y = Ax
+    void Execute(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        method->Execute(vector_x, vector_y_out);
+    }
+
+    void Clear()
+    {
+        if (method == NULL)
+            return;
+        method->Teardown();
+        delete method;
+        method = NULL;
+    }
+};
+
+
+//---------------------------------------------------------------------
+// Dynamic CSR
+//---------------------------------------------------------------------
+
+/// Kinds of DynamicCsrUpdate
+enum DynamicCsrOp
+{
+    DYNAMIC_CSR_INSERT,         // Set the entry, adding it if absent
+    DYNAMIC_CSR_UPDATE,         // Set the entry if present (else ignored)
+    DYNAMIC_CSR_DELETE          // Remove the entry if present
+};
+
+
+/**
+ * One change to a DynamicCsrMatrix.  Changes to the same entry within a
+ * batch take effect in batch order.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct DynamicCsrUpdate
+{
+    OffsetT         row;
+    OffsetT         col;
+    ValueT          val;            // Ignored by DYNAMIC_CSR_DELETE
+    DynamicCsrOp    op;
+
+    /// Apply to an entry's state
+    void ApplyTo(bool &present, ValueT &value) const
+    {
+        if ((op == DYNAMIC_CSR_INSERT) || ((op == DYNAMIC_CSR_UPDATE) && present))
+        {
+            present = true;
+            value   = val;
+        }
+        else if (op == DYNAMIC_CSR_DELETE)
+        {
+            present = false;
+        }
+    }
+};
+
+
+/// Buffered entries, as a fraction of the base nonzeros, past which DynamicCsrMatrix::Apply() merges (default)
+const double DYNAMIC_CSR_MERGE_FRACTION = 0.02;
+
+/// Drift from its diagonal, as a fraction of the merge items per thread, past which a partition boundary is searched again
+const double DYNAMIC_CSR_REPAIR_TOLERANCE = 0.1;
+
+
+/**
+ * CSR matrix taking batches of inserts, updates, and deletes between SpMVs.
+ *
+ * Changes go to per-thread delta buffers rather than the base CSR: each
+ * thread buffers the rows it owns under the base's merge-path partitioning,
+ * one entry per changed (row, col), sorted, holding the entry's state and its
+ * difference from the base.  SpMV is the merge-based SpMV of the base, then
+ * each thread adds the differences of its buffer to its own rows.
+ *
+ * Once the buffers hold more than merge_fraction of the base nonzeros, they
+ * are merged into a new base in parallel (each thread rebuilding its own
+ * rows).  The merge-path boundaries are then carried over to the new offsets
+ * (same row, same position within it), and only those that drifted from their
+ * diagonal by more than DYNAMIC_CSR_REPAIR_TOLERANCE are searched again,
+ * starting from the previous boundary.
+ *
+ * The base is an owned, zero-based three-array CSR with columns sorted
+ * within rows.
+ */
+template <
+    typename ValueT,
+    typename OffsetT>
+struct DynamicCsrMatrix
+{
+    typedef DynamicCsrUpdate<ValueT, OffsetT>                   Update;
+    typedef typename CsrMatrix<ValueT, OffsetT>::CooComparator  Comparator;     // Rows, then columns
+
+    /// Buffered state of an entry that differs from the base
+    struct DeltaEntry
+    {
+        OffsetT     row;
+        OffsetT     col;
+        ValueT      value;          // Current value (if present)
+        ValueT      delta;          // Current value (0 if absent) minus the base value (0 if not in the base)
+        bool        present;
+        bool        in_base;
+    };
+
+    CsrView<ValueT, OffsetT>                    base;
+    int                                         num_threads;
+    int2*                                       thread_coords;
+    int2*                                       thread_coord_ends;
+    std::vector<OffsetT>                        row_splits;         // First row of each thread's buffer, then num_rows
+    std::vector<std::vector<DeltaEntry> >       deltas;             // Per-thread delta buffers
+    OffsetT                                     num_deltas;         // Entries in all buffers
+    double                                      merge_fraction;
+    int                                         num_merges;
+    int                                         num_searched;       // Boundaries searched again by the last merge
+
+    DynamicCsrMatrix() :
+        num_threads(0), thread_coords(NULL), thread_coord_ends(NULL), num_deltas(0),
+        merge_fraction(DYNAMIC_CSR_MERGE_FRACTION), num_merges(0), num_searched(0)
+    {}
+
+    ~DynamicCsrMatrix()
+    {
+        Clear();
+    }
+
+    /**
+     * Copy the matrix a (any base or layout) as the base and partition it
+     */
+    void Init(
+        const CsrView<ValueT, OffsetT>& a,
+        int                             num_threads,
+        double                          merge_fraction = DYNAMIC_CSR_MERGE_FRACTION)
+    {
+        Clear();
+        this->num_threads       = num_threads;
+        this->merge_fraction    = merge_fraction;
+
+        OffsetT *row_offsets    = (OffsetT*) HostMalloc(sizeof(OffsetT) * (a.num_rows + 1));
+        row_offsets[0] = 0;
+        for (OffsetT row = 0; row < a.num_rows; ++row)
+            row_offsets[row + 1] = row_offsets[row] + (a.row_end_offsets[row] - a.row_offsets[row]);
+
+        OffsetT num_nonzeros    = row_offsets[a.num_rows];
+        OffsetT *column_indices = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_nonzeros);
+        ValueT  *values         = (ValueT*) HostMalloc(sizeof(ValueT) * num_nonzeros);
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (OffsetT row = 0; row < a.num_rows; ++row)
+        {
+            OffsetT source = a.row_offsets[row] - a.index_base;
+            OffsetT length = row_offsets[row + 1] - row_offsets[row];
+            bool    sorted = true;
+            for (OffsetT k = 0; k < length; ++k)
+            {
+                column_indices[row_offsets[row] + k]    = a.column_indices[source + k] - a.index_base;
+                values[row_offsets[row] + k]            = a.values[source + k];
+                sorted = sorted && ((k == 0) || (a.column_indices[source + k - 1] <= a.column_indices[source + k]));
+            }
+
+            if (!sorted)
+            {
+                std::vector<std::pair<OffsetT, ValueT> > entries(length);
+                for (OffsetT k = 0; k < length; ++k)
+                    entries[k] = std::make_pair(column_indices[row_offsets[row] + k], values[row_offsets[row] + k]);
+                std::stable_sort(entries.begin(), entries.end());
+                for (OffsetT k = 0; k < length; ++k)
+                {
+                    column_indices[row_offsets[row] + k]    = entries[k].first;
+                    values[row_offsets[row] + k]            = entries[k].second;
+                }
+            }
+        }
+
+        base.Init(a.num_rows, a.num_cols, row_offsets, row_offsets + 1, column_indices, values);
+
+        thread_coords       = new int2[num_threads];
+        thread_coord_ends   = new int2[num_threads];
+        OmpMergePartitionMatrix(thread_coords, thread_coord_ends, num_threads, base);
+        deltas.resize(num_threads);
+        SplitRows();
+    }
+
+    void Clear()
+    {
+        if (base.row_offsets)
+        {
+            HostFree(base.row_offsets, sizeof(OffsetT) * (base.num_rows + 1));
+            HostFree(base.column_indices, sizeof(OffsetT) * base.num_nonzeros);
+            HostFree(base.values, sizeof(ValueT) * base.num_nonzeros);
+        }
+        base = CsrView<ValueT, OffsetT>();
+
+        delete[] thread_coords;         thread_coords = NULL;
+        delete[] thread_coord_ends;     thread_coord_ends = NULL;
+        row_splits.clear();
+        deltas.clear();
+        num_deltas      = 0;
+        num_merges      = 0;
+        num_searched    = 0;
+    }
+
+    /// Each thread's buffer holds the rows it starts under the current partitioning
+    void SplitRows()
+    {
+        row_splits.resize(num_threads + 1);
+        for (int tid = 0; tid < num_threads; ++tid)
+            row_splits[tid] = thread_coords[tid].x;
+        row_splits[num_threads] = base.num_rows;
+    }
+
+    /// Offset of (row, col) in the base, or -1
+    OffsetT FindBase(OffsetT row, OffsetT col) const
+    {
+        OffsetT* begin  = base.column_indices + base.row_offsets[row];
+        OffsetT* end    = base.column_indices + base.row_offsets[row + 1];
+        OffsetT* found  = std::lower_bound(begin, end, col);
+        return ((found != end) && (*found == col)) ? OffsetT(found - base.column_indices) : -1;
+    }
+
+    /**
+     * Apply a batch of changes, skipping those outside the matrix, and return
+     * the number skipped.  Merges the buffers into the base if they pass
+     * merge_fraction of the base nonzeros (counted in num_merges).
+     */
+    OffsetT Apply(const Update* updates, OffsetT num_updates)
+    {
+        std::vector<Update> batch;
+        batch.reserve(num_updates);
+        for (OffsetT i = 0; i < num_updates; ++i)
+        {
+            if ((updates[i].row >= 0) && (updates[i].row < base.num_rows) &&
+                (updates[i].col >= 0) && (updates[i].col < base.num_cols))
+            {
+                batch.push_back(updates[i]);
+            }
+        }
+        OffsetT num_rejected = num_updates - OffsetT(batch.size());
+
+        std::stable_sort(batch.begin(), batch.end(), Comparator());
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            // This thread's rows of the batch
+            Update probe;
+            probe.row = row_splits[tid];
+            probe.col = -1;
+            OffsetT begin = std::lower_bound(batch.begin(), batch.end(), probe, Comparator()) - batch.begin();
+            probe.row = row_splits[tid + 1];
+            OffsetT end = std::lower_bound(batch.begin(), batch.end(), probe, Comparator()) - batch.begin();
+            if (begin == end)
+                continue;
+
+            // New state of each changed entry
+            std::vector<DeltaEntry> &buffer = deltas[tid];
+            std::vector<DeltaEntry> changed;
+            for (OffsetT i = begin; i < end;)
+            {
+                DeltaEntry entry;
+                entry.row       = batch[i].row;
+                entry.col       = batch[i].col;
+                OffsetT offset  = FindBase(entry.row, entry.col);
+                entry.in_base   = (offset >= 0);
+                ValueT base_val = (entry.in_base) ? base.values[offset] : ValueT(0.0);
+
+                typename std::vector<DeltaEntry>::iterator buffered = std::lower_bound(buffer.begin(), buffer.end(), entry, Comparator());
+                if ((buffered != buffer.end()) && (buffered->row == entry.row) && (buffered->col == entry.col))
+                {
+                    entry.present   = buffered->present;
+                    entry.value     = buffered->value;
+                }
+                else
+                {
+                    entry.present   = entry.in_base;
+                    entry.value     = base_val;
+                }
+
+                for (; (i < end) && (batch[i].row == entry.row) && (batch[i].col == entry.col); ++i)
+                    batch[i].ApplyTo(entry.present, entry.value);
+
+                entry.delta = ((entry.present) ? entry.value : ValueT(0.0)) - base_val;
+                changed.push_back(entry);
+            }
+
+            // Merge into the buffer, dropping entries back in their base state
+            std::vector<DeltaEntry> merged;
+            merged.reserve(buffer.size() + changed.size());
+            size_t b = 0, c = 0;
+            while ((b < buffer.size()) || (c < changed.size()))
+            {
+                if ((c == changed.size()) || ((b < buffer.size()) && Comparator()(buffer[b], changed[c])))
+                {
+                    merged.push_back(buffer[b++]);
+                    continue;
+                }
+                if ((b < buffer.size()) && (buffer[b].row == changed[c].row) && (buffer[b].col == changed[c].col))
+                    ++b;
+                if ((changed[c].present != changed[c].in_base) || (changed[c].delta != ValueT(0.0)))
+                    merged.push_back(changed[c]);
+                ++c;
+            }
+            buffer.swap(merged);
+        }
+
+        num_deltas = 0;
+        for (int tid = 0; tid < num_threads; ++tid)
+            num_deltas += OffsetT(deltas[tid].size());
+
+        if (num_deltas > merge_fraction * base.num_nonzeros)
+            Merge();
+        return num_rejected;
+    }
+
+    /**
+     * Merge the delta buffers into a new base and repair the partitioning
+     */
+    void Merge()
+    {
+        OffsetT     num_rows        = base.num_rows;
+        OffsetT*    row_offsets     = (OffsetT*) HostMalloc(sizeof(OffsetT) * (num_rows + 1));
+        std::vector<OffsetT> thread_nonzeros(num_threads + 1, 0);
+
+        // Merged row lengths, as offsets within each thread's rows
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            const std::vector<DeltaEntry> &buffer = deltas[tid];
+            size_t  k       = 0;
+            OffsetT total   = 0;
+            for (OffsetT row = row_splits[tid]; row < row_splits[tid + 1]; ++row)
+            {
+                OffsetT length = base.row_offsets[row + 1] - base.row_offsets[row];
+                for (; (k < buffer.size()) && (buffer[k].row == row); ++k)
+                    length += OffsetT(buffer[k].present) - OffsetT(buffer[k].in_base);
+                row_offsets[row] = total;
+                total += length;
+            }
+            thread_nonzeros[tid + 1] = total;
+        }
+
+        for (int tid = 0; tid < num_threads; ++tid)
+            thread_nonzeros[tid + 1] += thread_nonzeros[tid];
+        OffsetT num_nonzeros = thread_nonzeros[num_threads];
+        row_offsets[num_rows] = num_nonzeros;
+
+        OffsetT *column_indices = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_nonzeros);
+        ValueT  *values         = (ValueT*) HostMalloc(sizeof(ValueT) * num_nonzeros);
+
+        // Each thread merges its buffer into its rows
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            const std::vector<DeltaEntry> &buffer = deltas[tid];
+            size_t  k   = 0;
+            OffsetT out = thread_nonzeros[tid];
+            for (OffsetT row = row_splits[tid]; row < row_splits[tid + 1]; ++row)
+            {
+                row_offsets[row] += thread_nonzeros[tid];
+
+                OffsetT j   = base.row_offsets[row];
+                OffsetT end = base.row_offsets[row + 1];
+                while ((j < end) || ((k < buffer.size()) && (buffer[k].row == row)))
+                {
+                    if ((k < buffer.size()) && (buffer[k].row == row) && ((j == end) || (buffer[k].col <= base.column_indices[j])))
+                    {
+                        if ((j < end) && (buffer[k].col == base.column_indices[j]))
+                            ++j;
+                        if (buffer[k].present)
+                        {
+                            column_indices[out] = buffer[k].col;
+                            values[out]         = buffer[k].value;
+                            ++out;
+                        }
+                        ++k;
+                    }
+                    else
+                    {
+                        column_indices[out] = base.column_indices[j];
+                        values[out]         = base.values[j];
+                        ++out;
+                        ++j;
+                    }
+                }
+            }
+        }
+
+        // Carry each boundary over to the new offsets (same row, same position within it)
+        for (int tid = 1; tid < num_threads; ++tid)
+        {
+            int2 coord = thread_coords[tid];
+            if (coord.x < num_rows)
+                coord.y = row_offsets[coord.x] + std::min(
+                    coord.y - base.row_offsets[coord.x],
+                    row_offsets[coord.x + 1] - row_offsets[coord.x]);
+            else
+                coord.y = num_nonzeros;
+            thread_coords[tid] = coord;
+        }
+
+        HostFree(base.row_offsets, sizeof(OffsetT) * (num_rows + 1));
+        HostFree(base.column_indices, sizeof(OffsetT) * base.num_nonzeros);
+        HostFree(base.values, sizeof(ValueT) * base.num_nonzeros);
+        base.Init(num_rows, base.num_cols, row_offsets, row_offsets + 1, column_indices, values);
+
+        // Search again from the previous boundary where a boundary drifted
+        OffsetT num_merge_items     = num_rows + num_nonzeros;
+        OffsetT items_per_thread    = (num_merge_items + num_threads - 1) / num_threads;
+        num_searched = 0;
+        for (int tid = 1; tid < num_threads; ++tid)
+        {
+            OffsetT diagonal = std::min(items_per_thread * tid, num_merge_items);
+            OffsetT drift    = thread_coords[tid].x + thread_coords[tid].y - diagonal;
+            if (std::abs(double(drift)) > DYNAMIC_CSR_REPAIR_TOLERANCE * items_per_thread)
+            {
+                int2 previous = thread_coords[tid - 1];
+                CountingInputIterator<OffsetT> nonzero_indices(previous.y);
+                MergePathSearch(diagonal - previous.x - previous.y, row_offsets + 1 + previous.x, nonzero_indices,
+                    num_rows - previous.x, num_nonzeros - previous.y, thread_coords[tid]);
+                thread_coords[tid].x += previous.x;
+                thread_coords[tid].y += previous.y;
+                ++num_searched;
+            }
+            thread_coord_ends[tid - 1] = thread_coords[tid];
+        }
+        thread_coord_ends[num_threads - 1].x = num_rows;
+        thread_coord_ends[num_threads - 1].y = num_nonzeros;
+
+        for (int tid = 0; tid < num_threads; ++tid)
+            std::vector<DeltaEntry>().swap(deltas[tid]);
+        num_deltas = 0;
+        ++num_merges;
+        SplitRows();
+    }
+
+    /**
+     * y = Ax: the merge-based SpMV of the base, then the buffered differences
+     */
+    void Spmv(
+        ValueT*                         vector_x,
+        ValueT*                         vector_y_out)
+    {
+        OmpMergeCsrmv(thread_coords, thread_coord_ends, num_threads, base, vector_x, vector_y_out);
+        if (num_deltas == 0)
+            return;
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            const std::vector<DeltaEntry> &buffer = deltas[tid];
+            for (size_t k = 0; k < buffer.size(); ++k)
+                vector_y_out[buffer[k].row] += buffer[k].delta * vector_x[buffer[k].col];
+        }
+    }
+};
@@ -0,0 +1,289 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIAeBILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * libmergespmv: C API over the templates of merge_spmv.h
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "merge_spmv.h"
+#include "mergespmv.h"
+
+
+//---------------------------------------------------------------------
+// Handles
+//---------------------------------------------------------------------
+
+struct spmv_csr
+{
+    bool                        fp32;           // Which of the views below holds the arrays
+    CsrView<double, int>        matrix;
+    CsrView<float, int>         matrix_s;
+};
+
+struct spmv_plan
+{
+    bool                        fp32;
+    SpmvPlan<double, int>       plan;
+    SpmvPlan<float, int>        plan_s;
+};
+
+
+#if defined(_MSC_VER)
+static __declspec(thread) char  g_last_error[256];     // Reason for the calling thread's last failure
+#else
+static __thread char            g_last_error[256];     // Reason for the calling thread's last failure
+#endif
+
+static void SetLastError(const char* reason, const char* method = NULL)
+{
+    if (method != NULL)
+        snprintf(g_last_error, sizeof(g_last_error), "%s: %s", method, reason);
+    else
+        snprintf(g_last_error, sizeof(g_last_error), "%s", reason);
+}
+
+
+/**
+ * Whether the CSR arrays are consistent enough to run on (offsets are only
+ * checked for order, the columns not at all)
+ */
+static bool ValidCsr(int num_rows, int num_cols, int* rows_start, int* rows_end, int* column_indices, const void* values, int index_base)
+{
+    if ((num_rows < 1) || (num_cols < 1))
+    {
+        SetLastError("invalid matrix dimensions");
+        return false;
+    }
+    if ((index_base != 0) && (index_base != 1))
+    {
+        SetLastError("index base must be 0 or 1");
+        return false;
+    }
+    if ((rows_start == NULL) || (rows_end == NULL) || (column_indices == NULL) || (values == NULL))
+    {
+        SetLastError("NULL CSR array");
+        return false;
+    }
+    if (rows_start[0] < index_base)
+    {
+        SetLastError("row offsets below the index base");
+        return false;
+    }
+    for (int row = 0; row < num_rows; ++row)
+    {
+        if ((rows_end[row] < rows_start[row]) || ((row > 0) && (rows_start[row] < rows_end[row - 1])))
+        {
+            SetLastError("row offsets out of order");
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//---------------------------------------------------------------------
+// API
+//---------------------------------------------------------------------
+
+extern "C" {
+
+int spmv_api_version(void)
+{
+    return SPMV_API_VERSION;
+}
+
+
+int spmv_num_methods(void)
+{
+    std::vector<SpmvMethod<double, int>*> registry;
+    RegisterSpmvMethods(registry);
+    for (int j = 0; j < int(registry.size()); ++j)
+        delete registry[j];
+    return int(registry.size());
+}
+
+
+const char* spmv_method_name(int i)
+{
+    // Method names are string literals, so they outlive the registry
+    std::vector<SpmvMethod<double, int>*> registry;
+    RegisterSpmvMethods(registry);
+    const char* name = ((i >= 0) && (i < int(registry.size()))) ? registry[i]->name : NULL;
+    for (int j = 0; j < int(registry.size()); ++j)
+        delete registry[j];
+    return name;
+}
+
+
+spmv_csr_t spmv_csr_create(
+    int             num_rows,
+    int             num_cols,
+    int             num_nonzeros,
+    int*            row_offsets,
+    int*            column_indices,
+    double*         values)
+{
+    if ((row_offsets != NULL) && (num_rows >= 1) && ((row_offsets[0] != 0) || (row_offsets[num_rows] != num_nonzeros)))
+    {
+        SetLastError("row offsets do not span the nonzeros (indices must be zero-based)");
+        return NULL;
+    }
+    return spmv_csr_create_ends(num_rows, num_cols, row_offsets, (row_offsets != NULL) ? row_offsets + 1 : NULL,
+        column_indices, values, 0);
+}
+
+
+spmv_csr_t spmv_csr_create_ends(
+    int             num_rows,
+    int             num_cols,
+    int*            rows_start,
+    int*            rows_end,
+    int*            column_indices,
+    double*         values,
+    int             index_base)
+{
+    if (!ValidCsr(num_rows, num_cols, rows_start, rows_end, column_indices, values, index_base))
+        return NULL;
+
+    spmv_csr_t csr = new spmv_csr();
+    csr->fp32 = false;
+    csr->matrix.Init(num_rows, num_cols, rows_start, rows_end, column_indices, values, index_base);
+    return csr;
+}
+
+
+spmv_csr_t spmv_csr_create_s(
+    int             num_rows,
+    int             num_cols,
+    int             num_nonzeros,
+    int*            row_offsets,
+    int*            column_indices,
+    float*          values)
+{
+    if ((row_offsets != NULL) && (num_rows >= 1) && ((row_offsets[0] != 0) || (row_offsets[num_rows] != num_nonzeros)))
+    {
+        SetLastError("row offsets do not span the nonzeros (indices must be zero-based)");
+        return NULL;
+    }
+    return spmv_csr_create_ends_s(num_rows, num_cols, row_offsets, (row_offsets != NULL) ? row_offsets + 1 : NULL,
+        column_indices, values, 0);
+}
+
+
+spmv_csr_t spmv_csr_create_ends_s(
+    int             num_rows,
+    int             num_cols,
+    int*            rows_start,
+    int*            rows_end,
+    int*            column_indices,
+    float*          values,
+    int             index_base)
+{
+    if (!ValidCsr(num_rows, num_cols, rows_start, rows_end, column_indices, values, index_base))
+        return NULL;
+
+    spmv_csr_t csr = new spmv_csr();
+    csr->fp32 = true;
+    csr->matrix_s.Init(num_rows, num_cols, rows_start, rows_end, column_indices, values, index_base);
+    return csr;
+}
+
+
+void spmv_csr_destroy(spmv_csr_t csr)
+{
+    delete csr;
+}
+
+
+spmv_plan_t spmv_plan_create(spmv_csr_t csr, const char* method, int threads)
+{
+    if (csr == NULL)
+    {
+        SetLastError("NULL matrix handle");
+        return NULL;
+    }
+    if (method == NULL)
+        method = "merge";
+    if (threads <= 0)
+        threads = omp_get_max_threads();
+
+    spmv_plan_t plan = new spmv_plan();
+    plan->fp32 = csr->fp32;
+    const char* reason = (csr->fp32) ?
+        plan->plan_s.Init(csr->matrix_s, method, threads) :
+        plan->plan.Init(csr->matrix, method, threads);
+
+    if (reason != NULL)
+    {
+        SetLastError(reason, method);
+        delete plan;
+        return NULL;
+    }
+    return plan;
+}
+
+
+int spmv_execute(spmv_plan_t plan, const double* x, double* y)
+{
+    if ((plan == NULL) || (x == NULL) || (y == NULL))
+        return SPMV_ERROR_INVALID_VALUE;
+    if (plan->fp32)
+        return SPMV_ERROR_TYPE_MISMATCH;
+
+    // The kernels only read vector_x
+    plan->plan.Execute(const_cast<double*>(x), y);
+    return SPMV_SUCCESS;
+}
+
+
+int spmv_execute_s(spmv_plan_t plan, const float* x, float* y)
+{
+    if ((plan == NULL) || (x == NULL) || (y == NULL))
+        return SPMV_ERROR_INVALID_VALUE;
+    if (!plan->fp32)
+        return SPMV_ERROR_TYPE_MISMATCH;
+
+    plan->plan_s.Execute(const_cast<float*>(x), y);
+    return SPMV_SUCCESS;
+}
+
+
+void spmv_plan_destroy(spmv_plan_t plan)
+{
+    delete plan;
+}
+
+
+const char* spmv_last_error(void)
+{
+    return g_last_error;
+}
+
+} // extern "C"
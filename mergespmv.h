@@ -0,0 +1,149 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIAeBILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * libmergespmv: C API of the merge-based SpMV engines
+ *
+ * Wrap CSR arrays in a spmv_csr_t (zero-copy: the arrays stay owned by the
+ * caller), create a plan for one method and thread count, and execute it as
+ * often as needed:
+ *
+ *      spmv_csr_t  a    = spmv_csr_create(rows, cols, nnz, row_offsets, column_indices, values);
+ *      spmv_plan_t plan = spmv_plan_create(a, "merge", 16);
+ *      spmv_execute(plan, x, y);      // y = Ax
+ *      spmv_plan_destroy(plan);
+ *      spmv_csr_destroy(a);
+ *
+ * spmv_csr_create_ends takes separate row start and end offsets (MKL's
+ * four-array CSR, whose rows may leave gaps) and zero- or one-based indices.
+ * The arrays must outlive the handle and its plans, and must not change while
+ * a plan exists.  Handles are opaque and all
+ * arguments are plain C types, so the ABI does not depend on the C++ layer
+ * (merge_spmv.h).  Link with -lmergespmv and the OpenMP runtime.
+ ******************************************************************************/
+
+#ifndef MERGESPMV_H
+#define MERGESPMV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Version of this API, also returned by spmv_api_version()
+#define SPMV_API_VERSION                2
+
+/// Return codes of spmv_execute()
+#define SPMV_SUCCESS                    0
+#define SPMV_ERROR_INVALID_VALUE        1   ///< NULL handle or vector
+#define SPMV_ERROR_TYPE_MISMATCH        2   ///< fp32 plan executed with fp64 vectors or vice versa
+
+/// Exported symbols (the shared library is built with hidden visibility)
+#if defined(__GNUC__)
+    #define SPMV_API __attribute__((visibility("default")))
+#else
+    #define SPMV_API
+#endif
+
+typedef struct spmv_csr*    spmv_csr_t;     ///< CSR matrix over caller-owned arrays
+typedef struct spmv_plan*   spmv_plan_t;    ///< SpMV method set up for one matrix
+
+SPMV_API int spmv_api_version(void);
+
+/**
+ * Number of registered SpMV methods, and their names (the `method` argument of
+ * spmv_plan_create(); NULL if i is out of range)
+ */
+SPMV_API int spmv_num_methods(void);
+SPMV_API const char* spmv_method_name(int i);
+
+/**
+ * Wrap caller-owned, zero-based fp64 (spmv_csr_create) or fp32
+ * (spmv_csr_create_s) CSR arrays.  Returns NULL if the arguments are invalid.
+ */
+SPMV_API spmv_csr_t spmv_csr_create(
+    int             num_rows,
+    int             num_cols,
+    int             num_nonzeros,
+    int*            row_offsets,        ///< num_rows + 1 offsets
+    int*            column_indices,     ///< num_nonzeros columns, sorted within each row
+    double*         values);            ///< num_nonzeros values
+
+SPMV_API spmv_csr_t spmv_csr_create_s(
+    int             num_rows,
+    int             num_cols,
+    int             num_nonzeros,
+    int*            row_offsets,
+    int*            column_indices,
+    float*          values);
+
+/**
+ * Wrap caller-owned CSR arrays with row starts and ends: row i is
+ * [rows_start[i], rows_end[i]).  index_base is 0, or 1 for one-based offsets
+ * and columns.  (Three-array CSR can pass row_offsets + 1 as rows_end.)
+ */
+SPMV_API spmv_csr_t spmv_csr_create_ends(
+    int             num_rows,
+    int             num_cols,
+    int*            rows_start,
+    int*            rows_end,
+    int*            column_indices,
+    double*         values,
+    int             index_base);
+
+SPMV_API spmv_csr_t spmv_csr_create_ends_s(
+    int             num_rows,
+    int             num_cols,
+    int*            rows_start,
+    int*            rows_end,
+    int*            column_indices,
+    float*          values,
+    int             index_base);
+
+/// Release the handle (not the arrays)
+SPMV_API void spmv_csr_destroy(spmv_csr_t csr);
+
+/**
+ * Set up the named method (NULL for "merge") on threads threads (<= 0 for the
+ * OpenMP default).  Setup cost (partitioning, format conversion) is paid here.
+ * Returns NULL on failure; spmv_last_error() says why.
+ */
+SPMV_API spmv_plan_t spmv_plan_create(spmv_csr_t csr, const char* method, int threads);
+
+/// y = Ax with fp64 (spmv_execute) or fp32 (spmv_execute_s) vectors; returns an SPMV_* code
+SPMV_API int spmv_execute(spmv_plan_t plan, const double* x, double* y);
+SPMV_API int spmv_execute_s(spmv_plan_t plan, const float* x, float* y);
+
+SPMV_API void spmv_plan_destroy(spmv_plan_t plan);
+
+/// Why the calling thread's last failed call failed
+SPMV_API const char* spmv_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MERGESPMV_H
@@ -0,0 +1,262 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIAeBILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * Example and check of the libmergespmv C API (make libmergespmv-check)
+ *
+ * Wraps a 2D 5-point Laplacian in zero-based three-array CSR and in one-based
+ * four-array CSR with gaps between rows, plans every registered method on
+ * both (fp64 and fp32), executes, compares against SpmvGold, and destroys.
+ * Exits non-zero on any mismatch or unexpected failure.
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mergespmv.h"
+
+
+/**
+ * Reference SpMV y = Ax (as in cpu_spmv.cpp), zero-based three-array CSR
+ */
+static void SpmvGold(
+    int             num_rows,
+    const int*      row_offsets,
+    const int*      column_indices,
+    const double*   values,
+    const double*   vector_x,
+    double*         vector_y_out)
+{
+    int row, offset;
+    for (row = 0; row < num_rows; ++row)
+    {
+        double partial = 0.0;
+        for (offset = row_offsets[row]; offset < row_offsets[row + 1]; ++offset)
+            partial += values[offset] * vector_x[column_indices[offset]];
+        vector_y_out[row] = partial;
+    }
+}
+
+
+/**
+ * Number of entries differing from the reference by more than tolerance (relative)
+ */
+static int CompareResults(const double* computed, const double* reference, int len, double tolerance)
+{
+    int i, errors = 0;
+    for (i = 0; i < len; ++i)
+    {
+        double scale = fabs(reference[i]) > 1.0 ? fabs(reference[i]) : 1.0;
+        if (fabs(computed[i] - reference[i]) > tolerance * scale)
+        {
+            if (errors == 0)
+                fprintf(stderr, "\tINCORRECT [%d]: %g != %g\n", i, computed[i], reference[i]);
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+
+/**
+ * Plan, execute, check, and destroy every method on one matrix.  Methods that
+ * do not support the matrix (plan creation fails) are reported and skipped.
+ */
+static int CheckMethods(
+    const char*     layout,
+    spmv_csr_t      a,
+    spmv_csr_t      a_s,
+    int             num_rows,
+    const double*   vector_x,
+    const float*    vector_x_s,
+    const double*   reference,
+    int             threads)
+{
+    int     m, i, failures = 0;
+    double  *vector_y   = (double*) malloc(sizeof(double) * num_rows);
+    float   *vector_y_s = (float*) malloc(sizeof(float) * num_rows);
+    double  *widened    = (double*) malloc(sizeof(double) * num_rows);
+
+    for (m = 0; m < spmv_num_methods(); ++m)
+    {
+        const char  *name   = spmv_method_name(m);
+        spmv_plan_t plan    = spmv_plan_create(a, name, threads);
+        if (plan == NULL)
+        {
+            printf("%s, %s, fp64: skipped (%s)\n", layout, name, spmv_last_error());
+        }
+        else
+        {
+            int status = spmv_execute(plan, vector_x, vector_y);
+            int errors = (status == SPMV_SUCCESS) ? CompareResults(vector_y, reference, num_rows, 1e-12) : num_rows;
+            if (spmv_execute_s(plan, vector_x_s, vector_y_s) != SPMV_ERROR_TYPE_MISMATCH)
+                ++errors;
+            printf("%s, %s, fp64: %s\n", layout, name, errors ? "FAIL" : "PASS");
+            failures += (errors != 0);
+            spmv_plan_destroy(plan);
+        }
+
+        plan = spmv_plan_create(a_s, name, threads);
+        if (plan == NULL)
+        {
+            printf("%s, %s, fp32: skipped (%s)\n", layout, name, spmv_last_error());
+            continue;
+        }
+        if (spmv_execute_s(plan, vector_x_s, vector_y_s) != SPMV_SUCCESS)
+        {
+            ++failures;
+        }
+        else
+        {
+            int errors;
+            for (i = 0; i < num_rows; ++i)
+                widened[i] = vector_y_s[i];
+            errors = CompareResults(widened, reference, num_rows, 1e-5);
+            printf("%s, %s, fp32: %s\n", layout, name, errors ? "FAIL" : "PASS");
+            failures += (errors != 0);
+        }
+        spmv_plan_destroy(plan);
+    }
+
+    free(vector_y);
+    free(vector_y_s);
+    free(widened);
+    return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+    int     width       = (argc > 1) ? atoi(argv[1]) : 200;
+    int     threads     = (argc > 2) ? atoi(argv[2]) : 0;
+    int     num_rows    = width * width;
+    int     num_nonzeros = 0;
+    int     row, k, failures;
+
+    int     *row_offsets    = (int*) malloc(sizeof(int) * (num_rows + 1));
+    int     *column_indices = (int*) malloc(sizeof(int) * num_rows * 5);
+    double  *values         = (double*) malloc(sizeof(double) * num_rows * 5);
+    float   *values_s       = (float*) malloc(sizeof(float) * num_rows * 5);
+    double  *vector_x       = (double*) malloc(sizeof(double) * num_rows);
+    float   *vector_x_s     = (float*) malloc(sizeof(float) * num_rows);
+    double  *reference      = (double*) malloc(sizeof(double) * num_rows);
+
+    // 2D 5-point Laplacian (columns sorted within rows); x values exact in fp32
+    for (row = 0; row < num_rows; ++row)
+    {
+        int i = row / width, j = row % width;
+        row_offsets[row] = num_nonzeros;
+        if (i > 0)          { column_indices[num_nonzeros] = row - width;   values[num_nonzeros++] = -1.0; }
+        if (j > 0)          { column_indices[num_nonzeros] = row - 1;       values[num_nonzeros++] = -1.0; }
+                              column_indices[num_nonzeros] = row;           values[num_nonzeros++] = 4.0;
+        if (j < width - 1)  { column_indices[num_nonzeros] = row + 1;       values[num_nonzeros++] = -1.0; }
+        if (i < width - 1)  { column_indices[num_nonzeros] = row + width;   values[num_nonzeros++] = -1.0; }
+        vector_x[row]   = (double) (row % 64) / 8.0;
+        vector_x_s[row] = (float) vector_x[row];
+    }
+    row_offsets[num_rows] = num_nonzeros;
+    for (k = 0; k < num_nonzeros; ++k)
+        values_s[k] = (float) values[k];
+
+    SpmvGold(num_rows, row_offsets, column_indices, values, vector_x, reference);
+    printf("libmergespmv API version %d, %d methods, %d x %d matrix with %d nonzeros\n",
+        spmv_api_version(), spmv_num_methods(), num_rows, num_rows, num_nonzeros);
+
+    // Zero-based three-array CSR
+    {
+        spmv_csr_t a    = spmv_csr_create(num_rows, num_rows, num_nonzeros, row_offsets, column_indices, values);
+        spmv_csr_t a_s  = spmv_csr_create_s(num_rows, num_rows, num_nonzeros, row_offsets, column_indices, values_s);
+        if ((a == NULL) || (a_s == NULL))
+        {
+            fprintf(stderr, "spmv_csr_create: %s\n", spmv_last_error());
+            return 1;
+        }
+        failures = CheckMethods("csr", a, a_s, num_rows, vector_x, vector_x_s, reference, threads);
+        spmv_csr_destroy(a);
+        spmv_csr_destroy(a_s);
+    }
+
+    // One-based four-array CSR with a one-entry gap after every row
+    {
+        int     gapped_length   = num_nonzeros + num_rows;
+        int     *rows_start     = (int*) malloc(sizeof(int) * num_rows);
+        int     *rows_end       = (int*) malloc(sizeof(int) * num_rows);
+        int     *gapped_columns = (int*) malloc(sizeof(int) * gapped_length);
+        double  *gapped_values  = (double*) malloc(sizeof(double) * gapped_length);
+        float   *gapped_values_s = (float*) malloc(sizeof(float) * gapped_length);
+        int     stored          = 0;
+        spmv_csr_t a, a_s;
+
+        for (row = 0; row < num_rows; ++row)
+        {
+            rows_start[row] = stored + 1;
+            for (k = row_offsets[row]; k < row_offsets[row + 1]; ++k, ++stored)
+            {
+                gapped_columns[stored]  = column_indices[k] + 1;
+                gapped_values[stored]   = values[k];
+                gapped_values_s[stored] = values_s[k];
+            }
+            rows_end[row] = stored + 1;
+
+            // Gap: an entry that would corrupt the result if read
+            gapped_columns[stored]  = 1;
+            gapped_values[stored]   = 1e30;
+            gapped_values_s[stored] = 1e30f;
+            ++stored;
+        }
+
+        a   = spmv_csr_create_ends(num_rows, num_rows, rows_start, rows_end, gapped_columns, gapped_values, 1);
+        a_s = spmv_csr_create_ends_s(num_rows, num_rows, rows_start, rows_end, gapped_columns, gapped_values_s, 1);
+        if ((a == NULL) || (a_s == NULL))
+        {
+            fprintf(stderr, "spmv_csr_create_ends: %s\n", spmv_last_error());
+            return 1;
+        }
+        failures += CheckMethods("ends,base1", a, a_s, num_rows, vector_x, vector_x_s, reference, threads);
+        spmv_csr_destroy(a);
+        spmv_csr_destroy(a_s);
+
+        free(rows_start);
+        free(rows_end);
+        free(gapped_columns);
+        free(gapped_values);
+        free(gapped_values_s);
+    }
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+
+    free(row_offsets);
+    free(column_indices);
+    free(values);
+    free(values_s);
+    free(vector_x);
+    free(vector_x_s);
+    free(reference);
+    return (failures != 0);
+}
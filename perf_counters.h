@@ -0,0 +1,527 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * Hardware performance counters (Linux perf_event_open) and RAPL energy
+ * counters (Linux powercap)
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+    #include <glob.h>
+#endif
+
+
+/******************************************************************************
+ * Counter values
+ ******************************************************************************/
+
+enum PerfEvent
+{
+    PERF_EVENT_CYCLES,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_LLC_REFERENCES,
+    PERF_EVENT_LLC_MISSES,
+    PERF_EVENT_DTLB_MISSES,
+    NUM_PERF_EVENTS,
+};
+
+
+/**
+ * Counts accumulated by one thread (or summed over threads).  Counts of events
+ * that could not be opened are marked invalid.
+ */
+struct PerfCounterValues
+{
+    double      counts[NUM_PERF_EVENTS];
+    bool        valid[NUM_PERF_EVENTS];
+
+    PerfCounterValues()
+    {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+        {
+            counts[e] = 0.0;
+            valid[e] = false;
+        }
+    }
+
+    PerfCounterValues& operator+=(const PerfCounterValues &other)
+    {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+        {
+            counts[e] += other.counts[e];
+            valid[e] |= other.valid[e];
+        }
+        return *this;
+    }
+
+    /// Ratio of two counts, or -1 if either is unavailable
+    double Ratio(PerfEvent numerator, PerfEvent denominator) const
+    {
+        if (!valid[numerator] || !valid[denominator] || (counts[denominator] == 0.0))
+            return -1.0;
+        return counts[numerator] / counts[denominator];
+    }
+
+    /// Count per item (e.g., per nonzero), or -1 if unavailable
+    double Per(PerfEvent event, double items) const
+    {
+        return (valid[event] && (items > 0)) ? counts[event] / items : -1.0;
+    }
+};
+
+
+#ifdef __linux__
+
+/******************************************************************************
+ * Per-thread counter group
+ ******************************************************************************/
+
+/**
+ * One perf_event_open group counting the calling thread (on any CPU).  Events
+ * the PMU does not support are skipped.
+ */
+struct ThreadPerfCounters
+{
+    int     leader_fd;
+    int     fds[NUM_PERF_EVENTS];
+    int     num_open;
+    int     order[NUM_PERF_EVENTS];     // Event of each group member, in read order
+
+    ThreadPerfCounters() : leader_fd(-1), num_open(0)
+    {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+            fds[e] = -1;
+    }
+
+    static int Open(unsigned int type, unsigned long long config, int pid, int cpu, int group_fd)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.disabled       = (group_fd == -1) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return (int) syscall(__NR_perf_event_open, &attr, pid, cpu, group_fd, 0);
+    }
+
+    /**
+     * Open the group for the calling thread.  Returns false if not even the
+     * cycle counter is available (no PMU, or perf_event_paranoid too high).
+     */
+    bool OpenForCallingThread()
+    {
+        static const unsigned long long LLC_READ_MISS =
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        static const unsigned long long DTLB_READ_MISS =
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+        unsigned int        types[NUM_PERF_EVENTS]      = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE };
+        unsigned long long  configs[NUM_PERF_EVENTS]    = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, LLC_READ_MISS, DTLB_READ_MISS };
+
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+        {
+            fds[e] = Open(types[e], configs[e], 0, -1, leader_fd);
+            if (fds[e] < 0)
+            {
+                if (e == PERF_EVENT_CYCLES)
+                    return false;
+                continue;
+            }
+            if (leader_fd == -1)
+                leader_fd = fds[e];
+            order[num_open++] = e;
+        }
+        return true;
+    }
+
+    void Reset()    { if (leader_fd >= 0) ioctl(leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP); }
+    void Enable()   { if (leader_fd >= 0) ioctl(leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP); }
+    void Disable()  { if (leader_fd >= 0) ioctl(leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP); }
+
+    /**
+     * Read the group, scaling for multiplexing
+     */
+    PerfCounterValues Read()
+    {
+        PerfCounterValues values;
+        if (leader_fd < 0)
+            return values;
+
+        unsigned long long buffer[3 + NUM_PERF_EVENTS];
+        if (read(leader_fd, buffer, sizeof(buffer)) < ssize_t(sizeof(unsigned long long) * (3 + num_open)))
+            return values;
+
+        unsigned long long  nr              = buffer[0];
+        double              time_enabled    = double(buffer[1]);
+        double              time_running    = double(buffer[2]);
+        double              scale           = (time_running > 0) ? time_enabled / time_running : 0.0;
+
+        for (int i = 0; (i < int(nr)) && (i < num_open); ++i)
+        {
+            values.counts[order[i]] = double(buffer[3 + i]) * scale;
+            values.valid[order[i]]  = (time_running > 0);
+        }
+        return values;
+    }
+
+    void Close()
+    {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+        {
+            if (fds[e] >= 0)
+                close(fds[e]);
+            fds[e] = -1;
+        }
+        leader_fd = -1;
+        num_open = 0;
+    }
+};
+
+
+/******************************************************************************
+ * Uncore memory-controller counters
+ ******************************************************************************/
+
+/**
+ * DRAM traffic from the uncore integrated memory controllers (Intel
+ * uncore_imc_* PMUs, CAS reads and writes of 64 bytes each).  Counts
+ * system-wide, so other activity on the machine is included.
+ */
+struct UncoreImcCounters
+{
+    std::vector<int> fds;
+
+    /// Parse "event=0x04,umask=0x03" into a raw config
+    static bool ParseEvent(const std::string &path, unsigned long long &config)
+    {
+        std::ifstream ifs(path.c_str());
+        std::string spec;
+        if (!(ifs >> spec))
+            return false;
+
+        unsigned long long event = 0, umask = 0;
+        const char *event_pos = strstr(spec.c_str(), "event=");
+        const char *umask_pos = strstr(spec.c_str(), "umask=");
+        if (!event_pos)
+            return false;
+        event = strtoull(event_pos + 6, NULL, 0);
+        if (umask_pos)
+            umask = strtoull(umask_pos + 6, NULL, 0);
+
+        config = event | (umask << 8);
+        return true;
+    }
+
+    bool Open()
+    {
+        glob_t pmus;
+        if (glob("/sys/bus/event_source/devices/uncore_imc*", 0, NULL, &pmus) != 0)
+            return false;
+
+        for (size_t p = 0; p < pmus.gl_pathc; ++p)
+        {
+            std::string dir(pmus.gl_pathv[p]);
+
+            unsigned int type;
+            std::ifstream type_file((dir + "/type").c_str());
+            if (!(type_file >> type))
+                continue;
+
+            // One CPU per socket is listed in the PMU's cpumask
+            std::vector<int> cpus;
+            std::ifstream cpumask_file((dir + "/cpumask").c_str());
+            std::string cpumask;
+            if (cpumask_file >> cpumask)
+            {
+                const char *c = cpumask.c_str();
+                while (*c)
+                {
+                    char *next;
+                    cpus.push_back(int(strtol(c, &next, 10)));
+                    if ((next == c) || (*next != ','))
+                        break;
+                    c = next + 1;
+                }
+            }
+            if (cpus.empty())
+                cpus.push_back(0);
+
+            const char *events[2] = { "/events/cas_count_read", "/events/cas_count_write" };
+            for (int ev = 0; ev < 2; ++ev)
+            {
+                unsigned long long config;
+                if (!ParseEvent(dir + events[ev], config))
+                    continue;
+
+                for (size_t c = 0; c < cpus.size(); ++c)
+                {
+                    perf_event_attr attr;
+                    memset(&attr, 0, sizeof(attr));
+                    attr.size       = sizeof(attr);
+                    attr.type       = type;
+                    attr.config     = config;
+                    attr.disabled   = 1;
+
+                    int fd = (int) syscall(__NR_perf_event_open, &attr, -1, cpus[c], -1, 0);
+                    if (fd >= 0)
+                        fds.push_back(fd);
+                }
+            }
+        }
+        globfree(&pmus);
+        return !fds.empty();
+    }
+
+    void Reset()    { for (size_t i = 0; i < fds.size(); ++i) ioctl(fds[i], PERF_EVENT_IOC_RESET, 0); }
+    void Enable()   { for (size_t i = 0; i < fds.size(); ++i) ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0); }
+    void Disable()  { for (size_t i = 0; i < fds.size(); ++i) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0); }
+
+    /// DRAM bytes read and written since the last reset
+    double ReadBytes()
+    {
+        double bytes = 0.0;
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            unsigned long long count = 0;
+            if (read(fds[i], &count, sizeof(count)) == sizeof(count))
+                bytes += double(count) * 64.0;
+        }
+        return bytes;
+    }
+
+    void Close()
+    {
+        for (size_t i = 0; i < fds.size(); ++i)
+            close(fds[i]);
+        fds.clear();
+    }
+};
+
+#endif // __linux__
+
+
+/******************************************************************************
+ * Counters for a team of OpenMP threads
+ ******************************************************************************/
+
+/**
+ * Per-thread counter groups for the OpenMP team of num_threads threads (opened
+ * from inside a parallel region so each group follows its own thread), plus
+ * system-wide DRAM traffic where the uncore PMUs are accessible.
+ */
+struct PerfCounters
+{
+    int                                 num_threads;
+    bool                                core_available;
+    bool                                dram_available;
+#ifdef __linux__
+    std::vector<ThreadPerfCounters>     threads;
+    UncoreImcCounters                   imc;
+#endif
+
+    PerfCounters() : num_threads(0), core_available(false), dram_available(false) {}
+
+    ~PerfCounters()
+    {
+        Close();
+    }
+
+    /**
+     * Open counters for each thread of the team.  Returns false if no core
+     * counters are available.
+     */
+    bool Init(int num_threads)
+    {
+        this->num_threads = num_threads;
+#ifdef __linux__
+        threads.resize(num_threads);
+
+        int num_opened = 0;
+        #pragma omp parallel for schedule(static) num_threads(num_threads) reduction(+:num_opened)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            if (threads[tid].OpenForCallingThread())
+                num_opened++;
+        }
+
+        core_available = (num_opened == num_threads);
+        dram_available = imc.Open();
+#endif
+        return core_available;
+    }
+
+    void Start()
+    {
+#ifdef __linux__
+        for (int tid = 0; tid < int(threads.size()); ++tid)
+        {
+            threads[tid].Reset();
+            threads[tid].Enable();
+        }
+        imc.Reset();
+        imc.Enable();
+#endif
+    }
+
+    void Stop()
+    {
+#ifdef __linux__
+        imc.Disable();
+        for (int tid = 0; tid < int(threads.size()); ++tid)
+            threads[tid].Disable();
+#endif
+    }
+
+    /// Read each thread's counts and the DRAM bytes (-1 if unavailable)
+    void Read(std::vector<PerfCounterValues> &thread_values, double &dram_bytes)
+    {
+        thread_values.assign(num_threads, PerfCounterValues());
+        dram_bytes = -1.0;
+#ifdef __linux__
+        for (int tid = 0; tid < int(threads.size()); ++tid)
+            thread_values[tid] = threads[tid].Read();
+        if (dram_available)
+            dram_bytes = imc.ReadBytes();
+#endif
+    }
+
+    void Close()
+    {
+#ifdef __linux__
+        for (int tid = 0; tid < int(threads.size()); ++tid)
+            threads[tid].Close();
+        threads.clear();
+        imc.Close();
+#endif
+        core_available = false;
+        dram_available = false;
+    }
+};
+
+
+
+/******************************************************************************
+ * RAPL energy counters
+ ******************************************************************************/
+
+/**
+ * Package and DRAM energy from the Linux powercap RAPL zones
+ * (/sys/class/powercap/intel-rapl:*, which recent AMD processors also
+ * expose).  The counters are per socket, so other activity on the machine is
+ * included, and they update about once a millisecond.  energy_uj is often
+ * readable by root only.
+ */
+struct RaplCounters
+{
+    struct Zone
+    {
+        std::string     energy_path;
+        bool            dram;
+        double          max_uj;         // Counter range (it wraps to zero)
+        double          start_uj;
+    };
+
+    std::vector<Zone>   zones;
+
+    static bool ReadNumber(const std::string &path, double &value)
+    {
+        std::ifstream ifs(path.c_str());
+        return bool(ifs >> value);
+    }
+
+    /// Find the readable package and DRAM zones.  Returns false if there are none.
+    bool Open()
+    {
+        zones.clear();
+#ifdef __linux__
+        glob_t paths;
+        if (glob("/sys/class/powercap/intel-rapl:*", 0, NULL, &paths) != 0)
+            return false;
+
+        for (size_t p = 0; p < paths.gl_pathc; ++p)
+        {
+            std::string dir(paths.gl_pathv[p]);
+            std::string name;
+            std::ifstream name_file((dir + "/name").c_str());
+            if (!(name_file >> name) || ((name.compare(0, 7, "package") != 0) && (name != "dram")))
+                continue;
+
+            Zone zone;
+            zone.energy_path    = dir + "/energy_uj";
+            zone.dram           = (name == "dram");
+            zone.start_uj       = 0;
+            if (!ReadNumber(dir + "/max_energy_range_uj", zone.max_uj) || !ReadNumber(zone.energy_path, zone.start_uj))
+                continue;
+            zones.push_back(zone);
+        }
+        globfree(&paths);
+#endif
+        return !zones.empty();
+    }
+
+    void Start()
+    {
+        for (size_t z = 0; z < zones.size(); ++z)
+            ReadNumber(zones[z].energy_path, zones[z].start_uj);
+    }
+
+    /// Joules of the package and DRAM zones since Start() (-1 if a domain is unavailable)
+    void Stop(double &package_joules, double &dram_joules)
+    {
+        package_joules  = -1;
+        dram_joules     = -1;
+        for (size_t z = 0; z < zones.size(); ++z)
+        {
+            double end_uj;
+            if (!ReadNumber(zones[z].energy_path, end_uj))
+                continue;
+            double delta_uj = (end_uj >= zones[z].start_uj) ? end_uj - zones[z].start_uj : end_uj + zones[z].max_uj - zones[z].start_uj;
+
+            double &joules = zones[z].dram ? dram_joules : package_joules;
+            joules = std::max(joules, 0.0) + delta_uj / 1.0e6;
+        }
+    }
+};
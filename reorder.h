@@ -0,0 +1,954 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/******************************************************************************
+ * Column-locality reorderings (Reverse Cuthill-McKee, degree sort, Gorder)
+ * and multilevel graph partitioning
+ ******************************************************************************/
+
+#pragma once
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "sparse_matrix.h"
+
+
+/******************************************************************************
+ * Symmetric pattern
+ ******************************************************************************/
+
+/**
+ * Adjacency of the pattern of A + A^T without the diagonal, which the
+ * orderings treat as an undirected graph.  Neighbor lists are sorted and free
+ * of duplicates.
+ */
+template <typename OffsetT>
+struct SymmetricPattern
+{
+    OffsetT                 num_vertices;
+    std::vector<OffsetT>    offsets;
+    std::vector<OffsetT>    neighbors;
+
+    SymmetricPattern() : num_vertices(0) {}
+
+    OffsetT Degree(OffsetT vertex) const
+    {
+        return offsets[vertex + 1] - offsets[vertex];
+    }
+
+    template <typename ValueT>
+    void Init(CsrMatrix<ValueT, OffsetT> &csr_matrix)
+    {
+        num_vertices = csr_matrix.num_rows;
+        offsets.assign(num_vertices + 1, 0);
+
+        // Count the off-diagonal entries of A and A^T
+        OffsetT *counts = &offsets[0];
+
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (OffsetT row = 0; row < num_vertices; ++row)
+        {
+            for (OffsetT nz = csr_matrix.row_offsets[row]; nz < csr_matrix.row_offsets[row + 1]; ++nz)
+            {
+                OffsetT col = csr_matrix.column_indices[nz];
+                if (col == row)
+                    continue;
+
+                #pragma omp atomic
+                counts[row + 1]++;
+                #pragma omp atomic
+                counts[col + 1]++;
+            }
+        }
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            counts[vertex + 1] += counts[vertex];
+
+        // Place them
+        std::vector<OffsetT> cursors(offsets.begin(), offsets.end() - 1);
+        std::vector<OffsetT> entries(offsets[num_vertices] > 0 ? offsets[num_vertices] : 1);
+        OffsetT *cursor = &cursors[0];
+        OffsetT *entry  = &entries[0];
+
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (OffsetT row = 0; row < num_vertices; ++row)
+        {
+            for (OffsetT nz = csr_matrix.row_offsets[row]; nz < csr_matrix.row_offsets[row + 1]; ++nz)
+            {
+                OffsetT col = csr_matrix.column_indices[nz];
+                if (col == row)
+                    continue;
+
+                OffsetT slot;
+                #pragma omp atomic capture
+                slot = cursor[row]++;
+                entry[slot] = col;
+
+                #pragma omp atomic capture
+                slot = cursor[col]++;
+                entry[slot] = row;
+            }
+        }
+
+        // Sort and deduplicate each list, then compact
+        std::vector<OffsetT> lengths(num_vertices + 1, 0);
+
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+        {
+            std::sort(entry + offsets[vertex], entry + offsets[vertex + 1]);
+            lengths[vertex + 1] = OffsetT(std::unique(entry + offsets[vertex], entry + offsets[vertex + 1]) - (entry + offsets[vertex]));
+        }
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            lengths[vertex + 1] += lengths[vertex];
+
+        neighbors.resize(lengths[num_vertices]);
+
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            std::copy(entry + offsets[vertex], entry + offsets[vertex] + (lengths[vertex + 1] - lengths[vertex]),
+                neighbors.begin() + lengths[vertex]);
+
+        offsets.swap(lengths);
+    }
+
+    /**
+     * Vertices sorted by degree (ascending or descending), ties in vertex
+     * order: a counting sort over a histogram of the degrees
+     */
+    void SortByDegree(bool descending, std::vector<OffsetT> &order) const
+    {
+        OffsetT max_degree = 0;
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            max_degree = std::max(max_degree, Degree(vertex));
+
+        std::vector<OffsetT> starts(max_degree + 2, 0);
+        OffsetT *start = &starts[0];
+
+        #pragma omp parallel for schedule(static)
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+        {
+            OffsetT bucket = descending ? max_degree - Degree(vertex) : Degree(vertex);
+            #pragma omp atomic
+            start[bucket + 1]++;
+        }
+        for (OffsetT bucket = 0; bucket <= max_degree; ++bucket)
+            starts[bucket + 1] += starts[bucket];
+
+        order.resize(num_vertices);
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+        {
+            OffsetT bucket = descending ? max_degree - Degree(vertex) : Degree(vertex);
+            order[starts[bucket]++] = vertex;
+        }
+    }
+};
+
+
+/******************************************************************************
+ * Orderings
+ ******************************************************************************/
+
+/**
+ * Relabel by descending degree in A + A^T, so the rows and vector_x entries
+ * of hub vertices are packed together at the front
+ */
+template <typename ValueT, typename OffsetT>
+void DegreeOrdering(CsrMatrix<ValueT, OffsetT> &csr_matrix, OffsetT *relabel)
+{
+    SymmetricPattern<OffsetT> pattern;
+    pattern.Init(csr_matrix);
+
+    std::vector<OffsetT> order;
+    pattern.SortByDegree(true, order);
+
+    #pragma omp parallel for schedule(static)
+    for (OffsetT position = 0; position < pattern.num_vertices; ++position)
+        relabel[order[position]] = position;
+}
+
+
+/**
+ * Expand a BFS level: the vertices adjacent to the frontier whose mark is not
+ * yet stamp, each once (in no particular order), marked with stamp
+ */
+template <typename OffsetT>
+void ExpandLevel(
+    const SymmetricPattern<OffsetT>&    pattern,
+    const OffsetT*                      frontier,
+    OffsetT                             frontier_size,
+    int*                                marks,
+    int                                 stamp,
+    std::vector<OffsetT>&               next)
+{
+    next.clear();
+
+    #pragma omp parallel
+    {
+        std::vector<OffsetT> local;
+
+        #pragma omp for schedule(dynamic, 64) nowait
+        for (OffsetT f = 0; f < frontier_size; ++f)
+        {
+            OffsetT vertex = frontier[f];
+            for (OffsetT n = pattern.offsets[vertex]; n < pattern.offsets[vertex + 1]; ++n)
+            {
+                OffsetT neighbor = pattern.neighbors[n];
+                int previous;
+                #pragma omp atomic capture
+                { previous = marks[neighbor]; marks[neighbor] = stamp; }
+                if (previous != stamp)
+                    local.push_back(neighbor);
+            }
+        }
+
+        #pragma omp critical
+        next.insert(next.end(), local.begin(), local.end());
+    }
+}
+
+
+/**
+ * Depth of the BFS from root, with the vertices of its last level in last_level
+ */
+template <typename OffsetT>
+int BfsDepth(
+    const SymmetricPattern<OffsetT>&    pattern,
+    OffsetT                             root,
+    int*                                marks,
+    int&                                stamp,
+    std::vector<OffsetT>&               last_level)
+{
+    std::vector<OffsetT> level(1, root), next;
+    marks[root] = ++stamp;
+
+    int depth = 0;
+    while (true)
+    {
+        ExpandLevel(pattern, &level[0], OffsetT(level.size()), marks, stamp, next);
+        if (next.empty())
+            break;
+        level.swap(next);
+        ++depth;
+    }
+    last_level.swap(level);
+    return depth;
+}
+
+
+/**
+ * Reverse Cuthill-McKee ordering of A + A^T.  Each connected component
+ * starts from a pseudo-peripheral vertex (George-Liu: repeated BFS from the
+ * lowest-degree vertex of the deepest level), and is then numbered level by
+ * level.  Levels are expanded in parallel: each new vertex goes to its
+ * lowest-numbered neighbor in the current level, and the children of each
+ * parent are numbered by ascending degree, which gives the same numbering as
+ * sequential Cuthill-McKee.  The numbering is reversed at the end.
+ */
+template <typename ValueT, typename OffsetT>
+void RcmOrdering(CsrMatrix<ValueT, OffsetT> &csr_matrix, OffsetT *relabel)
+{
+    SymmetricPattern<OffsetT> pattern;
+    pattern.Init(csr_matrix);
+
+    OffsetT                 num_vertices = pattern.num_vertices;
+    std::vector<OffsetT>    by_degree;
+    std::vector<OffsetT>    order(num_vertices);
+    std::vector<OffsetT>    positions(num_vertices, -1);
+    std::vector<int>        marks(num_vertices, 0);
+    std::vector<OffsetT>    last_level, candidates, parents, starts;
+    int                     stamp = 0;
+
+    pattern.SortByDegree(false, by_degree);
+
+    OffsetT placed = 0;
+    for (OffsetT cursor = 0; cursor < num_vertices; ++cursor)
+    {
+        if (positions[by_degree[cursor]] >= 0)
+            continue;
+
+        // Pseudo-peripheral root of this component
+        OffsetT root    = by_degree[cursor];
+        int     depth   = BfsDepth(pattern, root, &marks[0], stamp, last_level);
+        for (int sweep = 0; (sweep < 8) && (depth > 0); ++sweep)
+        {
+            OffsetT candidate = last_level[0];
+            for (size_t i = 1; i < last_level.size(); ++i)
+            {
+                OffsetT vertex = last_level[i];
+                if ((pattern.Degree(vertex) < pattern.Degree(candidate)) ||
+                    ((pattern.Degree(vertex) == pattern.Degree(candidate)) && (vertex < candidate)))
+                    candidate = vertex;
+            }
+
+            std::vector<OffsetT> candidate_level;
+            int candidate_depth = BfsDepth(pattern, candidate, &marks[0], stamp, candidate_level);
+            if (candidate_depth <= depth)
+                break;
+            root    = candidate;
+            depth   = candidate_depth;
+            last_level.swap(candidate_level);
+        }
+
+        // Cuthill-McKee numbering, level by level
+        OffsetT level_begin = placed;
+        order[placed]       = root;
+        positions[root]     = placed++;
+        marks[root]         = ++stamp;
+
+        while (level_begin < placed)
+        {
+            OffsetT level_end = placed;
+            ExpandLevel(pattern, &order[level_begin], level_end - level_begin, &marks[0], stamp, candidates);
+            OffsetT num_candidates = OffsetT(candidates.size());
+
+            // Parent of each candidate: its lowest-numbered neighbor (all numbered neighbors are in this level)
+            parents.resize(num_candidates);
+            starts.assign(level_end - level_begin + 1, 0);
+            OffsetT *start = &starts[0];
+
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (OffsetT c = 0; c < num_candidates; ++c)
+            {
+                OffsetT vertex = candidates[c];
+                OffsetT parent = level_end;
+                for (OffsetT n = pattern.offsets[vertex]; n < pattern.offsets[vertex + 1]; ++n)
+                {
+                    OffsetT position = positions[pattern.neighbors[n]];
+                    if ((position >= level_begin) && (position < parent))
+                        parent = position;
+                }
+                parents[c] = parent - level_begin;
+
+                #pragma omp atomic
+                start[parents[c] + 1]++;
+            }
+            for (OffsetT p = 0; p < level_end - level_begin; ++p)
+                starts[p + 1] += starts[p];
+
+            // Group the candidates by parent, then order each group by degree
+            std::vector<OffsetT> cursors(starts.begin(), starts.end() - 1);
+            OffsetT *slot_cursor    = &cursors[0];
+            OffsetT *next_level     = &order[level_end];
+
+            #pragma omp parallel for schedule(static)
+            for (OffsetT c = 0; c < num_candidates; ++c)
+            {
+                OffsetT slot;
+                #pragma omp atomic capture
+                slot = slot_cursor[parents[c]]++;
+                next_level[slot] = candidates[c];
+            }
+
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (OffsetT p = 0; p < level_end - level_begin; ++p)
+            {
+                for (OffsetT i = starts[p] + 1; i < starts[p + 1]; ++i)
+                {
+                    // Insertion sort by (degree, vertex); groups are small
+                    OffsetT vertex = next_level[i];
+                    OffsetT j = i;
+                    while ((j > starts[p]) &&
+                        ((pattern.Degree(next_level[j - 1]) > pattern.Degree(vertex)) ||
+                            ((pattern.Degree(next_level[j - 1]) == pattern.Degree(vertex)) && (next_level[j - 1] > vertex))))
+                    {
+                        next_level[j] = next_level[j - 1];
+                        --j;
+                    }
+                    next_level[j] = vertex;
+                }
+            }
+
+            #pragma omp parallel for schedule(static)
+            for (OffsetT c = 0; c < num_candidates; ++c)
+                positions[next_level[c]] = level_end + c;
+
+            level_begin = level_end;
+            placed      = level_end + num_candidates;
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+        relabel[vertex] = num_vertices - 1 - positions[vertex];
+}
+
+
+/**
+ * Max-priority queue over vertices whose keys change by one at a time
+ * (Gorder's unit heap): a doubly-linked list per key, so updates are O(1)
+ */
+template <typename OffsetT>
+struct UnitHeap
+{
+    std::vector<OffsetT>    keys;
+    std::vector<OffsetT>    prev;
+    std::vector<OffsetT>    next;
+    std::vector<OffsetT>    heads;      // First vertex of each key's list (-1 if empty)
+    OffsetT                 top;        // No list above this key is non-empty
+
+    void Init(OffsetT num_vertices)
+    {
+        keys.assign(num_vertices, 0);
+        prev.assign(num_vertices, -1);
+        next.assign(num_vertices, -1);
+        heads.assign(1, -1);
+        top = 0;
+    }
+
+    void Insert(OffsetT vertex)
+    {
+        OffsetT key = keys[vertex];
+        if (key >= OffsetT(heads.size()))
+            heads.resize(key + 1, -1);
+
+        prev[vertex] = -1;
+        next[vertex] = heads[key];
+        if (heads[key] >= 0)
+            prev[heads[key]] = vertex;
+        heads[key] = vertex;
+        top = std::max(top, key);
+    }
+
+    void Remove(OffsetT vertex)
+    {
+        if (prev[vertex] >= 0)
+            next[prev[vertex]] = next[vertex];
+        else
+            heads[keys[vertex]] = next[vertex];
+        if (next[vertex] >= 0)
+            prev[next[vertex]] = prev[vertex];
+    }
+
+    void Add(OffsetT vertex, int delta)
+    {
+        Remove(vertex);
+        keys[vertex] += delta;
+        Insert(vertex);
+    }
+
+    /// Remove and return a vertex of the largest key (the most recently updated)
+    OffsetT PopMax()
+    {
+        while (heads[top] < 0)
+            --top;
+        OffsetT vertex = heads[top];
+        Remove(vertex);
+        return vertex;
+    }
+};
+
+
+/**
+ * Gorder (Wei et al., SIGMOD 2016) on A + A^T: vertices are placed greedily,
+ * each time picking the unplaced vertex with the most neighbors and shared
+ * neighbors among the last window placed ones, so rows that gather the same
+ * vector_x entries end up close together.  As in the paper, vertices with
+ * more than sqrt(n) neighbors are not expanded for shared neighbors.  The
+ * greedy placement is sequential.
+ */
+template <typename ValueT, typename OffsetT>
+void GorderOrdering(CsrMatrix<ValueT, OffsetT> &csr_matrix, OffsetT *relabel, int window = 5)
+{
+    SymmetricPattern<OffsetT> pattern;
+    pattern.Init(csr_matrix);
+
+    OffsetT                 num_vertices    = pattern.num_vertices;
+    OffsetT                 hub_degree      = std::max(OffsetT(16), OffsetT(sqrt(double(num_vertices))));
+    std::vector<OffsetT>    order(num_vertices);
+    std::vector<char>       placed(num_vertices, 0);
+
+    // Insert by ascending degree so ties go to the highest degree
+    std::vector<OffsetT> by_degree;
+    pattern.SortByDegree(false, by_degree);
+
+    UnitHeap<OffsetT> heap;
+    heap.Init(num_vertices);
+    for (OffsetT i = 0; i < num_vertices; ++i)
+        heap.Insert(by_degree[i]);
+
+    for (OffsetT i = 0; i < num_vertices; ++i)
+    {
+        OffsetT vertex = heap.PopMax();
+        order[i]        = vertex;
+        placed[vertex]  = 1;
+
+        // The new vertex enters the window, and the oldest one leaves it
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            if ((pass == 1) && (i < window))
+                break;
+            OffsetT changed = (pass == 0) ? vertex : order[i - window];
+            int     delta   = (pass == 0) ? 1 : -1;
+
+            for (OffsetT n = pattern.offsets[changed]; n < pattern.offsets[changed + 1]; ++n)
+            {
+                OffsetT neighbor = pattern.neighbors[n];
+                if (!placed[neighbor])
+                    heap.Add(neighbor, delta);
+
+                if (pattern.Degree(neighbor) > hub_degree)
+                    continue;
+                for (OffsetT s = pattern.offsets[neighbor]; s < pattern.offsets[neighbor + 1]; ++s)
+                {
+                    OffsetT sibling = pattern.neighbors[s];
+                    if ((sibling != changed) && !placed[sibling])
+                        heap.Add(sibling, delta);
+                }
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (OffsetT position = 0; position < num_vertices; ++position)
+        relabel[order[position]] = position;
+}
+
+
+/**
+ * Whether name is one of the orderings accepted by ComputeOrdering()
+ */
+inline bool IsOrderingName(const std::string &name)
+{
+    return (name == "rcm") || (name == "degree") || (name == "gorder");
+}
+
+
+/**
+ * Relabelling of a square matrix by the named ordering ("rcm", "degree", or
+ * "gorder"), as relabel[old] = new for CooMatrix::InitCsrRelabel()
+ */
+template <typename ValueT, typename OffsetT>
+void ComputeOrdering(const std::string &name, CsrMatrix<ValueT, OffsetT> &csr_matrix, OffsetT *relabel)
+{
+    if (name == "rcm")
+        RcmOrdering(csr_matrix, relabel);
+    else if (name == "degree")
+        DegreeOrdering(csr_matrix, relabel);
+    else if (name == "gorder")
+        GorderOrdering(csr_matrix, relabel);
+    else
+    {
+        fprintf(stderr, "Unknown reordering '%s' (expected rcm, degree, or gorder)\n", name.c_str());
+        exit(1);
+    }
+}
+
+
+/******************************************************************************
+ * Multilevel graph partitioning
+ ******************************************************************************/
+
+/**
+ * Undirected graph with vertex and edge weights, as coarsened by
+ * MultilevelPartition()
+ */
+template <typename OffsetT>
+struct WeightedGraph
+{
+    std::vector<OffsetT>    offsets;
+    std::vector<OffsetT>    adjacency;
+    std::vector<long long>  edge_weights;
+    std::vector<long long>  vertex_weights;
+
+    OffsetT NumVertices() const
+    {
+        return OffsetT(vertex_weights.size());
+    }
+
+    long long TotalWeight() const
+    {
+        long long total = 0;
+        for (OffsetT vertex = 0; vertex < NumVertices(); ++vertex)
+            total += vertex_weights[vertex];
+        return total;
+    }
+
+    /**
+     * Contract a heavy-edge matching: vertices are visited by ascending
+     * degree, each matched to the unmatched neighbor it shares the heaviest
+     * edge with, unless their combined weight exceeds max_vertex_weight.
+     * coarse_map gives the coarse vertex of each vertex.
+     */
+    void Coarsen(long long max_vertex_weight, WeightedGraph &coarse, std::vector<OffsetT> &coarse_map) const
+    {
+        OffsetT                 num_vertices = NumVertices();
+        std::vector<OffsetT>    order(num_vertices);
+        std::vector<OffsetT>    match(num_vertices, -1);
+
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            order[vertex] = vertex;
+        std::stable_sort(order.begin(), order.end(), DegreeLess(offsets));
+
+        for (OffsetT i = 0; i < num_vertices; ++i)
+        {
+            OffsetT vertex = order[i];
+            if (match[vertex] >= 0)
+                continue;
+
+            OffsetT     mate        = vertex;
+            long long   mate_weight = -1;
+            for (OffsetT n = offsets[vertex]; n < offsets[vertex + 1]; ++n)
+            {
+                OffsetT neighbor = adjacency[n];
+                if ((match[neighbor] < 0) && (neighbor != vertex) &&
+                    (vertex_weights[vertex] + vertex_weights[neighbor] <= max_vertex_weight) &&
+                    (edge_weights[n] > mate_weight))
+                {
+                    mate        = neighbor;
+                    mate_weight = edge_weights[n];
+                }
+            }
+            match[vertex]   = mate;
+            match[mate]     = vertex;
+        }
+
+        OffsetT num_coarse = 0;
+        coarse_map.resize(num_vertices);
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            if (vertex <= match[vertex])
+                coarse_map[vertex] = coarse_map[match[vertex]] = num_coarse++;
+
+        // Merge the neighbor lists of each pair, summing parallel edges
+        coarse.offsets.assign(1, 0);
+        coarse.adjacency.clear();
+        coarse.edge_weights.clear();
+        coarse.vertex_weights.clear();
+        std::vector<long long> slots(num_coarse, -1);
+
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+        {
+            if (vertex > match[vertex])
+                continue;
+
+            OffsetT     coarse_vertex   = coarse_map[vertex];
+            long long   begin           = (long long) coarse.adjacency.size();
+            long long   weight          = vertex_weights[vertex];
+            if (match[vertex] != vertex)
+                weight += vertex_weights[match[vertex]];
+
+            for (int member = 0; member < ((match[vertex] != vertex) ? 2 : 1); ++member)
+            {
+                OffsetT fine = (member == 0) ? vertex : match[vertex];
+                for (OffsetT n = offsets[fine]; n < offsets[fine + 1]; ++n)
+                {
+                    OffsetT coarse_neighbor = coarse_map[adjacency[n]];
+                    if (coarse_neighbor == coarse_vertex)
+                        continue;
+
+                    long long slot = slots[coarse_neighbor];
+                    if ((slot >= begin) && (coarse.adjacency[slot] == coarse_neighbor))
+                    {
+                        coarse.edge_weights[slot] += edge_weights[n];
+                    }
+                    else
+                    {
+                        slots[coarse_neighbor] = (long long) coarse.adjacency.size();
+                        coarse.adjacency.push_back(coarse_neighbor);
+                        coarse.edge_weights.push_back(edge_weights[n]);
+                    }
+                }
+            }
+            coarse.offsets.push_back(OffsetT(coarse.adjacency.size()));
+            coarse.vertex_weights.push_back(weight);
+        }
+    }
+
+    /**
+     * Greedy k-way boundary refinement: move vertices to the neighboring part
+     * they are most connected to when that reduces the edge cut without
+     * exceeding max_part_weight, or keeps the cut and improves the balance.
+     * Vertices of a part over max_part_weight move to their best-connected
+     * neighboring part with room, even if the cut grows.
+     */
+    void Refine(int num_parts, long long max_part_weight, std::vector<int> &parts, int max_passes = 8) const
+    {
+        OffsetT                 num_vertices = NumVertices();
+        std::vector<long long>  part_weights(num_parts, 0);
+        std::vector<long long>  connection(num_parts, 0);
+        std::vector<int>        touched;
+
+        for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            part_weights[parts[vertex]] += vertex_weights[vertex];
+
+        for (int pass = 0; pass < max_passes; ++pass)
+        {
+            OffsetT moves = 0;
+            for (OffsetT vertex = 0; vertex < num_vertices; ++vertex)
+            {
+                int from = parts[vertex];
+                touched.clear();
+                for (OffsetT n = offsets[vertex]; n < offsets[vertex + 1]; ++n)
+                {
+                    int part = parts[adjacency[n]];
+                    if (connection[part] == 0)
+                        touched.push_back(part);
+                    connection[part] += edge_weights[n];
+                }
+
+                // Vertices of overweight parts move even at a loss
+                int         best        = from;
+                long long   best_gain   = (part_weights[from] > max_part_weight) ? std::numeric_limits<long long>::min() : 0;
+                for (size_t t = 0; t < touched.size(); ++t)
+                {
+                    int         part    = touched[t];
+                    long long   gain    = connection[part] - connection[from];
+                    if ((part == from) || (part_weights[part] + vertex_weights[vertex] > max_part_weight))
+                        continue;
+                    if ((gain > best_gain) ||
+                        ((gain == best_gain) && (part_weights[part] + vertex_weights[vertex] < part_weights[(best == from) ? from : best])))
+                    {
+                        best        = part;
+                        best_gain   = gain;
+                    }
+                }
+                for (size_t t = 0; t < touched.size(); ++t)
+                    connection[touched[t]] = 0;
+
+                if (best != from)
+                {
+                    parts[vertex] = best;
+                    part_weights[from] -= vertex_weights[vertex];
+                    part_weights[best] += vertex_weights[vertex];
+                    ++moves;
+                }
+            }
+            if (moves == 0)
+                break;
+        }
+    }
+
+    /// Orders vertices by degree
+    struct DegreeLess
+    {
+        const std::vector<OffsetT> &offsets;
+
+        DegreeLess(const std::vector<OffsetT> &offsets) : offsets(offsets) {}
+
+        bool operator()(OffsetT a, OffsetT b) const
+        {
+            return (offsets[a + 1] - offsets[a]) < (offsets[b + 1] - offsets[b]);
+        }
+    };
+};
+
+
+/**
+ * Quality of a partition of the pattern of A + A^T
+ */
+struct PartitionStats
+{
+    int         levels;             // Graphs in the multilevel hierarchy (including the original)
+    long long   edge_cut;           // Edges of A + A^T between parts
+    long long   total_edges;
+    double      imbalance;          // Heaviest part over the average part weight
+};
+
+
+/**
+ * Multilevel k-way partitioning of the pattern of A + A^T (in the manner of
+ * METIS): coarsen by heavy-edge matching until about 20 vertices per part
+ * remain, split the coarsest graph into parts of equal weight along a BFS
+ * order, then project back level by level with greedy boundary refinement
+ * at each.  Vertices weigh their row length + 1, their share of the merge
+ * path, so balanced parts line up with merge-path partitions.  Parts are
+ * kept within 3% of the average weight where the coarse vertex weights
+ * allow it.  Sequential and deterministic.
+ */
+template <typename ValueT, typename OffsetT>
+PartitionStats MultilevelPartition(CsrMatrix<ValueT, OffsetT> &csr_matrix, int num_parts, std::vector<int> &parts)
+{
+    SymmetricPattern<OffsetT> pattern;
+    pattern.Init(csr_matrix);
+
+    // Finest level
+    std::vector<WeightedGraph<OffsetT> >    graphs(1);
+    std::vector<std::vector<OffsetT> >      coarse_maps;
+    graphs[0].offsets       = pattern.offsets;
+    graphs[0].adjacency     = pattern.neighbors;
+    graphs[0].edge_weights.assign(pattern.neighbors.size(), 1);
+    graphs[0].vertex_weights.resize(pattern.num_vertices);
+    for (OffsetT row = 0; row < pattern.num_vertices; ++row)
+        graphs[0].vertex_weights[row] = csr_matrix.row_offsets[row + 1] - csr_matrix.row_offsets[row] + 1;
+
+    long long total_weight  = graphs[0].TotalWeight();
+    OffsetT   target        = OffsetT(std::max(20 * num_parts, 200));
+    long long max_vertex    = std::max(1ll, (long long) (1.5 * double(total_weight) / target));
+
+    // Coarsen
+    while (graphs.back().NumVertices() > target)
+    {
+        WeightedGraph<OffsetT>  coarse;
+        std::vector<OffsetT>    coarse_map;
+        graphs.back().Coarsen(max_vertex, coarse, coarse_map);
+        if (coarse.NumVertices() > graphs.back().NumVertices() * 0.95)
+            break;
+        graphs.push_back(coarse);
+        coarse_maps.push_back(coarse_map);
+    }
+
+    // Initial partition: equal-weight runs of a BFS order of the coarsest graph
+    const WeightedGraph<OffsetT>    &coarsest       = graphs.back();
+    OffsetT                         num_coarsest    = coarsest.NumVertices();
+    std::vector<OffsetT>            bfs_order;
+    std::vector<char>               visited(num_coarsest, 0);
+    for (OffsetT root = 0; root < num_coarsest; ++root)
+    {
+        if (visited[root])
+            continue;
+        visited[root] = 1;
+        bfs_order.push_back(root);
+        for (size_t head = bfs_order.size() - 1; head < bfs_order.size(); ++head)
+        {
+            OffsetT vertex = bfs_order[head];
+            for (OffsetT n = coarsest.offsets[vertex]; n < coarsest.offsets[vertex + 1]; ++n)
+            {
+                if (!visited[coarsest.adjacency[n]])
+                {
+                    visited[coarsest.adjacency[n]] = 1;
+                    bfs_order.push_back(coarsest.adjacency[n]);
+                }
+            }
+        }
+    }
+
+    std::vector<int> level_parts(num_coarsest);
+    long long prefix = 0;
+    for (OffsetT i = 0; i < num_coarsest; ++i)
+    {
+        OffsetT vertex = bfs_order[i];
+        level_parts[vertex] = int(std::min<long long>(num_parts - 1, (prefix + coarsest.vertex_weights[vertex] / 2) * num_parts / total_weight));
+        prefix += coarsest.vertex_weights[vertex];
+    }
+
+    // Uncoarsen and refine
+    for (int level = int(graphs.size()) - 1; level >= 0; --level)
+    {
+        const WeightedGraph<OffsetT> &graph = graphs[level];
+
+        long long heaviest = 0;
+        for (OffsetT vertex = 0; vertex < graph.NumVertices(); ++vertex)
+            heaviest = std::max(heaviest, graph.vertex_weights[vertex]);
+        long long max_part_weight = std::max(
+            (long long) (1.03 * double(total_weight) / num_parts),
+            total_weight / num_parts + heaviest);
+
+        graph.Refine(num_parts, max_part_weight, level_parts);
+
+        if (level > 0)
+        {
+            const std::vector<OffsetT>  &coarse_map = coarse_maps[level - 1];
+            std::vector<int>            finer(coarse_map.size());
+            for (size_t vertex = 0; vertex < coarse_map.size(); ++vertex)
+                finer[vertex] = level_parts[coarse_map[vertex]];
+            level_parts.swap(finer);
+        }
+    }
+    parts.swap(level_parts);
+
+    // Quality
+    PartitionStats stats;
+    std::vector<long long> part_weights(num_parts, 0);
+    stats.levels        = int(graphs.size());
+    stats.edge_cut      = 0;
+    stats.total_edges   = (long long) pattern.neighbors.size() / 2;
+    for (OffsetT vertex = 0; vertex < pattern.num_vertices; ++vertex)
+    {
+        part_weights[parts[vertex]] += graphs[0].vertex_weights[vertex];
+        for (OffsetT n = pattern.offsets[vertex]; n < pattern.offsets[vertex + 1]; ++n)
+            if (parts[pattern.neighbors[n]] != parts[vertex])
+                stats.edge_cut++;
+    }
+    stats.edge_cut /= 2;
+    stats.imbalance = double(*std::max_element(part_weights.begin(), part_weights.end())) * num_parts / total_weight;
+    return stats;
+}
+
+
+/**
+ * Relabelling that makes each part of MultilevelPartition() a contiguous
+ * range of rows (parts in order, rows within a part in their current order)
+ */
+template <typename ValueT, typename OffsetT>
+PartitionStats PartitionOrdering(CsrMatrix<ValueT, OffsetT> &csr_matrix, int num_parts, OffsetT *relabel)
+{
+    std::vector<int> parts;
+    PartitionStats stats = MultilevelPartition(csr_matrix, num_parts, parts);
+
+    std::vector<OffsetT> starts(num_parts + 1, 0);
+    for (OffsetT row = 0; row < csr_matrix.num_rows; ++row)
+        starts[parts[row] + 1]++;
+    for (int part = 0; part < num_parts; ++part)
+        starts[part + 1] += starts[part];
+    for (OffsetT row = 0; row < csr_matrix.num_rows; ++row)
+        relabel[row] = starts[parts[row]]++;
+
+    return stats;
+}
+
+
+/******************************************************************************
+ * Ordering quality
+ ******************************************************************************/
+
+/**
+ * Bandwidth (max |row - col|) and profile (sum over rows of the distance from
+ * the first nonzero left of the diagonal to the diagonal) of a matrix
+ */
+struct OrderingStats
+{
+    long long   bandwidth;
+    double      profile;
+
+    template <typename ValueT, typename OffsetT>
+    void Compute(CsrMatrix<ValueT, OffsetT> &csr_matrix)
+    {
+        long long   max_distance    = 0;
+        double      sum             = 0;
+
+        #pragma omp parallel for schedule(dynamic, 1024) reduction(max:max_distance) reduction(+:sum)
+        for (OffsetT row = 0; row < csr_matrix.num_rows; ++row)
+        {
+            OffsetT first = row;
+            for (OffsetT nz = csr_matrix.row_offsets[row]; nz < csr_matrix.row_offsets[row + 1]; ++nz)
+            {
+                long long col = csr_matrix.column_indices[nz];
+                max_distance = std::max(max_distance, (col > row) ? col - row : row - col);
+                first = std::min(first, OffsetT(col));
+            }
+            sum += row - first;
+        }
+
+        bandwidth   = max_distance;
+        profile     = sum;
+    }
+};
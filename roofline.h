@@ -0,0 +1,303 @@
+/******************************************************************************
+ * Copyright (c) 2011-2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the NVIDIA CORPORATION nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL NVIDIA CORPORATION BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * Memory bandwidth calibration and SpMV roofline bounds
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "sparse_matrix.h"
+#include "utils.h"
+
+
+/******************************************************************************
+ * Machine calibration
+ ******************************************************************************/
+
+/**
+ * Sustained bandwidth of the machine as seen by a team of OpenMP threads:
+ * a STREAM-triad-like kernel for streaming access, and random gathers from a
+ * table larger than the last-level caches for irregular access to vector_x.
+ */
+struct MachineBandwidth
+{
+    int         num_threads;
+    size_t      llc_bytes;          // Total last-level cache over all instances
+    double      triad_gbs;          // Streaming GB/s (STREAM convention: 3 x 8 bytes per element)
+    double      gather_rate;        // Random gathers per second that miss the last-level caches
+
+    MachineBandwidth() : num_threads(0), llc_bytes(0), triad_gbs(0), gather_rate(0) {}
+
+    /**
+     * Run both microbenchmarks with num_threads threads, keeping the best of
+     * several repetitions.  Arrays are first-touched with the same static
+     * schedule as the timed loops so each thread streams from its own pages.
+     */
+    void Calibrate(int num_threads, int llc_instances = 1, int repetitions = 10)
+    {
+        this->num_threads   = num_threads;
+        this->llc_bytes     = CacheFlusher::LastLevelCacheBytes() * std::max(llc_instances, 1);
+
+        // Each array is four times the total last-level cache (and at least 32MB)
+        long long n = std::max<long long>(4 * llc_bytes, 32ll << 20) / sizeof(double);
+
+        double *a = (double*) HostMalloc(sizeof(double) * n);
+        double *b = (double*) HostMalloc(sizeof(double) * n);
+        double *c = (double*) HostMalloc(sizeof(double) * n);
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (long long i = 0; i < n; ++i)
+        {
+            a[i] = 0.0;
+            b[i] = 1.0;
+            c[i] = 2.0;
+        }
+
+        // Triad
+        double best_s = std::numeric_limits<double>::max();
+        for (int r = 0; r < repetitions; ++r)
+        {
+            double start = WallClockSeconds();
+
+            #pragma omp parallel for schedule(static) num_threads(num_threads)
+            for (long long i = 0; i < n; ++i)
+                a[i] = b[i] + 3.0 * c[i];
+
+            best_s = std::min(best_s, WallClockSeconds() - start);
+        }
+        triad_gbs = double(3 * sizeof(double) * n) / best_s / 1.0e9;
+
+        // Random gather: reuse c as the index stream and a as the table
+        int *indices = (int*) c;
+        long long table_items = std::min<long long>(n, std::numeric_limits<int>::max());
+
+        #pragma omp parallel num_threads(num_threads)
+        {
+            unsigned long long state = 0x9E3779B97F4A7C15ull * (omp_get_thread_num() + 1);
+
+            #pragma omp for schedule(static)
+            for (long long i = 0; i < n; ++i)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                indices[i] = int(state % table_items);
+            }
+        }
+
+        double sum = 0.0;
+        best_s = std::numeric_limits<double>::max();
+        for (int r = 0; r < repetitions; ++r)
+        {
+            double start = WallClockSeconds();
+
+            #pragma omp parallel for schedule(static) num_threads(num_threads) reduction(+:sum)
+            for (long long i = 0; i < n; ++i)
+                sum += a[indices[i]];
+
+            best_s = std::min(best_s, WallClockSeconds() - start);
+        }
+        gather_rate = double(n) / best_s;
+
+        // Keep the gather loop from being optimized away
+        if (sum < 0)
+            printf(" ");
+
+        HostFree(a, sizeof(double) * n);
+        HostFree(b, sizeof(double) * n);
+        HostFree(c, sizeof(double) * n);
+    }
+
+    /// Random-gather bandwidth in GB/s, counting a whole cache line per gather
+    double GatherGbs() const
+    {
+        return gather_rate * 64 / 1.0e9;
+    }
+};
+
+
+/******************************************************************************
+ * SpMV traffic model
+ ******************************************************************************/
+
+/**
+ * Bytes an SpMV must move, and an estimate of the vector_x gathers that miss
+ * the last-level caches.
+ *
+ * Within a row, consecutive nonzeros whose columns fall in the same cache line
+ * of vector_x share one access.  When vector_x fits in the last-level caches,
+ * only its compulsory traffic is paid; otherwise each remaining line access
+ * misses with probability 1 - llc_bytes / x_bytes (no locality between rows).
+ *
+ * SimulateXCache() refines the vector_x term by replaying each merge-path
+ * partition's column indices through an LRU cache (--cache-sim).
+ */
+struct SpmvTrafficModel
+{
+    double      stream_bytes;       // Matrix arrays, vector_y, and one pass over vector_x
+    double      x_line_accesses;    // Distinct-line accesses to vector_x summed over rows
+    double      x_misses;           // Estimated vector_x gathers beyond the compulsory pass
+
+    double      naive_bytes;        // One vector_x value loaded per nonzero (the effective GB/s convention)
+    double      matrix_bytes;       // Matrix arrays and vector_y, without vector_x
+    size_t      cache_bytes;        // Simulated cache over all partitions (0 if not simulated)
+    int         cache_partitions;
+    int         cache_ways;
+    double      x_lru_misses;       // vector_x line misses summed over the simulated partitions
+
+    SpmvTrafficModel() :
+        stream_bytes(0), x_line_accesses(0), x_misses(0),
+        naive_bytes(0), matrix_bytes(0), cache_bytes(0), cache_partitions(0), cache_ways(0), x_lru_misses(0)
+    {}
+
+    template <typename ValueT, typename OffsetT>
+    void Init(CsrMatrix<ValueT, OffsetT> &csr_matrix, size_t llc_bytes)
+    {
+        const OffsetT ITEMS_PER_LINE = OffsetT(64 / sizeof(ValueT));
+
+        double x_bytes = double(sizeof(ValueT)) * csr_matrix.num_cols;
+
+        stream_bytes =
+            double(csr_matrix.num_nonzeros) * (sizeof(ValueT) + sizeof(OffsetT)) +     // values, column_indices
+            double(csr_matrix.num_rows + 1) * sizeof(OffsetT) +                         // row_offsets
+            double(csr_matrix.num_rows) * sizeof(ValueT) +                              // vector_y
+            x_bytes;                                                                    // vector_x
+
+        double line_accesses = 0;
+
+        #pragma omp parallel for schedule(static) reduction(+:line_accesses)
+        for (OffsetT row = 0; row < csr_matrix.num_rows; ++row)
+        {
+            OffsetT previous_line = -1;
+            for (OffsetT nz = csr_matrix.row_offsets[row]; nz < csr_matrix.row_offsets[row + 1]; ++nz)
+            {
+                OffsetT line = csr_matrix.column_indices[nz] / ITEMS_PER_LINE;
+                if (line != previous_line)
+                    line_accesses += 1;
+                previous_line = line;
+            }
+        }
+        x_line_accesses = line_accesses;
+
+        double x_lines      = (x_bytes + 63) / 64;
+        double miss_rate    = (x_bytes > llc_bytes) ? 1.0 - double(llc_bytes) / x_bytes : 0.0;
+        x_misses            = std::max(0.0, x_line_accesses - x_lines) * miss_rate;
+    }
+
+    /**
+     * Replay the column indices of each merge-path partition (nonzeros
+     * [starts[p].y, ends[p].y)) through its own cache_bytes / num_partitions
+     * share of a ways-way set-associative LRU cache of vector_x lines, as if
+     * each thread had a private slice of the cache.  Lines shared between
+     * partitions miss once in each.
+     */
+    template <typename ValueT, typename OffsetT, typename CoordinateT>
+    void SimulateXCache(
+        CsrMatrix<ValueT, OffsetT>&     csr_matrix,
+        const CoordinateT*              starts,
+        const CoordinateT*              ends,
+        int                             num_partitions,
+        size_t                          cache_bytes,
+        int                             ways = 16)
+    {
+        const OffsetT ITEMS_PER_LINE = OffsetT(64 / sizeof(ValueT));
+
+        naive_bytes =
+            double(csr_matrix.num_nonzeros) * (sizeof(ValueT) * 2 + sizeof(OffsetT)) +
+            double(csr_matrix.num_rows) * (sizeof(OffsetT) + sizeof(ValueT));
+        matrix_bytes =
+            double(csr_matrix.num_nonzeros) * (sizeof(ValueT) + sizeof(OffsetT)) +
+            double(csr_matrix.num_rows + 1) * sizeof(OffsetT) +
+            double(csr_matrix.num_rows) * sizeof(ValueT);
+
+        long long partition_lines = std::max<long long>(1, (long long) (cache_bytes / 64 / std::max(num_partitions, 1)));
+        ways = int(std::min<long long>(std::max(ways, 1), partition_lines));
+        long long num_sets = partition_lines / ways;
+
+        this->cache_bytes       = cache_bytes;
+        this->cache_partitions  = num_partitions;
+        this->cache_ways        = ways;
+
+        double misses = 0;
+
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:misses)
+        for (int p = 0; p < num_partitions; ++p)
+        {
+            // Tag and last-use time of each way, set-major
+            std::vector<long long>  tags(num_sets * ways, -1);
+            std::vector<long long>  last_use(num_sets * ways, 0);
+            long long               now = 0;
+
+            for (OffsetT nz = starts[p].y; nz < ends[p].y; ++nz)
+            {
+                long long   line    = csr_matrix.column_indices[nz] / ITEMS_PER_LINE;
+                long long   set     = (line % num_sets) * ways;
+                int         victim  = 0;
+                int         way     = 0;
+
+                ++now;
+                for (; way < ways; ++way)
+                {
+                    if (tags[set + way] == line)
+                        break;
+                    if (last_use[set + way] < last_use[set + victim])
+                        victim = way;
+                }
+                if (way == ways)
+                {
+                    misses += 1;
+                    tags[set + victim] = line;
+                    way = victim;
+                }
+                last_use[set + way] = now;
+            }
+        }
+        x_lru_misses = misses;
+    }
+
+    /// Bytes moved under the LRU simulation: the matrix arrays, vector_y, and the vector_x misses
+    double ModeledBytes() const
+    {
+        return matrix_bytes + x_lru_misses * 64;
+    }
+
+    /// Time to stream the compulsory bytes at the measured triad bandwidth
+    double StreamBoundMillis(const MachineBandwidth &machine) const
+    {
+        return stream_bytes / (machine.triad_gbs * 1.0e9) * 1000.0;
+    }
+
+    /// Streaming time plus the estimated vector_x misses at the measured gather rate
+    double BoundMillis(const MachineBandwidth &machine) const
+    {
+        return StreamBoundMillis(machine) + x_misses / machine.gather_rate * 1000.0;
+    }
+};
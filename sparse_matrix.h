@@ -43,15 +43,93 @@
 #include <set>
 #include <list>
 #include <fstream>
+#include <sstream>
+#include <limits>
 #include <stdio.h>
 
-#ifdef CUB_MKL
+#ifdef CUB_NUMA
     #include <numa.h>
+#endif
+
+#ifdef CUB_MKL
     #include <mkl.h>
 #endif
 
+#if defined(_WIN32) || defined(_WIN64)
+    #include <malloc.h>
+#else
+    #include <stdlib.h>
+#endif
+
+#include "utils.h"
+
 using namespace std;
 
+/******************************************************************************
+ * Host memory allocation
+ ******************************************************************************/
+
+/**
+ * Whether to use NUMA malloc to always put storage on the same sockets (for perf repeatability)
+ */
+inline bool NumaMallocAvailable()
+{
+#ifdef CUB_NUMA
+    return (numa_available() >= 0);
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * Page-aligned host allocation.  Uses libnuma to place the storage on the
+ * given node when available, else MKL's allocator when built with MKL, else
+ * the platform's aligned allocator.
+ */
+inline void* HostMalloc(size_t bytes, int numa_node = 0)
+{
+    void *ptr = NULL;
+#ifdef CUB_NUMA
+    if (NumaMallocAvailable())
+        return numa_alloc_onnode(bytes, numa_node);
+#endif
+#if defined(CUB_MKL)
+    ptr = mkl_malloc(bytes, 4096);
+#elif defined(_WIN32) || defined(_WIN64)
+    ptr = _aligned_malloc(bytes, 4096);
+#else
+    if (posix_memalign(&ptr, 4096, bytes) != 0)
+        ptr = NULL;
+#endif
+    return ptr;
+}
+
+
+/**
+ * Frees storage allocated by HostMalloc (bytes must match the allocation)
+ */
+inline void HostFree(void* ptr, size_t bytes)
+{
+    if (ptr == NULL)
+        return;
+#ifdef CUB_NUMA
+    if (NumaMallocAvailable())
+    {
+        numa_free(ptr, bytes);
+        return;
+    }
+#endif
+#if defined(CUB_MKL)
+    mkl_free(ptr);
+#elif defined(_WIN32) || defined(_WIN64)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+
 /******************************************************************************
  * Graph stats
  ******************************************************************************/
@@ -70,6 +148,10 @@ struct GraphStats
     double      row_length_variation;   // coefficient of variation
     double      row_length_skewness;    // skewness
 
+    double      diag_distance_mean;     // mean |col - row| over nonzeros, as a fraction of num_cols (bandwidth)
+    double      diag_distance_max;      // max |col - row| over nonzeros, as a fraction of num_cols
+    double      x_line_reuse;           // fraction of nonzeros whose vector_x cache line matches the previous nonzero's in the row
+
     void Display(bool show_labels = true)
     {
         if (show_labels)
@@ -81,7 +163,10 @@ struct GraphStats
                 "\t row_length_max: %d\n"
                 "\t row_length_std_dev: %.5f\n"
                 "\t row_length_variation: %.5f\n"
-                "\t row_length_skewness: %.5f\n",
+                "\t row_length_skewness: %.5f\n"
+                "\t diag_distance_mean: %.5f\n"
+                "\t diag_distance_max: %.5f\n"
+                "\t x_line_reuse: %.5f\n",
                     num_rows,
                     num_cols,
                     num_nonzeros,
@@ -89,7 +174,10 @@ struct GraphStats
                     row_length_max,
                     row_length_std_dev,
                     row_length_variation,
-                    row_length_skewness);
+                    row_length_skewness,
+                    diag_distance_mean,
+                    diag_distance_max,
+                    x_line_reuse);
         else
             printf(
                 "%d, "
@@ -217,9 +305,10 @@ struct CooMatrix
 
 
     /**
-     * Builds a MARKET COO sparse from the given file.
+     * Builds a MARKET COO sparse from the given file.  Returns false (after
+     * reporting the problem on stderr) if the file cannot be read or parsed.
      */
-    void InitMarket(
+    bool InitMarket(
         const string&   market_filename,
         ValueT          default_value       = 1.0,
         bool            verbose             = false)
@@ -239,7 +328,7 @@ struct CooMatrix
         if (!ifs.good())
         {
             fprintf(stderr, "Error opening file\n");
-            exit(1);
+            return false;
         }
 
         bool    array = false;
@@ -300,7 +389,8 @@ struct CooMatrix
                 else
                 {
                     fprintf(stderr, "Error parsing MARKET matrix: invalid problem description: %s\n", line);
-                    exit(1);
+                    Clear();
+                    return false;
                 }
 
             }
@@ -310,7 +400,8 @@ struct CooMatrix
                 if (current_nz >= num_nonzeros)
                 {
                     fprintf(stderr, "Error parsing MARKET matrix: encountered more than %d num_nonzeros\n", num_nonzeros);
-                    exit(1);
+                    Clear();
+                    return false;
                 }
 
                 OffsetT row, col;
@@ -321,7 +412,8 @@ struct CooMatrix
                     if (sscanf(line, "%lf", &val) != 1)
                     {
                         fprintf(stderr, "Error parsing MARKET matrix: badly formed current_nz: '%s' at edge %d\n", line, current_nz);
-                        exit(1);
+                        Clear();
+                        return false;
                     }
                     col = (current_nz / num_rows);
                     row = (current_nz - (num_rows * col));
@@ -339,7 +431,8 @@ struct CooMatrix
                     if (t == l)
                     {
                         fprintf(stderr, "Error parsing MARKET matrix: badly formed row at edge %d\n", current_nz);
-                        exit(1);
+                        Clear();
+                        return false;
                     }
                     l = t;
 
@@ -348,7 +441,8 @@ struct CooMatrix
                     if (t == l)
                     {
                         fprintf(stderr, "Error parsing MARKET matrix: badly formed col at edge %d\n", current_nz);
-                        exit(1);
+                        Clear();
+                        return false;
                     }
                     l = t;
 
@@ -374,6 +468,12 @@ struct CooMatrix
             }
         }
 
+        if (current_nz == -1)
+        {
+            fprintf(stderr, "Error parsing MARKET matrix: no problem description\n");
+            return false;
+        }
+
         // Adjust nonzero count (nonzeros along the diagonal aren't reversed)
         num_nonzeros = current_nz;
 
@@ -382,6 +482,7 @@ struct CooMatrix
         }
 
         ifs.close();
+        return true;
     }
 
 
@@ -625,6 +726,291 @@ struct CooMatrix
 
 
 
+/******************************************************************************
+ * Random matrix parameters
+ ******************************************************************************/
+
+/**
+ * Parameters of a random sparse matrix (see CsrMatrix::InitRandom) for
+ * controlled scaling studies: the row-length distribution, the bandwidth of
+ * the columns about the diagonal, and the fraction of empty rows can each be
+ * varied with the others fixed.
+ */
+struct RandomMatrixParams
+{
+    std::string     distribution;   // Lengths of non-empty rows: "uniform", "geometric", or "zipf"
+    long long       num_rows;
+    long long       num_cols;       // (-1: num_rows)
+    double          mean;           // Mean length of non-empty rows
+    double          alpha;          // Exponent of "zipf" (power-law) row lengths, > 1
+    double          band;           // Columns lie within band * num_cols of the diagonal (1: anywhere)
+    double          empty;          // Fraction of empty rows
+    unsigned int    seed;
+
+    RandomMatrixParams() :
+        distribution("uniform"), num_rows(1 << 20), num_cols(-1), mean(16), alpha(2.0), band(1.0), empty(0), seed(0)
+    {}
+
+    /**
+     * Parse "<distribution>[,rows=<n>][,cols=<n>][,mean=<x>][,alpha=<x>][,band=<x>][,empty=<x>][,seed=<n>]".
+     * Returns false (with a message on stderr) if the spec is malformed or out of range.
+     */
+    bool Parse(const std::string &spec)
+    {
+        std::istringstream tokens(spec);
+        std::string token;
+        for (int t = 0; std::getline(tokens, token, ','); ++t)
+        {
+            size_t pos = token.find('=');
+            if ((t == 0) && (pos == std::string::npos))
+            {
+                distribution = token;
+                continue;
+            }
+
+            std::string key     = token.substr(0, pos);
+            const char* value   = token.c_str() + pos + 1;
+            char*       end     = NULL;
+            double      number  = (pos == std::string::npos) ? 0.0 : strtod(value, &end);
+            if ((pos == std::string::npos) || (end == value) || (*end != '\0'))
+            {
+                fprintf(stderr, "Malformed generator parameter '%s'\n", token.c_str());
+                return false;
+            }
+
+            if (key == "rows")          num_rows = (long long) number;
+            else if (key == "cols")     num_cols = (long long) number;
+            else if (key == "mean")     mean = number;
+            else if (key == "alpha")    alpha = number;
+            else if (key == "band")     band = number;
+            else if (key == "empty")    empty = number;
+            else if (key == "seed")     seed = (unsigned int) number;
+            else
+            {
+                fprintf(stderr, "Unknown generator parameter '%s'\n", key.c_str());
+                return false;
+            }
+        }
+        if (num_cols < 0)
+            num_cols = num_rows;
+
+        if ((distribution != "uniform") && (distribution != "geometric") && (distribution != "zipf"))
+        {
+            fprintf(stderr, "Unknown row-length distribution '%s' (uniform, geometric, or zipf)\n", distribution.c_str());
+            return false;
+        }
+        if ((num_rows < 1) || (num_cols < 1) || (mean < 1) || (mean > num_cols) || (alpha <= 1) ||
+            (band <= 0) || (band > 1) || (empty < 0) || (empty >= 1))
+        {
+            fprintf(stderr, "Generator parameters out of range (rows, cols >= 1; 1 <= mean <= cols; alpha > 1; 0 < band <= 1; 0 <= empty < 1)\n");
+            return false;
+        }
+        return true;
+    }
+
+    /// Uniform draw from (0, 1)
+    static double Uniform(mersenne::State &state)
+    {
+        return (double(mersenne::genrand_int32(state)) + 0.5) / 4294967296.0;
+    }
+
+    /// Uniform draw from [0, n)
+    static long long Below(mersenne::State &state, long long n)
+    {
+        unsigned long long bits = ((unsigned long long) mersenne::genrand_int32(state) << 32) | mersenne::genrand_int32(state);
+        return (long long) (bits % (unsigned long long) n);
+    }
+
+    /// Length of a random row
+    long long RowLength(mersenne::State &state) const
+    {
+        if (Uniform(state) < empty)
+            return 0;
+
+        double length;
+        if (distribution == "uniform")
+        {
+            // Uniform over [1, 2 * mean - 1]
+            length = 1 + Below(state, std::max(1ll, (long long) (2 * mean - 1 + 0.5)));
+        }
+        else if (distribution == "geometric")
+        {
+            // Trials to the first success with p = 1 / mean
+            length = (mean <= 1) ? 1 : 1 + floor(log(Uniform(state)) / log(1 - (1 / mean)));
+        }
+        else
+        {
+            // Pareto with shape alpha and the given mean, rounded
+            double scale = mean * (alpha - 1) / alpha;
+            length = floor(scale * pow(Uniform(state), -1 / alpha) + 0.5);
+        }
+        return std::max(1ll, std::min(num_cols, (long long) std::min(length, 1e18)));
+    }
+
+    /// Name for results, e.g. "gen:zipf,rows=1048576,cols=1048576,mean=16,alpha=2,band=1,empty=0,seed=0"
+    std::string Name() const
+    {
+        std::ostringstream name;
+        name << "gen:" << distribution << ",rows=" << num_rows << ",cols=" << num_cols << ",mean=" << mean;
+        if (distribution == "zipf")
+            name << ",alpha=" << alpha;
+        name << ",band=" << band << ",empty=" << empty << ",seed=" << seed;
+        return name.str();
+    }
+};
+
+
+/******************************************************************************
+ * CSR matrix views
+ ******************************************************************************/
+
+template<
+    typename ValueT,
+    typename OffsetT>
+struct CsrMatrix;
+
+/**
+ * Non-owning view of CSR arrays, as taken by the SpMV kernels and the
+ * merge-path partitioner.  Row r's nonzeros are [row_offsets[r],
+ * row_end_offsets[r]), which covers both the usual three-array CSR
+ * (row_end_offsets = row_offsets + 1) and MKL's four-array form with separate
+ * row starts and ends (whose rows may leave gaps between them).  With
+ * index_base 1, offsets and column indices are one-based.
+ */
+template<
+    typename ValueT,
+    typename OffsetT>
+struct CsrView
+{
+    OffsetT     num_rows;
+    OffsetT     num_cols;
+    OffsetT     num_nonzeros;       // Nonzeros in rows (not counting gaps)
+    OffsetT*    row_offsets;        // Start of each row
+    OffsetT*    row_end_offsets;    // End of each row
+    OffsetT*    column_indices;
+    ValueT*     values;
+    int         index_base;         // 0 or 1
+
+    /**
+     * Constructor (empty; see Init())
+     */
+    CsrView() :
+        num_rows(0), num_cols(0), num_nonzeros(0), row_offsets(NULL), row_end_offsets(NULL),
+        column_indices(NULL), values(NULL), index_base(0)
+    {}
+
+    /**
+     * View of a CsrMatrix
+     */
+    CsrView(const CsrMatrix<ValueT, OffsetT> &matrix) :
+        num_rows(matrix.num_rows), num_cols(matrix.num_cols), num_nonzeros(matrix.num_nonzeros),
+        row_offsets(matrix.row_offsets), row_end_offsets(matrix.row_offsets + 1),
+        column_indices(matrix.column_indices), values(matrix.values), index_base(0)
+    {}
+
+    /**
+     * View of caller-owned arrays (pass row_offsets + 1 as row_end_offsets for
+     * three-array CSR)
+     */
+    void Init(
+        OffsetT     num_rows,
+        OffsetT     num_cols,
+        OffsetT*    row_offsets,
+        OffsetT*    row_end_offsets,
+        OffsetT*    column_indices,
+        ValueT*     values,
+        int         index_base = 0)
+    {
+        this->num_rows          = num_rows;
+        this->num_cols          = num_cols;
+        this->row_offsets       = row_offsets;
+        this->row_end_offsets   = row_end_offsets;
+        this->column_indices    = column_indices;
+        this->values            = values;
+        this->index_base        = index_base;
+
+        num_nonzeros = 0;
+        if (Contiguous())
+        {
+            if (num_rows > 0)
+                num_nonzeros = row_end_offsets[num_rows - 1] - row_offsets[0];
+        }
+        else
+        {
+            for (OffsetT row = 0; row < num_rows; ++row)
+                num_nonzeros += row_end_offsets[row] - row_offsets[row];
+        }
+    }
+
+    /**
+     * Whether every row starts where the previous one ends
+     */
+    bool Contiguous() const
+    {
+        if (row_end_offsets == row_offsets + 1)
+            return true;
+        for (OffsetT row = 1; row < num_rows; ++row)
+        {
+            if (row_offsets[row] != row_end_offsets[row - 1])
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Length of the nonzero list the merge path runs over: from the first
+     * row's start to the last row's end, including any gaps
+     */
+    OffsetT PathNonzeros() const
+    {
+        return (num_rows > 0) ? row_end_offsets[num_rows - 1] - row_offsets[0] : 0;
+    }
+
+
+    /**
+     * Get the dimensions and row-length statistics only (a single pass over
+     * the row offsets; pearson_r and the locality statistics are left zero)
+     */
+    GraphStats RowLengthStats() const
+    {
+        GraphStats stats;
+        stats.num_rows = num_rows;
+        stats.num_cols = num_cols;
+        stats.num_nonzeros = num_nonzeros;
+        stats.pearson_r = 0.0;
+        stats.diag_distance_mean = 0.0;
+        stats.diag_distance_max = 0.0;
+        stats.x_line_reuse = 0.0;
+
+        //
+        // Compute row-length statistics
+        //
+
+        // Sample mean
+        stats.row_length_mean       = double(num_nonzeros) / num_rows;
+        OffsetT max                 = 0;
+        double variance             = 0.0;
+        stats.row_length_skewness   = 0.0;
+        for (OffsetT row = 0; row < num_rows; ++row)
+        {
+            OffsetT length              = row_end_offsets[row] - row_offsets[row];
+            if (length > max)
+                max = length;
+            double delta                = double(length) - stats.row_length_mean;
+            variance   += (delta * delta);
+            stats.row_length_skewness   += (delta * delta * delta);
+        }
+        variance                    /= num_rows;
+        stats.row_length_std_dev    = sqrt(variance);
+        stats.row_length_skewness   = (stats.row_length_skewness / num_rows) / pow(stats.row_length_std_dev, 3.0);
+        stats.row_length_variation  = stats.row_length_std_dev / stats.row_length_mean;
+        stats.row_length_max = max;
+
+        return stats;
+    }
+};
+
+
 /******************************************************************************
  * CSR matrix type
  ******************************************************************************/
@@ -658,11 +1044,7 @@ struct CsrMatrix
     // Whether to use NUMA malloc to always put storage on the same sockets (for perf repeatability)
     bool IsNumaMalloc()
     {
-#ifdef CUB_MKL
-        return (numa_available() >= 0);
-#else
-        return false;
-#endif
+        return NumaMallocAvailable();
     }
 
     /**
@@ -681,34 +1063,21 @@ struct CsrMatrix
         std::stable_sort(coo_matrix.coo_tuples, coo_matrix.coo_tuples + num_nonzeros, CooComparator());
         if (verbose) printf("done."); fflush(stdout);
 
-#ifdef CUB_MKL
-
+#ifdef CUB_NUMA
         if (IsNumaMalloc())
-        {
             numa_set_strict(1);
+#endif
 
-            row_offsets     = (OffsetT*) numa_alloc_onnode(sizeof(OffsetT) * (num_rows + 1), 0);
-            column_indices  = (OffsetT*) numa_alloc_onnode(sizeof(OffsetT) * num_nonzeros, 0);
-
-            if (numa_num_task_nodes() > 1)
-                values          = (ValueT*) numa_alloc_onnode(sizeof(ValueT) * num_nonzeros, 1);    // put on different socket than column_indices
-            else
-                values          = (ValueT*) numa_alloc_onnode(sizeof(ValueT) * num_nonzeros, 0);
-        }
-        else
-        {
-            values          = (ValueT*) mkl_malloc(sizeof(ValueT) * num_nonzeros, 4096);
-            row_offsets     = (OffsetT*) mkl_malloc(sizeof(OffsetT) * (num_rows + 1), 4096);
-            column_indices  = (OffsetT*) mkl_malloc(sizeof(OffsetT) * num_nonzeros, 4096);
-
-        }
-
-#else
-        row_offsets     = new OffsetT[num_rows + 1];
-        column_indices  = new OffsetT[num_nonzeros];
-        values          = new ValueT[num_nonzeros];
+        int values_node = 0;
+#ifdef CUB_NUMA
+        if (IsNumaMalloc() && (numa_num_task_nodes() > 1))
+            values_node = 1;    // put on different socket than column_indices
 #endif
 
+        row_offsets     = (OffsetT*) HostMalloc(sizeof(OffsetT) * (num_rows + 1), 0);
+        column_indices  = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_nonzeros, 0);
+        values          = (ValueT*) HostMalloc(sizeof(ValueT) * num_nonzeros, values_node);
+
         OffsetT prev_row = -1;
         for (OffsetT current_nz = 0; current_nz < num_nonzeros; current_nz++)
         {
@@ -734,30 +1103,284 @@ struct CsrMatrix
 
 
     /**
-     * Clear
+     * Builds a scale-free R-MAT (recursive Kronecker) matrix with 2^scale rows
+     * and columns, as in the Graph500 generator: each of edge_factor * 2^scale
+     * edges descends scale levels of the adjacency matrix, picking the
+     * top-left, top-right, bottom-left, or bottom-right quadrant with
+     * probabilities a, b, c, and 1 - a - b - c.  Duplicate edges are merged,
+     * and unless permute is false, vertices are relabelled by a random
+     * permutation so the high-degree rows are spread over the matrix.
+     *
+     * Edges are generated in parallel, directly into CSR, in blocks that each
+     * seed their own Mersenne Twister from (seed, block), so the matrix
+     * depends only on the parameters and seed, not the thread count.
      */
-    void Clear()
+    void InitRmat(
+        int             scale,
+        int             edge_factor,
+        double          a,
+        double          b,
+        double          c,
+        unsigned int    seed,
+        bool            permute         = true,
+        ValueT          default_value   = 1.0)
     {
-#ifdef CUB_MKL
+        const long long BLOCK_EDGES = 1 << 16;
+
+        long long num_edges = (long long) edge_factor << scale;
+        if ((scale < 1) || (scale > 30) || (edge_factor < 1) || (num_edges > (long long) std::numeric_limits<OffsetT>::max()))
+        {
+            fprintf(stderr, "R-MAT scale %d and edge factor %d out of range for %d-byte offsets\n", scale, edge_factor, int(sizeof(OffsetT)));
+            exit(1);
+        }
+
+        num_rows        = OffsetT(1) << scale;
+        num_cols        = num_rows;
+
+        // Thresholds on a uniform 32-bit draw for the quadrant at each level
+        double          scale_32    = 4294967296.0;
+        unsigned int    a_bound     = (unsigned int) std::min(a * scale_32, scale_32 - 1);
+        unsigned int    ab_bound    = (unsigned int) std::min((a + b) * scale_32, scale_32 - 1);
+        unsigned int    abc_bound   = (unsigned int) std::min((a + b + c) * scale_32, scale_32 - 1);
+
+        // Vertex relabelling (Fisher-Yates shuffle)
+        OffsetT *labels = new OffsetT[num_rows];
+        for (OffsetT i = 0; i < num_rows; ++i)
+            labels[i] = i;
+        if (permute)
+        {
+            mersenne::State state;
+            unsigned int key[2] = {seed, 0xffffffffu};
+            mersenne::init_by_array(state, key, 2);
+            for (OffsetT i = num_rows - 1; i > 0; --i)
+            {
+                unsigned long long bits = ((unsigned long long) mersenne::genrand_int32(state) << 32) | mersenne::genrand_int32(state);
+                std::swap(labels[i], labels[bits % (unsigned long long) (i + 1)]);
+            }
+        }
+
+        long long   num_blocks      = (num_edges + BLOCK_EDGES - 1) / BLOCK_EDGES;
+        OffsetT*    row_lengths     = new OffsetT[num_rows];
+        OffsetT*    row_cursors     = new OffsetT[num_rows];
+        OffsetT*    edge_columns    = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_edges, 0);
+
+        memset(row_lengths, 0, sizeof(OffsetT) * num_rows);
+
+        // Pass 0 counts the edges of each row; pass 1 regenerates the same
+        // edges and places their columns
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (long long block = 0; block < num_blocks; ++block)
+            {
+                mersenne::State state;
+                unsigned int key[2] = {seed, (unsigned int) block};
+                mersenne::init_by_array(state, key, 2);
+
+                long long block_end = std::min(num_edges, (block + 1) * BLOCK_EDGES);
+                for (long long edge = block * BLOCK_EDGES; edge < block_end; ++edge)
+                {
+                    OffsetT row = 0;
+                    OffsetT col = 0;
+                    for (int level = 0; level < scale; ++level)
+                    {
+                        unsigned int draw = mersenne::genrand_int32(state);
+                        row = (row << 1) | OffsetT(draw >= ab_bound);
+                        col = (col << 1) | OffsetT(((draw >= a_bound) && (draw < ab_bound)) || (draw >= abc_bound));
+                    }
+                    row = labels[row];
+                    col = labels[col];
+
+                    if (pass == 0)
+                    {
+                        #pragma omp atomic
+                        row_lengths[row]++;
+                    }
+                    else
+                    {
+                        OffsetT slot;
+                        #pragma omp atomic capture
+                        slot = row_cursors[row]++;
+                        edge_columns[slot] = col;
+                    }
+                }
+            }
+
+            if (pass == 0)
+            {
+                OffsetT offset = 0;
+                for (OffsetT row = 0; row < num_rows; ++row)
+                {
+                    row_cursors[row] = offset;
+                    offset += row_lengths[row];
+                }
+            }
+        }
+
+        // Sort each row and merge duplicate edges (row_cursors are now the row ends)
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (OffsetT row = 0; row < num_rows; ++row)
+        {
+            OffsetT *row_begin  = edge_columns + row_cursors[row] - row_lengths[row];
+            OffsetT *row_end    = edge_columns + row_cursors[row];
+            std::sort(row_begin, row_end);
+            row_lengths[row]    = OffsetT(std::unique(row_begin, row_end) - row_begin);
+        }
+
+#ifdef CUB_NUMA
         if (IsNumaMalloc())
+            numa_set_strict(1);
+#endif
+
+        int values_node = 0;
+#ifdef CUB_NUMA
+        if (IsNumaMalloc() && (numa_num_task_nodes() > 1))
+            values_node = 1;    // put on different socket than column_indices
+#endif
+
+        row_offsets = (OffsetT*) HostMalloc(sizeof(OffsetT) * (num_rows + 1), 0);
+        row_offsets[0] = 0;
+        for (OffsetT row = 0; row < num_rows; ++row)
+            row_offsets[row + 1] = row_offsets[row] + row_lengths[row];
+        num_nonzeros = row_offsets[num_rows];
+
+        column_indices  = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_nonzeros, 0);
+        values          = (ValueT*) HostMalloc(sizeof(ValueT) * num_nonzeros, values_node);
+
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (OffsetT row = 0; row < num_rows; ++row)
         {
-            numa_free(row_offsets, sizeof(OffsetT) * (num_rows + 1));
-            numa_free(values, sizeof(ValueT) * num_nonzeros);
-            numa_free(column_indices, sizeof(OffsetT) * num_nonzeros);
+            OffsetT *row_begin = edge_columns + ((row > 0) ? row_cursors[row - 1] : 0);
+            for (OffsetT nz = 0; nz < row_lengths[row]; ++nz)
+            {
+                column_indices[row_offsets[row] + nz]   = row_begin[nz];
+                values[row_offsets[row] + nz]           = default_value;
+            }
         }
-        else
+
+        HostFree(edge_columns, sizeof(OffsetT) * num_edges);
+        delete[] row_cursors;
+        delete[] row_lengths;
+        delete[] labels;
+    }
+
+
+    /**
+     * Builds a random matrix from params (see RandomMatrixParams).  The columns
+     * of each row are distinct and drawn uniformly from a window of
+     * band * num_cols columns (at least the row length) centred on the
+     * diagonal.
+     *
+     * Rows are generated in parallel in fixed blocks that each seed their own
+     * Mersenne Twister from (seed, block), so the matrix depends only on the
+     * parameters, not the thread count.
+     */
+    void InitRandom(
+        const RandomMatrixParams    &params,
+        ValueT                      default_value = 1.0)
+    {
+        const OffsetT BLOCK_ROWS = 4096;
+
+        if ((params.num_rows > (long long) std::numeric_limits<OffsetT>::max() - 1) ||
+            (params.num_cols > (long long) std::numeric_limits<OffsetT>::max()))
         {
-            if (row_offsets)    mkl_free(row_offsets);
-            if (column_indices) mkl_free(column_indices);
-            if (values)         mkl_free(values);
+            fprintf(stderr, "Random matrix dimensions out of range for %d-byte offsets\n", int(sizeof(OffsetT)));
+            exit(1);
         }
 
-#else
-        if (row_offsets)    delete[] row_offsets;
-        if (column_indices) delete[] column_indices;
-        if (values)         delete[] values;
+        num_rows            = OffsetT(params.num_rows);
+        num_cols            = OffsetT(params.num_cols);
+        OffsetT num_blocks  = (num_rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+        long long window    = std::min((long long) num_cols, (long long) (2 * params.band * num_cols) + 1);
+
+#ifdef CUB_NUMA
+        if (IsNumaMalloc())
+            numa_set_strict(1);
+#endif
+
+        int values_node = 0;
+#ifdef CUB_NUMA
+        if (IsNumaMalloc() && (numa_num_task_nodes() > 1))
+            values_node = 1;    // put on different socket than column_indices
 #endif
 
+        // Row lengths
+        row_offsets = (OffsetT*) HostMalloc(sizeof(OffsetT) * (num_rows + 1), 0);
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (OffsetT block = 0; block < num_blocks; ++block)
+        {
+            mersenne::State state;
+            unsigned int key[3] = {params.seed, (unsigned int) block, 0};
+            mersenne::init_by_array(state, key, 3);
+
+            OffsetT block_end = std::min(num_rows, (block + 1) * BLOCK_ROWS);
+            for (OffsetT row = block * BLOCK_ROWS; row < block_end; ++row)
+                row_offsets[row + 1] = OffsetT(params.RowLength(state));
+        }
+
+        long long total = 0;
+        row_offsets[0] = 0;
+        for (OffsetT row = 0; row < num_rows; ++row)
+        {
+            total += row_offsets[row + 1];
+            if (total > (long long) std::numeric_limits<OffsetT>::max())
+            {
+                fprintf(stderr, "Random matrix has too many nonzeros for %d-byte offsets\n", int(sizeof(OffsetT)));
+                exit(1);
+            }
+            row_offsets[row + 1] = OffsetT(total);
+        }
+        num_nonzeros = OffsetT(total);
+
+        column_indices  = (OffsetT*) HostMalloc(sizeof(OffsetT) * num_nonzeros, 0);
+        values          = (ValueT*) HostMalloc(sizeof(ValueT) * num_nonzeros, values_node);
+
+        // Columns: Floyd's sampling of distinct columns from the row's window
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (OffsetT block = 0; block < num_blocks; ++block)
+        {
+            mersenne::State state;
+            unsigned int key[3] = {params.seed, (unsigned int) block, 1};
+            mersenne::init_by_array(state, key, 3);
+
+            std::set<OffsetT> columns;
+            OffsetT block_end = std::min(num_rows, (block + 1) * BLOCK_ROWS);
+            for (OffsetT row = block * BLOCK_ROWS; row < block_end; ++row)
+            {
+                long long length    = row_offsets[row + 1] - row_offsets[row];
+                long long width     = std::max(window, length);
+                long long diagonal  = (long long) row * num_cols / num_rows;
+                long long start     = std::max(0ll, std::min(diagonal - (width / 2), num_cols - width));
+
+                columns.clear();
+                for (long long j = width - length; j < width; ++j)
+                {
+                    OffsetT col = OffsetT(start + RandomMatrixParams::Below(state, j + 1));
+                    if (!columns.insert(col).second)
+                        columns.insert(OffsetT(start + j));
+                }
+
+                OffsetT nz = row_offsets[row];
+                for (typename std::set<OffsetT>::iterator it = columns.begin(); it != columns.end(); ++it, ++nz)
+                {
+                    column_indices[nz]  = *it;
+                    values[nz]          = default_value;
+                }
+            }
+        }
+    }
+
+
+    /**
+     * Clear
+     */
+    void Clear()
+    {
+        HostFree(row_offsets, sizeof(OffsetT) * (num_rows + 1));
+        HostFree(column_indices, sizeof(OffsetT) * num_nonzeros);
+        HostFree(values, sizeof(ValueT) * num_nonzeros);
+
         row_offsets = NULL;
         column_indices = NULL;
         values = NULL;
@@ -765,6 +1388,28 @@ struct CsrMatrix
     }
 
 
+    /**
+     * Exchange contents with another matrix
+     */
+    void Swap(CsrMatrix &other)
+    {
+        std::swap(num_rows, other.num_rows);
+        std::swap(num_cols, other.num_cols);
+        std::swap(num_nonzeros, other.num_nonzeros);
+        std::swap(row_offsets, other.row_offsets);
+        std::swap(column_indices, other.column_indices);
+        std::swap(values, other.values);
+    }
+
+
+    /**
+     * Constructor (empty; see Init() and InitRmat())
+     */
+    CsrMatrix() :
+        num_rows(0), num_cols(0), num_nonzeros(0), row_offsets(NULL), column_indices(NULL), values(NULL)
+    {}
+
+
     /**
      * Constructor
      */
@@ -790,10 +1435,7 @@ struct CsrMatrix
      */
     GraphStats Stats()
     {
-        GraphStats stats;
-        stats.num_rows = num_rows;
-        stats.num_cols = num_cols;
-        stats.num_nonzeros = num_nonzeros;
+        GraphStats stats = RowLengthStats();
 
         //
         // Compute diag-distance statistics
@@ -802,11 +1444,17 @@ struct CsrMatrix
         OffsetT samples     = 0;
         double  mean        = 0.0;
         double  ss_tot      = 0.0;
+        double  max_x       = 0.0;
+        OffsetT line_hits   = 0;
+
+        // Columns per 64-byte line of an fp64 vector_x
+        const OffsetT ITEMS_PER_LINE = 8;
 
         for (OffsetT row = 0; row < num_rows; ++row)
         {
             OffsetT nz_idx_start    = row_offsets[row];
             OffsetT nz_idx_end      = row_offsets[row + 1];
+            OffsetT previous_line   = -1;
 
             for (int nz_idx = nz_idx_start; nz_idx < nz_idx_end; ++nz_idx)
             {
@@ -817,9 +1465,23 @@ struct CsrMatrix
                 double delta            = x - mean;
                 mean                    = mean + (delta / samples);
                 ss_tot                  += delta * (x - mean);
+                max_x                   = std::max(max_x, x);
+
+                OffsetT line            = col / ITEMS_PER_LINE;
+                if (line == previous_line)
+                    line_hits++;
+                previous_line           = line;
             }
         }
 
+        if (num_cols > 0)
+        {
+            stats.diag_distance_mean    = mean / num_cols;
+            stats.diag_distance_max     = max_x / num_cols;
+        }
+        if (num_nonzeros > 0)
+            stats.x_line_reuse          = double(line_hits) / num_nonzeros;
+
         //
         // Compute deming statistics
         //
@@ -894,31 +1556,38 @@ struct CsrMatrix
 
         stats.pearson_r = (num_nonzeros * s_xy) / (sqrt(ss_x) * sqrt(ss_y));
 
-        //
-        // Compute row-length statistics
-        //
+        return stats;
+    }
 
-        // Sample mean
-        stats.row_length_mean       = double(num_nonzeros) / num_rows;
-        OffsetT max                 = 0;
-        double variance             = 0.0;
-        stats.row_length_skewness   = 0.0;
-        for (OffsetT row = 0; row < num_rows; ++row)
-        {
-            OffsetT length              = row_offsets[row + 1] - row_offsets[row];
-            if (length > max)
-                max = length;
-            double delta                = double(length) - stats.row_length_mean;
-            variance   += (delta * delta);
-            stats.row_length_skewness   += (delta * delta * delta);
-        }
-        variance                    /= num_rows;
-        stats.row_length_std_dev    = sqrt(variance);
-        stats.row_length_skewness   = (stats.row_length_skewness / num_rows) / pow(stats.row_length_std_dev, 3.0);
-        stats.row_length_variation  = stats.row_length_std_dev / stats.row_length_mean;
-        stats.row_length_max = max;
 
-        return stats;
+    /**
+     * Get the dimensions and row-length statistics only (a single pass over
+     * row_offsets; pearson_r and the locality statistics are left zero)
+     */
+    GraphStats RowLengthStats()
+    {
+        return CsrView<ValueT, OffsetT>(*this).RowLengthStats();
+    }
+
+
+    /**
+     * Hash of the dimensions and sparsity structure (FNV-1a over row_offsets
+     * and column_indices), identifying a matrix across runs
+     */
+    unsigned long long Fingerprint()
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        const unsigned long long PRIME = 1099511628211ull;
+
+        hash = (hash ^ (unsigned long long) num_rows) * PRIME;
+        hash = (hash ^ (unsigned long long) num_cols) * PRIME;
+        hash = (hash ^ (unsigned long long) num_nonzeros) * PRIME;
+        for (OffsetT row = 0; row <= num_rows; ++row)
+            hash = (hash ^ (unsigned long long) row_offsets[row]) * PRIME;
+        for (OffsetT nz = 0; nz < num_nonzeros; ++nz)
+            hash = (hash ^ (unsigned long long) column_indices[nz]) * PRIME;
+
+        return hash;
     }
 
 
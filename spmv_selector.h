@@ -0,0 +1,180 @@
+/******************************************************************************
+ * SpMV method selector (generated by train_selector.py; do not edit)
+ *
+ * Trained on 145 samples from 84 matrices: fp64.csv, fp32.csv
+ * Measured on Intel(R) Xeon(R) Processor (vm), gcc 12.2.0
+ * Oracle picks: csr 75, lengoto 26, merge 44
+ * max_depth 6, min_leaf 2
+ * Training accuracy 91.7%, geomean slowdown vs. oracle 1.014x
+ * 5-fold (by matrix) accuracy 69.7%, geomean slowdown vs. oracle 1.061x
+ * Best single method: merge, accuracy 30.3%, geomean slowdown vs. oracle 1.118x
+ ******************************************************************************/
+
+#pragma once
+
+#include "sparse_matrix.h"
+
+/// Training conditions: thread counts, and CPU model (empty if several)
+#define SPMV_SELECTOR_MIN_THREADS   1
+#define SPMV_SELECTOR_MAX_THREADS   1
+#define SPMV_SELECTOR_CPU_MODEL     "Intel(R) Xeon(R) Processor"
+
+
+/**
+ * Predicted fastest method (a registry name) for a matrix with these
+ * statistics, value size, and thread count
+ */
+inline const char* SpmvSelectorPredict(const GraphStats &stats, int value_bytes, int threads)
+{
+    (void) threads;
+    (void) value_bytes;
+
+    if (double(value_bytes) <= 6)
+    {
+        if (stats.row_length_mean <= 2.956415)
+        {
+            if (stats.diag_distance_max <= 0.000675)
+            {
+                return "csr";
+            }
+            else
+            {
+                return "merge";
+            }
+        }
+        else
+        {
+            if (double(stats.num_nonzeros) <= 281329)
+            {
+                if (stats.row_length_std_dev <= 1.684635)
+                {
+                    if (stats.row_length_skewness <= 0.056845)
+                    {
+                        return "csr";
+                    }
+                    else
+                    {
+                        return "merge";
+                    }
+                }
+                else
+                {
+                    return "csr";
+                }
+            }
+            else
+            {
+                if (stats.row_length_skewness <= 0.034615)
+                {
+                    return "csr";
+                }
+                else
+                {
+                    return "merge";
+                }
+            }
+        }
+    }
+    else
+    {
+        if (stats.row_length_skewness <= 0.074995)
+        {
+            if (stats.row_length_mean <= 3.508525)
+            {
+                if (stats.row_length_mean <= 3.410445)
+                {
+                    if (stats.row_length_variation <= 0.47996)
+                    {
+                        if (stats.row_length_mean <= 2.999905)
+                        {
+                            return "lengoto";
+                        }
+                        else
+                        {
+                            return "merge";
+                        }
+                    }
+                    else
+                    {
+                        return "lengoto";
+                    }
+                }
+                else
+                {
+                    return "merge";
+                }
+            }
+            else
+            {
+                if (stats.row_length_skewness <= 0.01701)
+                {
+                    return "lengoto";
+                }
+                else
+                {
+                    if (stats.row_length_variation <= 0.554905)
+                    {
+                        return "csr";
+                    }
+                    else
+                    {
+                        return "lengoto";
+                    }
+                }
+            }
+        }
+        else
+        {
+            if (stats.row_length_std_dev <= 12.18042)
+            {
+                if (stats.x_line_reuse <= 0.29173)
+                {
+                    if (double(stats.num_nonzeros) <= 277556.5)
+                    {
+                        return "merge";
+                    }
+                    else
+                    {
+                        return "csr";
+                    }
+                }
+                else
+                {
+                    if (stats.diag_distance_max <= 0.0225)
+                    {
+                        if (stats.x_line_reuse <= 0.29714)
+                        {
+                            return "csr";
+                        }
+                        else
+                        {
+                            return "merge";
+                        }
+                    }
+                    else
+                    {
+                        return "csr";
+                    }
+                }
+            }
+            else
+            {
+                if (stats.row_length_variation <= 4.91206)
+                {
+                    if (double(stats.row_length_max) <= 1153)
+                    {
+                        return "csr";
+                    }
+                    else
+                    {
+                        return "merge";
+                    }
+                }
+                else
+                {
+                    return "csr";
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+"""
+Train the SpMV method selector from benchmark results and emit it as a C++
+header (spmv_selector.h) for `cpu_spmv --autotune=model`.
+
+Inputs are results files written by `cpu_spmv --output=<file>` or by batch mode
+(`--list ... --results=<file>`), as CSV or JSON Lines.  For each
+(matrix, value type, thread count) the oracle is the fastest method with a
+correct result; a CART decision tree (Gini impurity) is fit to predict it from
+the matrix statistics.  The report gives the tree's accuracy against the
+oracle, on the training set and by k-fold cross-validation over matrices, and
+the geometric-mean slowdown of its picks relative to the oracle next to that
+of the best single method.
+
+Usage:
+    ./train_selector.py [--max-depth=6] [--min-leaf=2] [--folds=5]
+                        [--header=spmv_selector.h] <results file>...
+
+Only the standard library is needed.
+"""
+
+import csv
+import json
+import math
+import sys
+import zlib
+from collections import Counter, OrderedDict
+
+# Feature name -> C++ expression over (stats, value_bytes, threads)
+FEATURES = OrderedDict([
+    ("num_rows",             "double(stats.num_rows)"),
+    ("num_cols",             "double(stats.num_cols)"),
+    ("num_nonzeros",         "double(stats.num_nonzeros)"),
+    ("row_length_mean",      "stats.row_length_mean"),
+    ("row_length_max",       "double(stats.row_length_max)"),
+    ("row_length_std_dev",   "stats.row_length_std_dev"),
+    ("row_length_variation", "stats.row_length_variation"),
+    ("row_length_skewness",  "stats.row_length_skewness"),
+    ("pearson_r",            "stats.pearson_r"),
+    ("diag_distance_mean",   "stats.diag_distance_mean"),
+    ("diag_distance_max",    "stats.diag_distance_max"),
+    ("x_line_reuse",         "stats.x_line_reuse"),
+    ("value_bytes",          "double(value_bytes)"),
+    ("threads",              "double(threads)"),
+    ("x_bytes",              "double(value_bytes) * stats.num_cols"),
+])
+
+
+#-----------------------------------------------------------------------------
+# Results loading
+#-----------------------------------------------------------------------------
+
+def read_records(filename):
+    with open(filename) as f:
+        if ".json" in filename:
+            for line in f:
+                line = line.strip()
+                if line:
+                    yield {k: ("" if v is None else str(v).lower() if isinstance(v, bool) else str(v))
+                           for k, v in json.loads(line).items()}
+        else:
+            for row in csv.DictReader(f, skipinitialspace=True):
+                yield row
+
+
+def to_float(text):
+    try:
+        value = float(text)
+    except (TypeError, ValueError):
+        return None
+    return value if math.isfinite(value) else None
+
+
+def load_samples(filenames, machines, cpu_models):
+    """
+    Group timed records by (matrix, value type, threads).  Returns a list of
+    samples: (matrix, feature vector, {method: avg_ms}), and adds the
+    "cpu_model (host), compiler" of each record to machines and its cpu_model
+    to cpu_models.  Sweep records
+    are skipped (their thread placement differs from a regular run); later
+    records of the same method replace earlier ones.
+    """
+    groups = OrderedDict()
+    for filename in filenames:
+        for record in read_records(filename):
+            if record.get("status") != "ok" or record.get("correct") != "true":
+                continue
+            if record.get("affinity", "").startswith("sweep"):
+                continue
+            avg_ms = to_float(record.get("avg_ms"))
+            threads = to_float(record.get("threads"))
+            if avg_ms is None or avg_ms <= 0 or threads is None:
+                continue
+
+            machines.add("%s (%s), %s" % (record.get("cpu_model"), record.get("host"), record.get("compiler")))
+            cpu_models.add(record.get("cpu_model") or "")
+            value_bytes = 4 if record.get("value_type") == "fp32" else 8
+            key = (record["matrix"], value_bytes, int(threads))
+            if key not in groups:
+                features = []
+                for name in FEATURES:
+                    if name == "value_bytes":
+                        value = value_bytes
+                    elif name == "threads":
+                        value = threads
+                    elif name == "x_bytes":
+                        value = value_bytes * (to_float(record.get("num_cols")) or 0.0)
+                    else:
+                        value = to_float(record.get(name))
+                    features.append(0.0 if value is None else value)
+                groups[key] = (features, {})
+            groups[key][1][record["method"]] = avg_ms
+
+    return [(key[0], features, times) for key, (features, times) in groups.items()]
+
+
+def oracle(times):
+    return min(sorted(times), key=lambda m: times[m])
+
+
+#-----------------------------------------------------------------------------
+# CART decision tree
+#-----------------------------------------------------------------------------
+
+def gini(counts, total):
+    return 1.0 - sum((c / total) ** 2 for c in counts.values())
+
+
+def majority(labels):
+    counts = Counter(labels)
+    return max(sorted(counts), key=lambda label: counts[label])
+
+
+def best_split(rows, labels, min_leaf):
+    """The (feature, threshold) split minimizing weighted Gini impurity, or None"""
+    total = len(labels)
+    parent = gini(Counter(labels), total)
+    best = None
+    best_impurity = parent - 1e-12
+    for f in range(len(FEATURES)):
+        order = sorted(range(total), key=lambda i: rows[i][f])
+        left, right = Counter(), Counter(labels)
+        for n in range(1, total):
+            label = labels[order[n - 1]]
+            left[label] += 1
+            right[label] -= 1
+            lo, hi = rows[order[n - 1]][f], rows[order[n]][f]
+            if lo == hi or n < min_leaf or total - n < min_leaf:
+                continue
+            impurity = (n * gini(left, n) + (total - n) * gini(+right, total - n)) / total
+            if impurity < best_impurity:
+                best_impurity = impurity
+                best = (f, (lo + hi) / 2.0)
+    return best
+
+
+def fit(rows, labels, max_depth, min_leaf):
+    """Nodes are ("leaf", label) or ("split", feature, threshold, left, right)"""
+    if max_depth == 0 or len(set(labels)) == 1:
+        return ("leaf", majority(labels))
+    split = best_split(rows, labels, min_leaf)
+    if split is None:
+        return ("leaf", majority(labels))
+    f, threshold = split
+    left = [i for i in range(len(rows)) if rows[i][f] <= threshold]
+    right = [i for i in range(len(rows)) if rows[i][f] > threshold]
+    left_node = fit([rows[i] for i in left], [labels[i] for i in left], max_depth - 1, min_leaf)
+    right_node = fit([rows[i] for i in right], [labels[i] for i in right], max_depth - 1, min_leaf)
+    if left_node[0] == "leaf" and right_node[0] == "leaf" and left_node[1] == right_node[1]:
+        return left_node
+    return ("split", f, threshold, left_node, right_node)
+
+
+def predict(node, features):
+    while node[0] == "split":
+        node = node[3] if features[node[1]] <= node[2] else node[4]
+    return node[1]
+
+
+#-----------------------------------------------------------------------------
+# Evaluation
+#-----------------------------------------------------------------------------
+
+def slowdown(method, times):
+    """
+    Time of the chosen method relative to the oracle.  A method that was not
+    measured for the sample (e.g., unsupported) is charged the slowest
+    measured time.
+    """
+    best = min(times.values())
+    return times.get(method, max(times.values())) / best
+
+
+def evaluate(picks, samples):
+    hits = sum(1 for pick, (_, _, times) in zip(picks, samples) if pick == oracle(times))
+    log_slowdown = sum(math.log(slowdown(pick, times)) for pick, (_, _, times) in zip(picks, samples))
+    return hits / len(samples), math.exp(log_slowdown / len(samples))
+
+
+def fold_of(matrix, folds):
+    return zlib.crc32(matrix.encode()) % folds
+
+
+def cross_validate(samples, folds, max_depth, min_leaf):
+    """Picks for each sample from a tree trained without any sample of the same matrix"""
+    picks = [None] * len(samples)
+    for k in range(folds):
+        train = [s for s in samples if fold_of(s[0], folds) != k]
+        if not train:
+            continue
+        tree = fit([s[1] for s in train], [oracle(s[2]) for s in train], max_depth, min_leaf)
+        for i, s in enumerate(samples):
+            if fold_of(s[0], folds) == k:
+                picks[i] = predict(tree, s[1])
+    fallback = majority([oracle(s[2]) for s in samples])
+    return [pick if pick is not None else fallback for pick in picks]
+
+
+#-----------------------------------------------------------------------------
+# Header generation
+#-----------------------------------------------------------------------------
+
+def emit_node(node, depth, lines):
+    indent = "    " * depth
+    if node[0] == "leaf":
+        lines.append('%sreturn "%s";' % (indent, node[1]))
+        return
+    _, f, threshold, left, right = node
+    lines.append("%sif (%s <= %.9g)" % (indent, list(FEATURES.values())[f], threshold))
+    lines.append("%s{" % indent)
+    emit_node(left, depth + 1, lines)
+    lines.append("%s}" % indent)
+    lines.append("%selse" % indent)
+    lines.append("%s{" % indent)
+    emit_node(right, depth + 1, lines)
+    lines.append("%s}" % indent)
+
+
+def emit_header(tree, filename, provenance, threads, cpu_models):
+    lines = []
+    emit_node(tree, 1, lines)
+    with open(filename, "w") as f:
+        f.write("/******************************************************************************\n")
+        f.write(" * SpMV method selector (generated by train_selector.py; do not edit)\n")
+        f.write(" *\n")
+        for line in provenance:
+            f.write((" * " + line).rstrip() + "\n")
+        f.write(" ******************************************************************************/\n\n")
+        f.write("#pragma once\n\n")
+        f.write('#include "sparse_matrix.h"\n\n')
+        f.write("/// Training conditions: thread counts, and CPU model (empty if several)\n")
+        f.write("#define SPMV_SELECTOR_MIN_THREADS   %d\n" % min(threads))
+        f.write("#define SPMV_SELECTOR_MAX_THREADS   %d\n" % max(threads))
+        f.write('#define SPMV_SELECTOR_CPU_MODEL     "%s"\n\n\n' % (
+            list(cpu_models)[0].replace("\\", "\\\\").replace('"', '\\"') if len(cpu_models) == 1 else ""))
+        f.write("/**\n")
+        f.write(" * Predicted fastest method (a registry name) for a matrix with these\n")
+        f.write(" * statistics, value size, and thread count\n")
+        f.write(" */\n")
+        f.write("inline const char* SpmvSelectorPredict(const GraphStats &stats, int value_bytes, int threads)\n")
+        f.write("{\n")
+        f.write("    (void) threads;\n")
+        f.write("    (void) value_bytes;\n\n")
+        f.write("\n".join(lines) + "\n")
+        f.write("}\n")
+
+
+#-----------------------------------------------------------------------------
+# Main
+#-----------------------------------------------------------------------------
+
+def main(argv):
+    max_depth, min_leaf, folds, header = 6, 2, 5, "spmv_selector.h"
+    filenames = []
+    for arg in argv[1:]:
+        if arg.startswith("--max-depth="):
+            max_depth = int(arg.split("=", 1)[1])
+        elif arg.startswith("--min-leaf="):
+            min_leaf = int(arg.split("=", 1)[1])
+        elif arg.startswith("--folds="):
+            folds = int(arg.split("=", 1)[1])
+        elif arg.startswith("--header="):
+            header = arg.split("=", 1)[1]
+        elif arg.startswith("--"):
+            sys.stderr.write(__doc__)
+            return 1
+        else:
+            filenames.append(arg)
+    if not filenames:
+        sys.stderr.write(__doc__)
+        return 1
+
+    # Samples need at least two timed methods to say anything about selection
+    machines, cpu_models = set(), set()
+    samples = [s for s in load_samples(filenames, machines, cpu_models) if len(s[2]) >= 2]
+    if not samples:
+        sys.stderr.write("No (matrix, value type, threads) with two or more correct timed methods\n")
+        return 1
+
+    labels = [oracle(s[2]) for s in samples]
+    tree = fit([s[1] for s in samples], labels, max_depth, min_leaf)
+
+    methods = sorted(set(m for s in samples for m in s[2]))
+    train_accuracy, train_slowdown = evaluate([predict(tree, s[1]) for s in samples], samples)
+    cv_accuracy, cv_slowdown = evaluate(cross_validate(samples, folds, max_depth, min_leaf), samples)
+    single = dict((m, evaluate([m] * len(samples), samples)) for m in methods)
+    best_single = min(methods, key=lambda m: single[m][1])
+
+    report = [
+        "Trained on %d samples from %d matrices: %s" % (
+            len(samples), len(set(s[0] for s in samples)), ", ".join(filenames)),
+        "Measured on %s" % "; ".join(sorted(machines)),
+        "Oracle picks: %s" % ", ".join("%s %d" % (m, c) for m, c in sorted(Counter(labels).items())),
+        "max_depth %d, min_leaf %d" % (max_depth, min_leaf),
+        "Training accuracy %.1f%%, geomean slowdown vs. oracle %.3fx" % (100 * train_accuracy, train_slowdown),
+        "%d-fold (by matrix) accuracy %.1f%%, geomean slowdown vs. oracle %.3fx" % (folds, 100 * cv_accuracy, cv_slowdown),
+        "Best single method: %s, accuracy %.1f%%, geomean slowdown vs. oracle %.3fx" % (
+            best_single, 100 * single[best_single][0], single[best_single][1]),
+    ]
+    for line in report:
+        print(line)
+
+    threads = [int(s[1][list(FEATURES).index("threads")]) for s in samples]
+    emit_header(tree, header, report, threads, cpu_models)
+    print("Wrote %s" % header)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -35,9 +35,15 @@
 #else
     #include <sys/resource.h>
     #include <time.h>
+    #include <unistd.h>
+#endif
+
+#ifdef __linux__
+    #include <sched.h>
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <map>
@@ -48,12 +54,18 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <cmath>
 #include <float.h>
 
-#ifdef CUB_MKL
+#ifdef _OPENMP
     #include "omp.h"
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #include <emmintrin.h>
+    #define CUB_CLFLUSH
+#endif
+
 
 /******************************************************************************
  * Assertion macros
@@ -81,12 +93,23 @@ const unsigned int MATRIX_A   = 0x9908b0df; /* constant vector a */
 const unsigned int UPPER_MASK = 0x80000000; /* most significant w-r bits */
 const unsigned int LOWER_MASK = 0x7fffffff; /* least significant r bits */
 
-static unsigned int mt[N];  /* the array for the state vector  */
-static int mti = N + 1;     /* mti==N+1 means mt[N] is not initialized */
+/* generator state; the overloads without a state use a global one */
+struct State
+{
+    unsigned int mt[N];     /* the array for the state vector  */
+    int mti;                /* mti==N+1 means mt[N] is not initialized */
+
+    State() : mti(N + 1) {}
+};
+
+static State g_state;
 
 /* initializes mt[N] with a seed */
-void init_genrand(unsigned int s)
+inline void init_genrand(State &state, unsigned int s)
 {
+    unsigned int *mt = state.mt;
+    int &mti = state.mti;
+
     mt[0] = s & 0xffffffff;
     for (mti = 1; mti < N; mti++)
     {
@@ -106,10 +129,11 @@ void init_genrand(unsigned int s)
 /* init_key is the array for initializing keys */
 /* key_length is its length */
 /* slight change for C++, 2004/2/26 */
-void init_by_array(unsigned int init_key[], int key_length)
+inline void init_by_array(State &state, unsigned int init_key[], int key_length)
 {
+    unsigned int *mt = state.mt;
     int i, j, k;
-    init_genrand(19650218);
+    init_genrand(state, 19650218);
     i = 1;
     j = 0;
     k = (N > key_length ? N : key_length);
@@ -143,8 +167,10 @@ void init_by_array(unsigned int init_key[], int key_length)
 }
 
 /* generates a random number on [0,0xffffffff]-interval */
-unsigned int genrand_int32(void)
+inline unsigned int genrand_int32(State &state)
 {
+    unsigned int *mt = state.mt;
+    int &mti = state.mti;
     unsigned int y;
     static unsigned int mag01[2] = { 0x0, MATRIX_A };
 
@@ -155,7 +181,7 @@ unsigned int genrand_int32(void)
         int kk;
 
         if (mti == N + 1) /* if init_genrand() has not been called, */
-        init_genrand(5489); /* a defat initial seed is used */
+        init_genrand(state, 5489); /* a defat initial seed is used */
 
         for (kk = 0; kk < N - M; kk++)
         {
@@ -184,6 +210,20 @@ unsigned int genrand_int32(void)
     return y;
 }
 
+inline void init_genrand(unsigned int s)
+{
+    init_genrand(g_state, s);
+}
+
+inline void init_by_array(unsigned int init_key[], int key_length)
+{
+    init_by_array(g_state, init_key, key_length);
+}
+
+inline unsigned int genrand_int32(void)
+{
+    return genrand_int32(g_state);
+}
 
 
 } // namespace mersenne
@@ -526,7 +566,7 @@ struct CommandLineArgs
 //---------------------------------------------------------------------
 
 
-#ifdef CUB_MKL
+#ifdef _OPENMP
 
 /**
  * CPU timer (use omp wall timer because rusage accumulates time from all threads)
@@ -614,7 +654,420 @@ struct CpuTimer
 
 
 
-#endif  // CUB_MKL
+#endif  // _OPENMP
+
+
+/**
+ * Monotonic wall-clock time in seconds (cheap enough to read once per SpMV)
+ */
+inline double WallClockSeconds()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    LARGE_INTEGER ll_freq, ll_now;
+    QueryPerformanceFrequency(&ll_freq);
+    QueryPerformanceCounter(&ll_now);
+    return double(ll_now.QuadPart) / double(ll_freq.QuadPart);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) * 1.0e-9;
+#endif
+}
+
+
+/**
+ * Records one timestamp per iteration into a buffer allocated up front, so
+ * that timing a loop costs a single clock read per iteration.  Iteration i
+ * takes stamps[i + 1] - stamps[i].
+ */
+struct IterationTimer
+{
+    int         num_iterations;
+    double*     stamps;
+
+    IterationTimer(int num_iterations) :
+        num_iterations(num_iterations),
+        stamps(new double[num_iterations + 1])
+    {}
+
+    ~IterationTimer()
+    {
+        delete[] stamps;
+    }
+
+    /// Mark the start of iteration i (or the end of the loop when i == num_iterations)
+    void Mark(int i)
+    {
+        stamps[i] = WallClockSeconds();
+    }
+
+    /// Milliseconds taken by iteration i
+    double IterationMillis(int i)
+    {
+        return (stamps[i + 1] - stamps[i]) * 1000.0;
+    }
+
+    /// Milliseconds taken by the whole loop
+    double ElapsedMillis()
+    {
+        return (stamps[num_iterations] - stamps[0]) * 1000.0;
+    }
+};
+
+
+/**
+ * Distribution of per-iteration times
+ */
+struct TimingStats
+{
+    int         num_samples;
+    double      mean_ms;
+    double      min_ms;
+    double      median_ms;
+    double      p90_ms;
+    double      p99_ms;
+    double      max_ms;
+    double      std_dev_ms;
+    double      variation;      // coefficient of variation (std_dev / mean)
+
+    TimingStats() :
+        num_samples(0), mean_ms(0), min_ms(0), median_ms(0), p90_ms(0),
+        p99_ms(0), max_ms(0), std_dev_ms(0), variation(0)
+    {}
+
+    /// Nearest-rank percentile of sorted samples
+    static double Percentile(const std::vector<double> &sorted, double p)
+    {
+        int rank = int(p * sorted.size() + 0.999999) - 1;
+        rank = std::max(0, std::min(rank, int(sorted.size()) - 1));
+        return sorted[rank];
+    }
+
+    void Compute(IterationTimer &timer)
+    {
+        std::vector<double> samples(timer.num_iterations);
+        for (int i = 0; i < timer.num_iterations; ++i)
+            samples[i] = timer.IterationMillis(i);
+        Compute(samples);
+    }
+
+    void Compute(std::vector<double> samples)
+    {
+        num_samples = int(samples.size());
+        if (num_samples == 0)
+            return;
+
+        double sum = 0.0;
+        for (int i = 0; i < num_samples; ++i)
+            sum += samples[i];
+        mean_ms = sum / num_samples;
+
+        double ss = 0.0;
+        for (int i = 0; i < num_samples; ++i)
+            ss += (samples[i] - mean_ms) * (samples[i] - mean_ms);
+        std_dev_ms  = (num_samples > 1) ? sqrt(ss / (num_samples - 1)) : 0.0;
+        variation   = (mean_ms > 0.0) ? std_dev_ms / mean_ms : 0.0;
+
+        std::sort(samples.begin(), samples.end());
+        min_ms      = samples.front();
+        median_ms   = Percentile(samples, 0.50);
+        p90_ms      = Percentile(samples, 0.90);
+        p99_ms      = Percentile(samples, 0.99);
+        max_ms      = samples.back();
+    }
+
+    /// Whether the run is too noisy for its mean to be trusted
+    bool Noisy(double max_variation) const
+    {
+        return (variation > max_variation);
+    }
+};
+
+
+/**
+ * Evicts the caches between timed iterations, either by streaming through a
+ * buffer larger than the last-level cache or by clflush-ing registered arrays
+ * (x86 only; falls back to streaming elsewhere).
+ */
+struct CacheFlusher
+{
+    bool                                        clflush;
+    size_t                                      buffer_bytes;
+    char*                                       buffer;
+    std::vector<std::pair<char*, size_t> >      regions;
+    volatile char                               sink;
+
+    CacheFlusher() : clflush(false), buffer_bytes(0), buffer(NULL), sink(0) {}
+
+    ~CacheFlusher()
+    {
+        delete[] buffer;
+    }
+
+    /**
+     * Size of one last-level cache instance (64MB if it cannot be determined)
+     */
+    static size_t LastLevelCacheBytes()
+    {
+        long bytes = 0;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+        bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (bytes <= 0)
+        {
+            // e.g., "32768K"
+            std::ifstream ifs("/sys/devices/system/cpu/cpu0/cache/index3/size");
+            char unit = 0;
+            if (ifs >> bytes >> unit)
+                bytes *= (unit == 'M') ? (1 << 20) : (unit == 'K') ? (1 << 10) : 1;
+        }
+#endif
+        return (bytes > 0) ? size_t(bytes) : size_t(64) << 20;
+    }
+
+    /**
+     * Initialize for streaming (through buffer_bytes, or twice llc_instances
+     * last-level caches if zero), or for clflush of the regions added later
+     */
+    void Init(bool clflush, size_t buffer_bytes = 0, int llc_instances = 1)
+    {
+#ifdef CUB_CLFLUSH
+        this->clflush = clflush;
+#endif
+        if (this->clflush)
+            return;
+
+        if (buffer_bytes == 0)
+            buffer_bytes = 2 * LastLevelCacheBytes() * std::max(llc_instances, 1);
+
+        this->buffer_bytes  = buffer_bytes;
+        buffer              = new char[buffer_bytes];
+
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < (long long) buffer_bytes; i += 64)
+            buffer[i] = char(i);
+    }
+
+    /// Register an array to be clflush-ed
+    void AddRegion(void* ptr, size_t bytes)
+    {
+        regions.push_back(std::make_pair((char*) ptr, bytes));
+    }
+
+    /// Unregister the arrays added since there were num_regions
+    void RemoveRegions(size_t num_regions)
+    {
+        regions.resize(std::min(num_regions, regions.size()));
+    }
+
+    void Flush()
+    {
+#ifdef CUB_CLFLUSH
+        if (clflush)
+        {
+            for (int r = 0; r < int(regions.size()); ++r)
+            {
+                char*       begin   = (char*) (size_t(regions[r].first) & ~size_t(63));
+                long long   bytes   = (long long) (regions[r].first + regions[r].second - begin);
+
+                #pragma omp parallel for schedule(static)
+                for (long long i = 0; i < bytes; i += 64)
+                    _mm_clflush(begin + i);
+            }
+            _mm_mfence();
+            return;
+        }
+#endif
+        char sum = 0;
+        #pragma omp parallel for schedule(static) reduction(+:sum)
+        for (long long i = 0; i < (long long) buffer_bytes; i += 64)
+            sum += buffer[i];
+        sink = sum;
+    }
+};
+
+
+/**
+ * Hardware threads available to the process, split into one per physical core
+ * and the remaining SMT siblings.  Without topology information every
+ * hardware thread is treated as a core.
+ */
+struct CpuTopology
+{
+    std::vector<int> core_cpus;     // First hardware thread of each physical core, by cpu id
+    std::vector<int> smt_cpus;      // Remaining hardware threads, by cpu id
+
+    void Init()
+    {
+        core_cpus.clear();
+        smt_cpus.clear();
+
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &mask))
+                    cpus.push_back(cpu);
+        }
+#endif
+        if (cpus.empty())
+        {
+#ifdef _OPENMP
+            int num_procs = omp_get_num_procs();
+#else
+            int num_procs = 1;
+#endif
+            for (int cpu = 0; cpu < num_procs; ++cpu)
+                cpus.push_back(cpu);
+        }
+
+        std::vector<std::pair<int, int> > seen_cores;     // (package, core)
+        for (size_t i = 0; i < cpus.size(); ++i)
+        {
+            int package = -1, core = -1;
+#ifdef __linux__
+            char path[128];
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpus[i]);
+            std::ifstream package_file(path);
+            package_file >> package;
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpus[i]);
+            std::ifstream core_file(path);
+            core_file >> core;
+#endif
+            std::pair<int, int> id(package, (core < 0) ? -1 - cpus[i] : core);
+            if (std::find(seen_cores.begin(), seen_cores.end(), id) == seen_cores.end())
+            {
+                seen_cores.push_back(id);
+                core_cpus.push_back(cpus[i]);
+            }
+            else
+            {
+                smt_cpus.push_back(cpus[i]);
+            }
+        }
+    }
+
+    int NumCores() const    { return int(core_cpus.size()); }
+    int NumCpus() const     { return int(core_cpus.size() + smt_cpus.size()); }
+
+    /// Hardware thread for thread tid: distinct physical cores first, then SMT siblings
+    int Placement(int tid) const
+    {
+        int cpu = tid % NumCpus();
+        return (cpu < NumCores()) ? core_cpus[cpu] : smt_cpus[cpu - NumCores()];
+    }
+
+    /**
+     * Pin each thread of a team of num_threads OpenMP threads to its
+     * placement.  The runtime reuses the same threads for later parallel
+     * regions of the same size, which keep the pinning.
+     */
+    bool PinThreads(int num_threads) const
+    {
+        int num_pinned = 0;
+#ifdef __linux__
+        #pragma omp parallel for schedule(static) num_threads(num_threads) reduction(+:num_pinned)
+        for (int tid = 0; tid < num_threads; tid++)
+        {
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            CPU_SET(Placement(tid), &mask);
+            if (sched_setaffinity(0, sizeof(mask), &mask) == 0)
+                num_pinned++;
+        }
+#endif
+        return (num_pinned == num_threads);
+    }
+};
+
+
+/**
+ * Compiler name and version this binary was built with
+ */
+inline std::string CompilerDescription()
+{
+#if defined(__INTEL_COMPILER)
+    std::ostringstream oss;
+    oss << "icc " << __INTEL_COMPILER;
+    return oss.str();
+#elif defined(__clang__)
+    return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+    std::ostringstream oss;
+    oss << "msvc " << _MSC_VER;
+    return oss.str();
+#else
+    return "unknown";
+#endif
+}
+
+
+/**
+ * CPU model name (from /proc/cpuinfo where available)
+ */
+inline std::string CpuModelName()
+{
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.compare(0, 10, "model name") == 0)
+        {
+            size_t colon = line.find(':');
+            size_t start = (colon == std::string::npos) ? colon : line.find_first_not_of(" \t", colon + 1);
+            if (start != std::string::npos)
+                return line.substr(start);
+        }
+    }
+    return "unknown";
+}
+
+
+/**
+ * Host name of the machine
+ */
+inline std::string HostName()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    char name[256];
+    if (gethostname(name, sizeof(name)) == 0)
+    {
+        name[sizeof(name) - 1] = '\0';
+        return name;
+    }
+#endif
+    return "unknown";
+}
+
+
+/**
+ * Thread affinity settings of the OpenMP runtime, from the environment
+ * (e.g., "OMP_PROC_BIND=spread OMP_PLACES=cores"), or "none"
+ */
+inline std::string AffinityDescription()
+{
+    const char *variables[] = { "OMP_PROC_BIND", "OMP_PLACES", "KMP_AFFINITY", "GOMP_CPU_AFFINITY" };
+
+    std::string description;
+    for (int i = 0; i < int(sizeof(variables) / sizeof(variables[0])); ++i)
+    {
+        const char *value = getenv(variables[i]);
+        if (value && *value)
+        {
+            if (!description.empty())
+                description += " ";
+            description += std::string(variables[i]) + "=" + value;
+        }
+    }
+    return description.empty() ? "none" : description;
+}
+
 
 #ifdef __NVCC__
 
@@ -725,6 +1178,27 @@ int CompareResults(double* computed, double* reference, OffsetT len, bool verbos
 }
 
 
+/**
+ * Compares the equivalence of two arrays (fp32 results may differ from the
+ * reference in the order of accumulation, e.g., when vectorized)
+ */
+template <typename OffsetT>
+int CompareResults(float* computed, float* reference, OffsetT len, bool verbose = true)
+{
+    for (OffsetT i = 0; i < len; i++)
+    {
+        float   a           = computed[i];
+        float   b           = reference[i];
+        if (!AlmostEqualRelative(a, b, 4 * FLT_EPSILON))
+        {
+            if (verbose) std::cout << "INCORRECT [" << i << "]: " << a << " != " << b;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
 #ifdef __NVCC__
 
 /**